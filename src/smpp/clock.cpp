@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#include "smpp/clock.h"
+#include <chrono>
+
+using boost::posix_time::microsec_clock;
+using boost::posix_time::microseconds;
+using boost::posix_time::ptime;
+
+namespace smpp {
+
+/**
+ * Function local, so clocks constructed during static initialization can use it.
+ */
+static const ptime &getEpoch() {
+    static const ptime epoch(boost::gregorian::date(1970, 1, 1));
+    return epoch;
+}
+
+/**
+ * @return Microseconds of std::chrono::steady_clock.
+ */
+static int64_t getSteadyMicroseconds() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ptime SystemClock::universalTime() const {
+    return microsec_clock::universal_time();
+}
+
+ptime SystemClock::steadyTime() const {
+    return getEpoch() + microseconds(getSteadyMicroseconds());
+}
+
+CoarseClock::CoarseClock() :
+    now(0),
+    steady(0) {
+    update();
+}
+
+ptime CoarseClock::universalTime() const {
+    return getEpoch() + microseconds(now.load(std::memory_order_relaxed));
+}
+
+ptime CoarseClock::steadyTime() const {
+    return getEpoch() + microseconds(steady.load(std::memory_order_relaxed));
+}
+
+void CoarseClock::update() {
+    now.store((microsec_clock::universal_time() - getEpoch()).total_microseconds(), std::memory_order_relaxed);
+    steady.store(getSteadyMicroseconds(), std::memory_order_relaxed);
+}
+
+const Clock &getSystemClock() {
+    static const SystemClock clock;
+    return clock;
+}
+
+}  // namespace smpp
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#ifndef SMPP_CLOCK_H_
+#define SMPP_CLOCK_H_
+
+#include <stdint.h>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <atomic>
+
+namespace smpp {
+
+/**
+ * Source of the current time for timestamp resolution and expiry logic.
+ * Implementations can be swapped, so tests can run on a virtual clock.
+ */
+class Clock {
+  public:
+    virtual ~Clock() {
+    }
+
+    /**
+     * @return The current UTC time.
+     */
+    virtual boost::posix_time::ptime universalTime() const = 0;
+
+    /**
+     * @return Time that never steps back with the system clock, counted from an arbitrary start. Use it for
+     * intervals, ie. rates and backoffs, not to tell the time.
+     */
+    virtual boost::posix_time::ptime steadyTime() const = 0;
+
+    /**
+     * Called by the owner of the clock, ie. the I/O loop of a client, each time it wakes up.
+     * Clocks that read the time on demand ignore it.
+     */
+    virtual void update() {
+    }
+};
+
+/**
+ * Reads the system clock on every call.
+ */
+class SystemClock : public Clock {
+  public:
+    boost::posix_time::ptime universalTime() const;
+
+    /**
+     * @return Time of std::chrono::steady_clock.
+     */
+    boost::posix_time::ptime steadyTime() const;
+};
+
+/**
+ * Caches the system time, so reading it is a single atomic load instead of a clock call.
+ * The time only moves when update() is called, so its resolution is the interval between updates.
+ * Reading is safe from any thread while another thread updates it.
+ */
+class CoarseClock : public Clock {
+  private:
+    // microseconds since the epoch
+    std::atomic<int64_t> now;
+    // microseconds of std::chrono::steady_clock
+    std::atomic<int64_t> steady;
+
+  public:
+    /**
+     * Constructs the clock set to the current time.
+     */
+    CoarseClock();
+
+    boost::posix_time::ptime universalTime() const;
+
+    boost::posix_time::ptime steadyTime() const;
+
+    /**
+     * Sets the clock to the current system time.
+     */
+    void update();
+};
+
+/**
+ * A clock that only moves when told to, for tests.
+ */
+class VirtualClock : public Clock {
+  private:
+    boost::posix_time::ptime now;
+
+  public:
+    explicit VirtualClock(const boost::posix_time::ptime &start) :
+        now(start) {
+    }
+
+    boost::posix_time::ptime universalTime() const {
+        return now;
+    }
+
+    /**
+     * @return The same time as universalTime, as it only moves when told to.
+     */
+    boost::posix_time::ptime steadyTime() const {
+        return now;
+    }
+
+    void set(const boost::posix_time::ptime &time) {
+        now = time;
+    }
+
+    void advance(const boost::posix_time::time_duration &td) {
+        now += td;
+    }
+};
+
+/**
+ * Returns a process wide SystemClock, for callers that don't have a clock of their own.
+ */
+const Clock &getSystemClock();
+
+}  // namespace smpp
+
+#endif  // SMPP_CLOCK_H_
@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#ifndef SMPP_FAIRSCHEDULER_H_
+#define SMPP_FAIRSCHEDULER_H_
+
+#include <stdint.h>
+
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "smpp/exceptions.h"
+#include "smpp/priorityscheduler.h"
+
+namespace smpp {
+
+/**
+ * Queue depth and throughput of a tenant of a FairScheduler.
+ */
+struct TenantStats {
+    // Values waiting for their turn
+    size_t queued;
+    // Values taken and not completed yet
+    size_t inFlight;
+    // Values taken since the tenant was first seen
+    uint64_t sent;
+    // Values completed with an answer, ie. not timed out or lost
+    uint64_t answered;
+
+    TenantStats() :
+        queued(0), inFlight(0), sent(0), answered(0) {
+    }
+};
+
+/**
+ * Queue of values of many tenants, which shares the turns between the tenants by deficit round robin.
+ *
+ * Tenants with values queued take turns in a round. On its turn a tenant earns its weight in credit, and each value
+ * taken costs one, so over a round every busy tenant gets turns in proportion to its weight however much it has
+ * queued. A tenant with as many values in flight as its cap is passed over until one completes. Within a tenant the
+ * values are queued by priority in a PriorityScheduler.
+ *
+ * Tenants are known by an id chosen by the caller, and are added on their first value with weight 1 and no cap.
+ */
+template<typename T>
+class FairScheduler {
+  private:
+    struct Tenant {
+        PriorityScheduler<T> queue;
+        unsigned int weight;
+        // Cap on values in flight, 0 for none
+        size_t maxInFlight;
+        // Values it may still take this round
+        unsigned int deficit;
+        TenantStats stats;
+
+        explicit Tenant(const size_t classCount) :
+            queue(classCount), weight(1), maxInFlight(0), deficit(0), stats() {
+        }
+    };
+
+    typedef std::map<std::string, Tenant> TenantMap;
+
+    TenantMap tenants;
+    // Tenants with values queued, in the order of their turns, the first one has the turn
+    std::deque<typename TenantMap::iterator> active;
+    size_t classCount;
+    typename PriorityScheduler<T>::Mode mode;
+    std::vector<unsigned int> classWeights;
+    size_t count;
+
+    typename TenantMap::iterator getTenant(const std::string &id) {
+        typename TenantMap::iterator it = tenants.find(id);
+
+        if (it == tenants.end()) {
+            it = tenants.insert(std::make_pair(id, Tenant(classCount))).first;
+            it->second.queue.setMode(mode, classWeights);
+        }
+
+        return it;
+    }
+
+    bool capped(const Tenant &tenant) const {
+        return tenant.maxInFlight != 0 && tenant.stats.inFlight >= tenant.maxInFlight;
+    }
+
+    void enqueued(const typename TenantMap::iterator &it) {
+        if (it->second.queue.size() == 1) {
+            active.push_back(it);
+        }
+
+        it->second.stats.queued++;
+        count++;
+    }
+
+  public:
+    /**
+     * Constructs an empty scheduler, with strict priorities.
+     * @param _classCount Number of priority classes of each tenant, at least 1.
+     */
+    explicit FairScheduler(const size_t _classCount) :
+        tenants(),
+        active(),
+        classCount(_classCount),
+        mode(PriorityScheduler<T>::STRICT),
+        classWeights(),
+        count(0) {
+        if (classCount == 0) {
+            throw SmppException("Fair scheduler needs at least 1 priority class");
+        }
+    }
+
+    /**
+     * Sets how the priority classes of each tenant share its turns, see PriorityScheduler::setMode.
+     */
+    void setMode(const typename PriorityScheduler<T>::Mode _mode,
+                 const std::vector<unsigned int> &_classWeights = std::vector<unsigned int>()) {
+        // checked on a scheduler of its own, so a bad weight changes nothing
+        PriorityScheduler<T>(classCount).setMode(_mode, _classWeights);
+
+        for (typename TenantMap::iterator it = tenants.begin(); it != tenants.end(); it++) {
+            it->second.queue.setMode(_mode, _classWeights);
+        }
+
+        mode = _mode;
+        classWeights = _classWeights;
+    }
+
+    /**
+     * Sets the share of a tenant.
+     * @param id Tenant id.
+     * @param weight Turns per round, at least 1.
+     * @param maxInFlight Cap on values in flight, 0 for none.
+     * @throw SmppException if the weight is 0.
+     */
+    void setTenant(const std::string &id, const unsigned int weight, const size_t maxInFlight) {
+        if (weight == 0) {
+            throw SmppException("Tenant weight must be at least 1");
+        }
+
+        Tenant &tenant = getTenant(id)->second;
+        tenant.weight = weight;
+        tenant.maxInFlight = maxInFlight;
+    }
+
+    /**
+     * Adds a value behind the others of its tenant and priority.
+     */
+    void push(const std::string &id, const uint8_t priority, const T &value) {
+        typename TenantMap::iterator it = getTenant(id);
+        it->second.queue.push(priority, value);
+        enqueued(it);
+    }
+
+    /**
+     * Adds a value ahead of the others of its tenant and priority.
+     */
+    void pushFront(const std::string &id, const uint8_t priority, const T &value) {
+        typename TenantMap::iterator it = getTenant(id);
+        it->second.queue.pushFront(priority, value);
+        enqueued(it);
+    }
+
+    /**
+     * Finds the value that goes next, moving the turn past tenants that are capped or out of credit.
+     * @return Value that goes next, null if no tenant may take one.
+     */
+    T* front() {
+        for (size_t i = 0; i < active.size(); i++) {
+            Tenant &tenant = active.front()->second;
+
+            if (capped(tenant)) {
+                active.push_back(active.front());
+                active.pop_front();
+                continue;
+            }
+
+            if (tenant.deficit == 0) {
+                tenant.deficit = tenant.weight;
+            }
+
+            return &tenant.queue.front();
+        }
+
+        return NULL;
+    }
+
+    /**
+     * Takes the value front() returned, counting it in flight until complete() is called for it.
+     * @return Tenant of the value.
+     */
+    std::string pop() {
+        typename TenantMap::iterator it = active.front();
+        Tenant &tenant = it->second;
+        tenant.queue.pop();
+        tenant.deficit--;
+        tenant.stats.queued--;
+        tenant.stats.inFlight++;
+        tenant.stats.sent++;
+        count--;
+
+        if (tenant.queue.empty()) {
+            // an idle tenant saves no credit for later
+            tenant.deficit = 0;
+            active.pop_front();
+        } else if (tenant.deficit == 0 || capped(tenant)) {
+            active.push_back(it);
+            active.pop_front();
+        }
+
+        return it->first;
+    }
+
+    /**
+     * Takes a value out of flight, making room under the cap of its tenant.
+     * @param id Tenant pop() returned for the value.
+     * @param answered True if the value was answered, false if it timed out or was lost.
+     */
+    void complete(const std::string &id, const bool answered) {
+        typename TenantMap::iterator it = tenants.find(id);
+
+        if (it == tenants.end() || it->second.stats.inFlight == 0) {
+            return;
+        }
+
+        it->second.stats.inFlight--;
+
+        if (answered) {
+            it->second.stats.answered++;
+        }
+    }
+
+    /**
+     * Removes all queued values, in the order they would have gone, leaving the tenants and what is in flight.
+     * @param values Vector the values are appended to.
+     */
+    void takeAll(std::vector<T>* values) {
+        while (!active.empty()) {
+            Tenant &tenant = active.front()->second;
+
+            for (; !tenant.queue.empty(); tenant.queue.pop()) {
+                values->push_back(tenant.queue.front());
+            }
+
+            tenant.stats.queued = 0;
+            tenant.deficit = 0;
+            active.pop_front();
+        }
+
+        count = 0;
+    }
+
+    /**
+     * @return Stats of each tenant seen.
+     */
+    std::map<std::string, TenantStats> getStats() const {
+        std::map<std::string, TenantStats> stats;
+
+        for (typename TenantMap::const_iterator it = tenants.begin(); it != tenants.end(); it++) {
+            stats[it->first] = it->second.stats;
+        }
+
+        return stats;
+    }
+
+    /**
+     * @return Number of values queued by all tenants.
+     */
+    size_t size() const {
+        return count;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+};
+
+}  // namespace smpp
+
+#endif  // SMPP_FAIRSCHEDULER_H_
@@ -4,8 +4,12 @@
  * @author hd@onlinecity.dk & td@onlinecity.dk
  */
 #include "smpp/gsmencoding.h"
+#include <algorithm>
+#include <map>
+#include <stdexcept>
 #include <string>
 
+using std::map;
 using std::string;
 using oc::tools::GsmDictionary;
 
@@ -183,6 +187,502 @@ string GsmEncoder::getUtf8(const string &input) {
 
     return out;
 }
+
+/*
+ * National language tables - 3GPP TS 23.038 section 6.2.1 and annex A.
+ * Locking shift tables list the character for each of the 128 codes, the escape code 0x1B is left empty.
+ * Single shift tables list only the codes in use, each is sent as 0x1B followed by the code.
+ */
+struct ShiftEntry {
+    uint8_t code;
+    const char* utf8;
+};
+
+static const char* const defaultLockingTable[128] = {
+    "@", "£", "$", "¥", "è", "é", "ù", "ì", "ò", "Ç", "\n", "Ø", "ø", "\r", "Å", "å",
+    "Δ", "_", "Φ", "Γ", "Λ", "Ω", "Π", "Ψ", "Σ", "Θ", "Ξ", "", "Æ", "æ", "ß", "É",
+    " ", "!", "\"", "#", "¤", "%", "&", "'", "(", ")", "*", "+", ",", "-", ".", "/",
+    "0", "1", "2", "3", "4", "5", "6", "7", "8", "9", ":", ";", "<", "=", ">", "?",
+    "¡", "A", "B", "C", "D", "E", "F", "G", "H", "I", "J", "K", "L", "M", "N", "O",
+    "P", "Q", "R", "S", "T", "U", "V", "W", "X", "Y", "Z", "Ä", "Ö", "Ñ", "Ü", "§",
+    "¿", "a", "b", "c", "d", "e", "f", "g", "h", "i", "j", "k", "l", "m", "n", "o",
+    "p", "q", "r", "s", "t", "u", "v", "w", "x", "y", "z", "ä", "ö", "ñ", "ü", "à"
+};
+
+static const char* const turkishLockingTable[128] = {
+    "@", "£", "$", "¥", "€", "é", "ù", "ı", "ò", "Ç", "\n", "Ğ", "ğ", "\r", "Å", "å",
+    "Δ", "_", "Φ", "Γ", "Λ", "Ω", "Π", "Ψ", "Σ", "Θ", "Ξ", "", "Ş", "ş", "ß", "É",
+    " ", "!", "\"", "#", "¤", "%", "&", "'", "(", ")", "*", "+", ",", "-", ".", "/",
+    "0", "1", "2", "3", "4", "5", "6", "7", "8", "9", ":", ";", "<", "=", ">", "?",
+    "İ", "A", "B", "C", "D", "E", "F", "G", "H", "I", "J", "K", "L", "M", "N", "O",
+    "P", "Q", "R", "S", "T", "U", "V", "W", "X", "Y", "Z", "Ä", "Ö", "Ñ", "Ü", "§",
+    "ç", "a", "b", "c", "d", "e", "f", "g", "h", "i", "j", "k", "l", "m", "n", "o",
+    "p", "q", "r", "s", "t", "u", "v", "w", "x", "y", "z", "ä", "ö", "ñ", "ü", "à"
+};
+
+static const char* const portugueseLockingTable[128] = {
+    "@", "£", "$", "¥", "ê", "é", "ú", "í", "ó", "ç", "\n", "Ô", "ô", "\r", "Á", "á",
+    "Δ", "_", "ª", "Ç", "À", "∞", "^", "\\", "€", "Ó", "|", "", "Â", "â", "Ê", "É",
+    " ", "!", "\"", "#", "º", "%", "&", "'", "(", ")", "*", "+", ",", "-", ".", "/",
+    "0", "1", "2", "3", "4", "5", "6", "7", "8", "9", ":", ";", "<", "=", ">", "?",
+    "Í", "A", "B", "C", "D", "E", "F", "G", "H", "I", "J", "K", "L", "M", "N", "O",
+    "P", "Q", "R", "S", "T", "U", "V", "W", "X", "Y", "Z", "Ã", "Õ", "Ú", "Ü", "§",
+    "~", "a", "b", "c", "d", "e", "f", "g", "h", "i", "j", "k", "l", "m", "n", "o",
+    "p", "q", "r", "s", "t", "u", "v", "w", "x", "y", "z", "ã", "õ", "`", "ü", "à"
+};
+
+static const ShiftEntry defaultSingleTable[] = {
+    { 0x14, "^" }, { 0x28, "{" }, { 0x29, "}" }, { 0x2F, "\\" }, { 0x3C, "[" }, { 0x3D, "~" }, { 0x3E, "]" },
+    { 0x40, "|" }, { 0x65, "€" }, { 0x00, NULL }
+};
+
+static const ShiftEntry turkishSingleTable[] = {
+    { 0x14, "^" }, { 0x28, "{" }, { 0x29, "}" }, { 0x2F, "\\" }, { 0x3C, "[" }, { 0x3D, "~" }, { 0x3E, "]" },
+    { 0x40, "|" }, { 0x47, "Ğ" }, { 0x49, "İ" }, { 0x53, "Ş" }, { 0x63, "ç" }, { 0x65, "€" }, { 0x67, "ğ" },
+    { 0x69, "ı" }, { 0x73, "ş" }, { 0x00, NULL }
+};
+
+static const ShiftEntry spanishSingleTable[] = {
+    { 0x09, "ç" }, { 0x14, "^" }, { 0x28, "{" }, { 0x29, "}" }, { 0x2F, "\\" }, { 0x3C, "[" }, { 0x3D, "~" },
+    { 0x3E, "]" }, { 0x40, "|" }, { 0x41, "Á" }, { 0x49, "Í" }, { 0x4F, "Ó" }, { 0x55, "Ú" }, { 0x61, "á" },
+    { 0x65, "€" }, { 0x69, "í" }, { 0x6F, "ó" }, { 0x75, "ú" }, { 0x00, NULL }
+};
+
+static const ShiftEntry portugueseSingleTable[] = {
+    { 0x05, "ê" }, { 0x09, "ç" }, { 0x0B, "Ô" }, { 0x0C, "ô" }, { 0x0E, "Á" }, { 0x0F, "á" }, { 0x12, "Φ" },
+    { 0x13, "Γ" }, { 0x14, "^" }, { 0x15, "Ω" }, { 0x16, "Π" }, { 0x17, "Ψ" }, { 0x18, "Σ" }, { 0x19, "Θ" },
+    { 0x1F, "Ê" }, { 0x28, "{" }, { 0x29, "}" }, { 0x2F, "\\" }, { 0x3C, "[" }, { 0x3D, "~" }, { 0x3E, "]" },
+    { 0x40, "|" }, { 0x41, "À" }, { 0x49, "Í" }, { 0x4F, "Ó" }, { 0x55, "Ú" }, { 0x5B, "Ã" }, { 0x5C, "Õ" },
+    { 0x61, "Â" }, { 0x65, "€" }, { 0x69, "í" }, { 0x6F, "ó" }, { 0x75, "ú" }, { 0x7B, "ã" }, { 0x7C, "õ" },
+    { 0x7F, "â" }, { 0x00, NULL }
+};
+
+/*
+ * Transliterations of characters outside the GSM 03.38 alphabet, sorted by code point.
+ * The replacement is UTF-8 and is encoded with the tables in use, an empty replacement drops the character.
+ */
+struct Transliteration {
+    uint32_t codePoint;
+    const char* replacement;
+};
+
+static const Transliteration transliterations[] = {
+    { 0x00A0, " " }, { 0x00A2, "c" }, { 0x00A6, "|" }, { 0x00A8, "\"" }, { 0x00A9, "(c)" }, { 0x00AB, "\"" },
+    { 0x00AD, "-" }, { 0x00AE, "(R)" }, { 0x00B4, "'" }, { 0x00B7, "." }, { 0x00BB, "\"" }, { 0x00C0, "A" },
+    { 0x00C1, "A" }, { 0x00C2, "A" }, { 0x00C3, "A" }, { 0x00C8, "E" }, { 0x00CA, "E" }, { 0x00CB, "E" },
+    { 0x00CC, "I" }, { 0x00CD, "I" }, { 0x00CE, "I" }, { 0x00CF, "I" }, { 0x00D0, "D" }, { 0x00D2, "O" },
+    { 0x00D3, "O" }, { 0x00D4, "O" }, { 0x00D5, "O" }, { 0x00D7, "x" }, { 0x00D9, "U" }, { 0x00DA, "U" },
+    { 0x00DB, "U" }, { 0x00DD, "Y" }, { 0x00E1, "a" }, { 0x00E2, "a" }, { 0x00E3, "a" }, { 0x00E7, "Ç" },
+    { 0x00EA, "e" }, { 0x00EB, "e" }, { 0x00ED, "i" }, { 0x00EE, "i" }, { 0x00EF, "i" }, { 0x00F0, "d" },
+    { 0x00F3, "o" }, { 0x00F4, "o" }, { 0x00F5, "o" }, { 0x00F7, "/" }, { 0x00FA, "u" }, { 0x00FB, "u" },
+    { 0x00FD, "y" }, { 0x00FF, "y" }, { 0x0100, "A" }, { 0x0101, "a" }, { 0x0102, "A" }, { 0x0103, "a" },
+    { 0x0104, "A" }, { 0x0105, "a" }, { 0x0106, "C" }, { 0x0107, "c" }, { 0x010C, "C" }, { 0x010D, "c" },
+    { 0x010E, "D" }, { 0x010F, "d" }, { 0x0110, "D" }, { 0x0111, "d" }, { 0x0112, "E" }, { 0x0113, "e" },
+    { 0x0118, "E" }, { 0x0119, "e" }, { 0x011A, "E" }, { 0x011B, "e" }, { 0x011E, "G" }, { 0x011F, "g" },
+    { 0x012A, "I" }, { 0x012B, "i" }, { 0x0130, "I" }, { 0x0131, "i" }, { 0x0141, "L" }, { 0x0142, "l" },
+    { 0x0143, "N" }, { 0x0144, "n" }, { 0x0147, "N" }, { 0x0148, "n" }, { 0x014C, "O" }, { 0x014D, "o" },
+    { 0x0150, "Ö" }, { 0x0151, "ö" }, { 0x0152, "OE" }, { 0x0153, "oe" }, { 0x0158, "R" }, { 0x0159, "r" },
+    { 0x015A, "S" }, { 0x015B, "s" }, { 0x015E, "S" }, { 0x015F, "s" }, { 0x0160, "S" }, { 0x0161, "s" },
+    { 0x0162, "T" }, { 0x0163, "t" }, { 0x0164, "T" }, { 0x0165, "t" }, { 0x016A, "U" }, { 0x016B, "u" },
+    { 0x016E, "U" }, { 0x016F, "u" }, { 0x0170, "Ü" }, { 0x0171, "ü" }, { 0x0178, "Y" }, { 0x0179, "Z" },
+    { 0x017A, "z" }, { 0x017B, "Z" }, { 0x017C, "z" }, { 0x017D, "Z" }, { 0x017E, "z" }, { 0x0192, "f" },
+    { 0x0218, "S" }, { 0x0219, "s" }, { 0x021A, "T" }, { 0x021B, "t" }, { 0x02C6, "^" }, { 0x02DC, "~" },
+    { 0x2002, " " }, { 0x2003, " " }, { 0x2004, " " }, { 0x2005, " " }, { 0x2006, " " }, { 0x2007, " " },
+    { 0x2008, " " }, { 0x2009, " " }, { 0x200A, " " }, { 0x200B, "" }, { 0x2010, "-" }, { 0x2011, "-" },
+    { 0x2012, "-" }, { 0x2013, "-" }, { 0x2014, "-" }, { 0x2015, "-" }, { 0x2018, "'" }, { 0x2019, "'" },
+    { 0x201A, "," }, { 0x201B, "'" }, { 0x201C, "\"" }, { 0x201D, "\"" }, { 0x201E, "\"" }, { 0x201F, "\"" },
+    { 0x2020, "+" }, { 0x2022, "*" }, { 0x2026, "..." }, { 0x202F, " " }, { 0x2030, "%" }, { 0x2032, "'" },
+    { 0x2033, "\"" }, { 0x2039, "<" }, { 0x203A, ">" }, { 0x2044, "/" }, { 0x205F, " " }, { 0x2060, "" },
+    { 0x2122, "TM" }, { 0x2190, "<-" }, { 0x2192, "->" }, { 0x2212, "-" }, { 0x2264, "<=" }, { 0x2265, ">=" },
+    { 0x3000, " " }, { 0xFEFF, "" }
+};
+
+static bool operator<(const Transliteration &lhs, const uint32_t &rhs) {
+    return lhs.codePoint < rhs;
+}
+
+// Table combinations tried by findShiftTables, the default alphabet first so it wins ties.
+static const GsmShiftTables candidateTables[] = {
+    GsmShiftTables(GSM_LANGUAGE_DEFAULT, GSM_LANGUAGE_DEFAULT),
+    GsmShiftTables(GSM_LANGUAGE_DEFAULT, GSM_LANGUAGE_TURKISH),
+    GsmShiftTables(GSM_LANGUAGE_DEFAULT, GSM_LANGUAGE_SPANISH),
+    GsmShiftTables(GSM_LANGUAGE_DEFAULT, GSM_LANGUAGE_PORTUGUESE),
+    GsmShiftTables(GSM_LANGUAGE_TURKISH, GSM_LANGUAGE_TURKISH),
+    GsmShiftTables(GSM_LANGUAGE_PORTUGUESE, GSM_LANGUAGE_PORTUGUESE)
+};
+
+static const char* const* getLockingTable(uint8_t language) {
+    switch (language) {
+    case GSM_LANGUAGE_DEFAULT:
+        return defaultLockingTable;
+
+    case GSM_LANGUAGE_TURKISH:
+        return turkishLockingTable;
+
+    case GSM_LANGUAGE_PORTUGUESE:
+        return portugueseLockingTable;
+    }
+
+    throw std::invalid_argument("No national language locking shift table for language");
+}
+
+static const ShiftEntry* getSingleTable(uint8_t language) {
+    switch (language) {
+    case GSM_LANGUAGE_DEFAULT:
+        return defaultSingleTable;
+
+    case GSM_LANGUAGE_TURKISH:
+        return turkishSingleTable;
+
+    case GSM_LANGUAGE_SPANISH:
+        return spanishSingleTable;
+
+    case GSM_LANGUAGE_PORTUGUESE:
+        return portugueseSingleTable;
+    }
+
+    throw std::invalid_argument("No national language single shift table for language");
+}
+
+/**
+ * Builds the dictionary for a pair of shift tables. Characters found in both tables are mapped to the locking
+ * shift table since it needs one septet less.
+ */
+static GsmDictionary buildDictionary(const char* const* locking, const ShiftEntry* single) {
+    GsmDictionary dict;
+
+    for (int code = 0; code < 128; code++) {
+        if (*locking[code] != '\0') {
+            dict.insert(GsmDictionary::value_type(locking[code], string(1, static_cast<char>(code))));
+        }
+    }
+
+    for (; single->utf8 != NULL; single++) {
+        char escaped[] = { 0x1B, static_cast<char>(single->code) };
+        dict.insert(GsmDictionary::value_type(single->utf8, string(escaped, 2)));
+    }
+
+    return dict;
+}
+
+static map<uint16_t, GsmDictionary> buildDictionaries() {
+    static const uint8_t lockingLanguages[] = { GSM_LANGUAGE_DEFAULT, GSM_LANGUAGE_TURKISH, GSM_LANGUAGE_PORTUGUESE };
+    static const uint8_t singleLanguages[] = {
+        GSM_LANGUAGE_DEFAULT, GSM_LANGUAGE_TURKISH, GSM_LANGUAGE_SPANISH, GSM_LANGUAGE_PORTUGUESE
+    };
+    map<uint16_t, GsmDictionary> dictionaries;
+
+    for (size_t l = 0; l < sizeof(lockingLanguages); l++) {
+        for (size_t s = 0; s < sizeof(singleLanguages); s++) {
+            uint16_t key = static_cast<uint16_t>((lockingLanguages[l] << 8) | singleLanguages[s]);
+            dictionaries[key] = buildDictionary(getLockingTable(lockingLanguages[l]),
+                                                getSingleTable(singleLanguages[s]));
+        }
+    }
+
+    return dictionaries;
+}
+
+/**
+ * Returns the dictionary for a pair of shift tables.
+ * All dictionaries are built on first use and kept for the lifetime of the process.
+ * @throw std::invalid_argument if there is no such table.
+ */
+static const GsmDictionary &getDictionary(const GsmShiftTables &tables) {
+    static const map<uint16_t, GsmDictionary> dictionaries = buildDictionaries();
+    map<uint16_t, GsmDictionary>::const_iterator found =
+        dictionaries.find(static_cast<uint16_t>((tables.lockingShift << 8) | tables.singleShift));
+
+    if (found == dictionaries.end()) {
+        throw std::invalid_argument("No such national language shift table");
+    }
+
+    return found->second;
+}
+
+/**
+ * Returns the length of the UTF-8 sequence starting with the given octet.
+ */
+static size_t getUtf8SequenceLength(uint8_t code) {
+    if (code >= 0xF0) {
+        return 4;
+    } else if (code >= 0xE0) {
+        return 3;
+    } else if (code >= 0xC0) {
+        return 2;
+    }
+
+    return 1;
+}
+
+/**
+ * Returns the code point of the UTF-8 sequence of the given length starting at pos.
+ */
+static uint32_t getCodePoint(const string &input, size_t pos, size_t len) {
+    static const uint8_t leadMasks[] = { 0x7F, 0x1F, 0x0F, 0x07 };
+    uint32_t codePoint = static_cast<uint8_t>(input[pos]) & leadMasks[len - 1];
+
+    for (size_t i = 1; i < len; i++) {
+        codePoint = (codePoint << 6) | (static_cast<uint8_t>(input[pos + i]) & 0x3F);
+    }
+
+    return codePoint;
+}
+
+/**
+ * Returns the transliteration of a code point, or NULL if there is none.
+ */
+static const char* getTransliteration(uint32_t codePoint) {
+    const Transliteration* end = transliterations + sizeof(transliterations) / sizeof(transliterations[0]);
+    const Transliteration* found = std::lower_bound(transliterations, end, codePoint);
+
+    if (found == end || found->codePoint != codePoint) {
+        return NULL;
+    }
+
+    return found->replacement;
+}
+
+/**
+ * Destination of the encoder, either a growing string or a fixed size caller buffer.
+ */
+class EncoderOutput {
+  private:
+    string* str;
+    uint8_t* buffer;
+    size_t capacity;
+    size_t written;
+
+  public:
+    explicit EncoderOutput(string* _str) :
+        str(_str), buffer(NULL), capacity(0), written(0) {
+    }
+
+    EncoderOutput(uint8_t* _buffer, const size_t &_capacity) :
+        str(NULL), buffer(_buffer), capacity(_capacity), written(0) {
+    }
+
+    /**
+     * Appends the octets of one character, so an escape sequence is never split.
+     * @return False if the octets don't fit in the buffer, in which case nothing is written.
+     */
+    bool write(const string &octets) {
+        if (str != NULL) {
+            *str += octets;
+        } else if (written + octets.length() > capacity) {
+            return false;
+        } else {
+            std::copy(octets.begin(), octets.end(), buffer + written);
+        }
+
+        written += octets.length();
+        return true;
+    }
+
+    size_t getWritten() const {
+        return written;
+    }
+};
+
+/**
+ * Encodes the input with a dictionary, replacing characters not in the dictionary with '?'.
+ * If transliterate is set, such characters are first looked up in the transliteration table.
+ * Encoding stops at the first character that doesn't fit in the output.
+ *
+ * @param substitutions Incremented for each transliterated character, may be NULL.
+ * @param consumed Set to the number of input octets encoded, may be NULL.
+ * @return Number of characters that had to be replaced by '?'.
+ */
+static int encode(const string &input, const GsmDictionary &dict, const bool transliterate, EncoderOutput* out,
+                  int* substitutions, size_t* consumed) {
+    int unmapped = 0;
+    GsmDictionary::left_const_iterator it;
+    size_t i = 0;
+
+    while (i < input.length()) {
+        size_t len = std::min(getUtf8SequenceLength(static_cast<uint8_t>(input[i])), input.length() - i);
+        it = dict.left.find(input.substr(i, len));
+
+        if (it != dict.left.end()) {
+            if (!out->write(it->second)) {
+                break;
+            }
+        } else if (len > 1 || static_cast<uint8_t>(input[i]) >= 0x20) {  // Unprintable char: ignore
+            const char* replacement = transliterate ? getTransliteration(getCodePoint(input, i, len)) : NULL;
+            string encoded;
+            EncoderOutput replacementOut(&encoded);
+
+            // The replacement must itself be encodable with the dictionary
+            if (replacement != NULL && encode(replacement, dict, false, &replacementOut, NULL, NULL) == 0) {
+                if (!out->write(encoded)) {
+                    break;
+                }
+
+                if (substitutions != NULL) {
+                    (*substitutions)++;
+                }
+            } else {
+                if (!out->write("?")) {
+                    break;
+                }
+
+                unmapped++;
+            }
+        }
+
+        i += len;
+    }
+
+    if (consumed != NULL) {
+        *consumed = i;
+    }
+
+    return unmapped;
+}
+
+/**
+ * Returns the number of segments needed for a message of the given number of septets,
+ * when the UDH of every segment carries the given number of octets besides the concatenation header.
+ */
+static int getGsmSegments(size_t septets, size_t udhOctets) {
+    size_t singleLimit = udhOctets == 0 ? 160 : ((140 - 1 - udhOctets) * 8) / 7;
+
+    if (septets <= singleLimit) {
+        return 1;
+    }
+
+    size_t partLimit = ((140 - 6 - udhOctets) * 8) / 7;
+    return static_cast<int>((septets + partLimit - 1) / partLimit);
+}
+
+/**
+ * Returns the number of segments needed to send the UTF-8 input as UCS-2.
+ */
+static int getUcs2Segments(const string &input) {
+    size_t units = 0;
+
+    for (size_t i = 0; i < input.length(); i += getUtf8SequenceLength(static_cast<uint8_t>(input[i]))) {
+        // code points outside the BMP need a surrogate pair
+        units += getUtf8SequenceLength(static_cast<uint8_t>(input[i])) == 4 ? 2 : 1;
+    }
+
+    if (units <= 70) {
+        return 1;
+    }
+
+    return static_cast<int>((units + 66) / 67);
+}
+
+string GsmShiftTables::getUdhElements() const {
+    string elements;
+
+    if (lockingShift != GSM_LANGUAGE_DEFAULT) {
+        elements += static_cast<char>(UDH_IE_NATIONAL_LOCKING_SHIFT);
+        elements += static_cast<char>(0x01);
+        elements += static_cast<char>(lockingShift);
+    }
+
+    if (singleShift != GSM_LANGUAGE_DEFAULT) {
+        elements += static_cast<char>(UDH_IE_NATIONAL_SINGLE_SHIFT);
+        elements += static_cast<char>(0x01);
+        elements += static_cast<char>(singleShift);
+    }
+
+    return elements;
+}
+
+string GsmEncoder::getGsm0338(const string &input, const GsmShiftTables &tables) {
+    if (tables.isDefault()) {
+        return getGsm0338(input);
+    }
+
+    string out;
+    out.reserve(input.length());
+    EncoderOutput output(&out);
+    encode(input, getDictionary(tables), false, &output, NULL, NULL);
+    return out;
+}
+
+string GsmEncoder::getGsm0338(const string &input, const GsmShiftTables &tables, const bool transliterate,
+                              int* substitutions) {
+    int count = 0;
+    string out;
+    out.reserve(input.length());
+    EncoderOutput output(&out);
+    encode(input, getDictionary(tables), transliterate, &output, &count, NULL);
+
+    if (substitutions != NULL) {
+        *substitutions = count;
+    }
+
+    return out;
+}
+
+size_t GsmEncoder::encodeGsm0338(const string &input, const GsmShiftTables &tables, uint8_t* out, const size_t &outLen,
+                                 size_t* consumed, const bool transliterate, int* substitutions) {
+    int count = 0;
+    EncoderOutput output(out, outLen);
+    encode(input, getDictionary(tables), transliterate, &output, &count, consumed);
+
+    if (substitutions != NULL) {
+        *substitutions = count;
+    }
+
+    return output.getWritten();
+}
+
+string GsmEncoder::getUtf8(const string &input, const GsmShiftTables &tables) {
+    if (tables.isDefault()) {
+        return getUtf8(input);
+    }
+
+    const GsmDictionary &dict = getDictionary(tables);
+    string out;
+    out.reserve(input.length() * 2);
+    GsmDictionary::right_const_iterator it;
+
+    for (size_t i = 0; i < input.length(); i++) {
+        size_t len = (input[i] == 0x1B && i + 1 < input.length()) ? 2 : 1;
+        it = dict.right.find(input.substr(i, len));
+
+        if (it != dict.right.end()) {
+            out += it->second;
+        } else {
+            out += input[i + len - 1];
+        }
+
+        i += len - 1;
+    }
+
+    return out;
+}
+
+bool GsmEncoder::findShiftTables(const string &input, GsmShiftTables* tables, const bool transliterate) {
+    int ucs2Segments = getUcs2Segments(input);
+    int bestSegments = ucs2Segments + 1;
+    int bestSubstitutions = 0;
+
+    for (size_t i = 0; i < sizeof(candidateTables) / sizeof(candidateTables[0]); i++) {
+        string out;
+        EncoderOutput output(&out);
+        int substitutions = 0;
+
+        if (encode(input, getDictionary(candidateTables[i]), transliterate, &output, &substitutions, NULL) != 0) {
+            continue;
+        }
+
+        int segments = getGsmSegments(out.length(), candidateTables[i].getUdhElements().length());
+
+        // Fewest segments first, then fewest transliterated characters
+        if (segments < bestSegments || (segments == bestSegments && substitutions < bestSubstitutions)) {
+            bestSegments = segments;
+            bestSubstitutions = substitutions;
+            *tables = candidateTables[i];
+        }
+    }
+
+    return bestSegments <= ucs2Segments;
+}
 }  // namespace tools
 }  // namespace oc
 
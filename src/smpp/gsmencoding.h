@@ -7,6 +7,7 @@
 #ifndef SMPP_GSMENCODING_H_
 #define SMPP_GSMENCODING_H_
 
+#include <stdint.h>
 #include <boost/bimap/bimap.hpp>
 #include <string>
 
@@ -14,6 +15,46 @@ namespace oc {
 namespace tools {
 typedef boost::bimaps::bimap<std::string, std::string> GsmDictionary;
 
+// National language identifiers - 3GPP TS 23.038 section 6.2.1.2.4
+const uint8_t GSM_LANGUAGE_DEFAULT = 0;
+const uint8_t GSM_LANGUAGE_TURKISH = 1;
+const uint8_t GSM_LANGUAGE_SPANISH = 2;
+const uint8_t GSM_LANGUAGE_PORTUGUESE = 3;
+
+// UDH information element identifiers - 3GPP TS 23.040 section 9.2.3.24
+const uint8_t UDH_IE_CONCAT_8BIT = 0x00;
+const uint8_t UDH_IE_NATIONAL_SINGLE_SHIFT = 0x24;
+const uint8_t UDH_IE_NATIONAL_LOCKING_SHIFT = 0x25;
+
+/**
+ * The pair of national language tables used to encode a message.
+ * The locking shift table replaces the default alphabet, the single shift table replaces the extension table.
+ * Spanish has no locking shift table, only a single shift table.
+ */
+class GsmShiftTables {
+  public:
+    uint8_t lockingShift;
+    uint8_t singleShift;
+
+    explicit GsmShiftTables(const uint8_t &_lockingShift = GSM_LANGUAGE_DEFAULT,
+                            const uint8_t &_singleShift = GSM_LANGUAGE_DEFAULT) :
+        lockingShift(_lockingShift), singleShift(_singleShift) {
+    }
+
+    /**
+     * @return True if both tables are the default GSM 03.38 alphabet and extension table.
+     */
+    bool isDefault() const {
+        return lockingShift == GSM_LANGUAGE_DEFAULT && singleShift == GSM_LANGUAGE_DEFAULT;
+    }
+
+    /**
+     * Returns the UDH information elements announcing the tables to the handset, without the UDH length octet.
+     * Returns an empty string for the default tables.
+     */
+    std::string getUdhElements() const;
+};
+
 /**
  * Class for encoding strings in GSM 0338.
  * It's a singleton so call getInstance.
@@ -27,12 +68,76 @@ class GsmEncoder {
      */
     static std::string getGsm0338(const std::string &input);
 
+    /**
+     * Returns the input string encoded in GSM 0338 using national language shift tables.
+     * Characters not found in either table are replaced by '?'.
+     * @param input String to be encoded.
+     * @param tables National language tables to encode with.
+     * @return Encoded string.
+     * @throw std::invalid_argument if there is no such table.
+     */
+    static std::string getGsm0338(const std::string &input, const GsmShiftTables &tables);
+
+    /**
+     * Returns the input string encoded in GSM 0338, optionally transliterating characters outside the tables
+     * to their closest GSM equivalent, ie. smart quotes to quotes, en-dashes to hyphens and ł to l.
+     * Characters without a transliteration are replaced by '?'.
+     * @param input String to be encoded.
+     * @param tables National language tables to encode with.
+     * @param transliterate True to transliterate characters outside the tables.
+     * @param substitutions Set to the number of transliterated characters, may be NULL.
+     * @return Encoded string.
+     * @throw std::invalid_argument if there is no such table.
+     */
+    static std::string getGsm0338(const std::string &input, const GsmShiftTables &tables, const bool transliterate,
+                                  int* substitutions = NULL);
+
+    /**
+     * Encodes the input in GSM 0338 into a caller provided buffer, ie. the short message part of a PDU under
+     * construction, without building an intermediate string.
+     * Encoding stops before the first character that doesn't fit, an escape sequence is never split.
+     *
+     * @param input String to be encoded.
+     * @param tables National language tables to encode with.
+     * @param out Buffer to write to.
+     * @param outLen Size of the buffer in octets.
+     * @param consumed Set to the number of input octets encoded, may be NULL. Encoding can be resumed from there.
+     * @param transliterate True to transliterate characters outside the tables.
+     * @param substitutions Set to the number of transliterated characters, may be NULL.
+     * @return Number of octets written.
+     * @throw std::invalid_argument if there is no such table.
+     */
+    static size_t encodeGsm0338(const std::string &input, const GsmShiftTables &tables, uint8_t* out,
+                                const size_t &outLen, size_t* consumed = NULL, const bool transliterate = false,
+                                int* substitutions = NULL);
+
     /**
      * Converts an GSM 0338 encoded string into UTF8.
      * @param input String to be encoded.
      * @return UTF8-encoded string.
      */
     static std::string getUtf8(const std::string &input);
+
+    /**
+     * Converts a GSM 0338 string encoded with national language shift tables into UTF8.
+     * @param input String to be decoded.
+     * @param tables National language tables the string was encoded with.
+     * @return UTF8-encoded string.
+     * @throw std::invalid_argument if there is no such table.
+     */
+    static std::string getUtf8(const std::string &input, const GsmShiftTables &tables);
+
+    /**
+     * Finds the national language tables that encode the input in the fewest segments, counting the UDH octets
+     * needed to announce them. Ties are won by the tables needing the fewest transliterations, then by the default
+     * alphabet.
+     *
+     * @param input UTF8 string to be sent.
+     * @param tables Set to the chosen tables.
+     * @param transliterate True if the message will be encoded with transliteration.
+     * @return False if the input can't be encoded in GSM 03.38 or UCS-2 would need fewer segments.
+     */
+    static bool findShiftTables(const std::string &input, GsmShiftTables* tables, const bool transliterate = false);
 };
 }  // namespace tools
 }  // namespace oc
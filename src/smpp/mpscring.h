@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#ifndef SMPP_MPSCRING_H_
+#define SMPP_MPSCRING_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace smpp {
+
+/**
+ * Bounded queue that any number of threads push to without locking, and one thread pops from.
+ *
+ * Each cell carries a sequence number that tells whose turn it is: producers claim a position by advancing the tail
+ * with compare-and-swap, then publish the value by bumping the sequence of its cell, which the consumer waits for.
+ * A full queue fails the push rather than blocking.
+ *
+ * The values must be default constructible and assignable, a popped cell is reset to release what it held.
+ */
+template<typename T>
+class MpscRing {
+  private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    // Producers and consumer are padded onto separate cache lines, so they don't invalidate each other
+    char tailPadding[64];
+    std::atomic<size_t> tail;
+    char headPadding[64];
+    size_t head;
+
+  public:
+    /**
+     * Constructs an empty queue.
+     * @param capacity Number of values it holds, rounded up to a power of two.
+     */
+    explicit MpscRing(const size_t capacity) :
+        cells(),
+        mask(0),
+        tailPadding(),
+        tail(0),
+        headPadding(),
+        head(0) {
+        size_t size = 1;
+
+        while (size < capacity) {
+            size <<= 1;
+        }
+
+        cells.reset(new Cell[size]);
+        mask = size - 1;
+
+        for (size_t i = 0; i < size; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpscRing(const MpscRing &) = delete;
+    MpscRing &operator=(const MpscRing &) = delete;
+
+    /**
+     * Adds a value, from any thread.
+     * @return False if the queue is full.
+     */
+    bool tryPush(const T &value) {
+        size_t position = tail.load(std::memory_order_relaxed);
+
+        while (true) {
+            Cell &cell = cells[position & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    cell.value = value;
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                // the cell still holds the value from one turn ago
+                return false;
+            } else {
+                position = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * Removes the oldest value, from the consumer thread only.
+     * @param value Set to the value.
+     * @return False if no value is ready.
+     */
+    bool tryPop(T* value) {
+        Cell &cell = cells[head & mask];
+
+        if (cell.sequence.load(std::memory_order_acquire) != head + 1) {
+            return false;
+        }
+
+        *value = std::move(cell.value);
+        cell.value = T();
+        cell.sequence.store(head + mask + 1, std::memory_order_release);
+        head++;
+        return true;
+    }
+
+    /**
+     * @return True if tryPop would succeed, from the consumer thread only.
+     */
+    bool ready() const {
+        return cells[head & mask].sequence.load(std::memory_order_acquire) == head + 1;
+    }
+
+    size_t capacity() const {
+        return mask + 1;
+    }
+};
+
+}  // namespace smpp
+
+#endif  // SMPP_MPSCRING_H_
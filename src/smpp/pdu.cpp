@@ -195,7 +195,11 @@ PDU &PDU::operator <<(smpp::TLV tlv) {
 }
 
 PDU &PDU::addOctets(const shared_array<uint8_t> &octets, const streamsize &len) {
-    buf.write(reinterpret_cast<char*>(octets.get()), len);
+    return addOctets(octets.get(), len);
+}
+
+PDU &PDU::addOctets(const uint8_t* octets, const streamsize &len) {
+    buf.write(reinterpret_cast<const char*>(octets), len);
 
     if (buf.fail()) {
         throw smpp::SmppException("PDU failed to write octets");
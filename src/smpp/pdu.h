@@ -113,6 +113,7 @@ class PDU {
     PDU &operator<<(const smpp::SmppAddress);
     PDU &operator<<(const smpp::TLV);
     PDU &addOctets(const boost::shared_array<uint8_t> &octets, const std::streamsize &len);
+    PDU &addOctets(const uint8_t* octets, const std::streamsize &len);
 
     /**
      * Skips n octets.
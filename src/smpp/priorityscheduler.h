@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#ifndef SMPP_PRIORITYSCHEDULER_H_
+#define SMPP_PRIORITYSCHEDULER_H_
+
+#include <stdint.h>
+
+#include <cstddef>
+#include <deque>
+#include <utility>
+#include <vector>
+
+#include "smpp/exceptions.h"
+
+namespace smpp {
+
+/**
+ * Queue of values in priority classes, which decides which value goes next.
+ *
+ * Values keep their order within a class. STRICT always takes from the highest class that has values, so lower
+ * classes only go when the higher ones are empty. WEIGHTED shares out turns by the weight of each class: in a round
+ * every class with values gets as many turns as its weight, highest class first, so a busy high class can't starve
+ * the lower ones.
+ */
+template<typename T>
+class PriorityScheduler {
+  public:
+    enum Mode {
+        STRICT, WEIGHTED
+    };
+
+  private:
+    std::vector<std::deque<T> > classes;
+    std::vector<unsigned int> weights;
+    // Turns each class has left in the current round
+    std::vector<unsigned int> credits;
+    Mode mode;
+    size_t count;
+
+    /**
+     * @return Class the next value is taken from. There must be a value.
+     */
+    size_t select() const {
+        size_t highest = classes.size();
+
+        for (size_t i = classes.size(); i-- > 0;) {
+            if (classes[i].empty()) {
+                continue;
+            }
+
+            if (mode == STRICT || credits[i] > 0) {
+                return i;
+            }
+
+            if (highest == classes.size()) {
+                highest = i;
+            }
+        }
+
+        // every class with values has used its turns, the next round starts with the highest
+        return highest;
+    }
+
+  public:
+    /**
+     * Constructs an empty strict scheduler.
+     * @param classCount Number of classes, at least 1. The highest class is classCount - 1.
+     */
+    explicit PriorityScheduler(const size_t classCount) :
+        classes(classCount),
+        weights(classCount, 1),
+        credits(classCount, 0),
+        mode(STRICT),
+        count(0) {
+        if (classCount == 0) {
+            throw SmppException("Priority scheduler needs at least 1 class");
+        }
+    }
+
+    /**
+     * Sets how the classes share turns.
+     * @param mode STRICT or WEIGHTED.
+     * @param weights Turns per round of each class, lowest class first. Ignored unless WEIGHTED.
+     * @throw SmppException if a weight is missing or 0.
+     */
+    void setMode(const Mode _mode, const std::vector<unsigned int> &_weights = std::vector<unsigned int>()) {
+        if (_mode == WEIGHTED) {
+            if (_weights.size() != classes.size()) {
+                throw SmppException("Priority scheduler needs a weight for each class");
+            }
+
+            for (size_t i = 0; i < _weights.size(); i++) {
+                if (_weights[i] == 0) {
+                    throw SmppException("Priority weights must be at least 1");
+                }
+            }
+
+            weights = _weights;
+        }
+
+        mode = _mode;
+        credits.assign(classes.size(), 0);
+    }
+
+    Mode getMode() const {
+        return mode;
+    }
+
+    /**
+     * Adds a value behind the others of its class.
+     * @param priority Class, higher ones are clamped to the highest.
+     */
+    void push(const uint8_t priority, const T &value) {
+        classes[clamp(priority)].push_back(value);
+        count++;
+    }
+
+    /**
+     * Adds a value ahead of the others of its class.
+     * @param priority Class, higher ones are clamped to the highest.
+     */
+    void pushFront(const uint8_t priority, const T &value) {
+        classes[clamp(priority)].push_front(value);
+        count++;
+    }
+
+    /**
+     * @return Value that goes next. There must be one.
+     */
+    T &front() {
+        return classes[select()].front();
+    }
+
+    /**
+     * Removes the value that goes next, using up a turn of its class. There must be one.
+     */
+    void pop() {
+        size_t next = select();
+
+        if (mode == WEIGHTED) {
+            if (credits[next] == 0) {
+                credits = weights;
+            }
+
+            credits[next]--;
+        }
+
+        classes[next].pop_front();
+        count--;
+    }
+
+    /**
+     * @return Class a priority is queued in.
+     */
+    size_t clamp(const uint8_t priority) const {
+        return priority < classes.size() ? priority : classes.size() - 1;
+    }
+
+    /**
+     * @return Number of values in a class.
+     */
+    size_t size(const uint8_t priority) const {
+        return classes[clamp(priority)].size();
+    }
+
+    /**
+     * @return Number of values in all classes.
+     */
+    size_t size() const {
+        return count;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    size_t getClassCount() const {
+        return classes.size();
+    }
+};
+
+}  // namespace smpp
+
+#endif  // SMPP_PRIORITYSCHEDULER_H_
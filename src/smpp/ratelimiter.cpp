@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#include "smpp/ratelimiter.h"
+#include <algorithm>
+#include "smpp/exceptions.h"
+
+using boost::posix_time::ptime;
+using boost::posix_time::time_duration;
+
+namespace smpp {
+
+RateLimiter::RateLimiter(const double _maxRate, const double _burst) :
+    mutex(),
+    clock(new SystemClock()),
+    maxRate(_maxRate),
+    minRate(std::min(1.0, _maxRate)),
+    rate(_maxRate),
+    burst(_burst),
+    tokens(_burst),
+    lastRefill(clock->steadyTime()),
+    decreaseFactor(0.5),
+    increaseStep(_maxRate / 10),
+    holdoff(boost::posix_time::milliseconds(1000)),
+    lastDecrease(boost::posix_time::min_date_time),
+    throttledCount(0),
+    parent() {
+    if (maxRate <= 0) {
+        throw SmppException("Rate must be positive");
+    }
+
+    if (burst < 1) {
+        throw SmppException("Burst must be at least 1");
+    }
+}
+
+void RateLimiter::refill(const ptime &now) {
+    if (now > lastRefill) {
+        tokens = std::min(burst, tokens + (now - lastRefill).total_microseconds() * rate / 1e6);
+        lastRefill = now;
+    }
+}
+
+time_duration RateLimiter::acquire() {
+    std::lock_guard<std::mutex> lock(mutex);
+    refill(clock->steadyTime());
+
+    if (tokens < 1) {
+        // round up, so the caller doesn't wake just before the token is there
+        return boost::posix_time::microseconds(static_cast<int64_t>((1 - tokens) * 1e6 / rate) + 1);
+    }
+
+    if (parent) {
+        time_duration delay = parent->acquire();
+
+        // keep the token for when the parent allows the submit
+        if (!delay.is_zero()) {
+            return delay;
+        }
+    }
+
+    tokens -= 1;
+    return time_duration();
+}
+
+void RateLimiter::onThrottled() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (parent) {
+        parent->onThrottled();
+    }
+
+    ptime now = clock->steadyTime();
+    throttledCount++;
+
+    if (now < lastDecrease + holdoff) {
+        return;
+    }
+
+    refill(now);
+    rate = std::max(minRate, rate * decreaseFactor);
+    // the SMSC is overloaded now, don't spend what was saved up
+    tokens = std::min(tokens, 0.0);
+    lastDecrease = now;
+}
+
+void RateLimiter::onAccepted() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (parent) {
+        parent->onAccepted();
+    }
+
+    if (rate < maxRate) {
+        // about rate submits are accepted per second, so this adds the step each second
+        refill(clock->steadyTime());
+        rate = std::min(maxRate, rate + increaseStep / rate);
+    }
+}
+
+double RateLimiter::getRate() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return rate;
+}
+
+uint64_t RateLimiter::getThrottledCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return throttledCount;
+}
+
+void RateLimiter::setMinRate(const double r) {
+    std::lock_guard<std::mutex> lock(mutex);
+    minRate = std::min(r, maxRate);
+}
+
+void RateLimiter::setDecreaseFactor(const double f) {
+    if (f <= 0 || f >= 1) {
+        throw SmppException("Decrease factor must be between 0 and 1");
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    decreaseFactor = f;
+}
+
+void RateLimiter::setIncreaseStep(const double step) {
+    std::lock_guard<std::mutex> lock(mutex);
+    increaseStep = step;
+}
+
+void RateLimiter::setHoldoff(const int ms) {
+    std::lock_guard<std::mutex> lock(mutex);
+    holdoff = boost::posix_time::milliseconds(ms);
+}
+
+void RateLimiter::setClock(const std::shared_ptr<Clock> &c) {
+    std::lock_guard<std::mutex> lock(mutex);
+    clock = c;
+    lastRefill = clock->steadyTime();
+}
+
+void RateLimiter::setParent(const std::shared_ptr<RateLimiter> &p) {
+    std::lock_guard<std::mutex> lock(mutex);
+    parent = p;
+}
+}  // namespace smpp
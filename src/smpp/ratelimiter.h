@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#ifndef SMPP_RATELIMITER_H_
+#define SMPP_RATELIMITER_H_
+
+#include <stdint.h>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <memory>
+#include <mutex>
+
+#include "smpp/clock.h"
+
+namespace smpp {
+
+/**
+ * Paces submits to the rate an SMSC account allows, with a token bucket.
+ *
+ * The bucket holds one token by default, so submits are spaced evenly instead of sent in bursts. When the SMSC
+ * answers ESME_RTHROTTLED or ESME_RMSGQFUL the rate is cut by a factor, and each accepted submit then raises it a
+ * little again, until it is back at the maximum (AIMD). The rate settles just under what the SMSC accepts.
+ *
+ * One limiter can be shared by the clients of an account to pace them together. To limit each session as well as the
+ * account, give each client its own limiter with the account limiter as parent. It is thread safe.
+ */
+class RateLimiter {
+  private:
+    mutable std::mutex mutex;
+    std::shared_ptr<Clock> clock;
+    // Contractual maximum, in submits per second
+    double maxRate;
+    // Floor the rate is never cut below
+    double minRate;
+    // Current rate
+    double rate;
+    // Tokens the bucket holds at most
+    double burst;
+    double tokens;
+    boost::posix_time::ptime lastRefill;
+    // Factor the rate is multiplied by on throttling. Default is 0.5.
+    double decreaseFactor;
+    // Submits per second the rate grows by, for each second of accepted submits at the current rate
+    double increaseStep;
+    // Throttling within this time of a cut is taken as the same overload, so one full window doesn't cut repeatedly
+    boost::posix_time::time_duration holdoff;
+    boost::posix_time::ptime lastDecrease;
+    uint64_t throttledCount;
+    // Limiter of the account, that must allow each submit too
+    std::shared_ptr<RateLimiter> parent;
+
+  public:
+    /**
+     * Constructs a limiter.
+     * @param maxRate Submits per second the account allows.
+     * @param burst Submits that may be sent back to back after an idle period, at least 1.
+     */
+    explicit RateLimiter(const double maxRate, const double burst = 1);
+
+    /**
+     * Takes a token if one is available, here and from the parent.
+     * @return Zero if the submit may be sent now, otherwise how long until the next token.
+     */
+    boost::posix_time::time_duration acquire();
+
+    /**
+     * Called when the SMSC throttled a submit, cuts the rate unless it was cut within the holdoff.
+     * The parent is told as well.
+     */
+    void onThrottled();
+
+    /**
+     * Called when the SMSC accepted a submit, raises the rate towards the maximum. The parent is told as well.
+     */
+    void onAccepted();
+
+    /**
+     * @return Current rate in submits per second.
+     */
+    double getRate() const;
+
+    double getMaxRate() const {
+        return maxRate;
+    }
+
+    /**
+     * @return Number of throttled submits reported.
+     */
+    uint64_t getThrottledCount() const;
+
+    /**
+     * Sets the floor of the rate. Default is 1 submit per second.
+     * @param r Submits per second.
+     */
+    void setMinRate(const double r);
+
+    /**
+     * Sets the factor the rate is cut by on throttling, between 0 and 1. Default is 0.5.
+     * @param f Factor.
+     */
+    void setDecreaseFactor(const double f);
+
+    /**
+     * Sets how fast the rate recovers, in submits per second gained for each second of accepted submits.
+     * Default is a tenth of the maximum rate.
+     * @param step Submits per second.
+     */
+    void setIncreaseStep(const double step);
+
+    /**
+     * Sets the time after a cut during which further throttling is ignored. Default is 1000 milliseconds.
+     * @param ms Holdoff in milliseconds.
+     */
+    void setHoldoff(const int ms);
+
+    /**
+     * Replaces the clock the bucket is refilled by, ie. with a VirtualClock in tests. Default is a SystemClock.
+     * Its steadyTime is used, so a step of the system clock neither stalls nor floods the bucket.
+     * @param c Clock to use.
+     */
+    void setClock(const std::shared_ptr<Clock> &c);
+
+    /**
+     * Sets a limiter, ie. of the account, that must allow each submit too.
+     * @param p Parent limiter, or null.
+     */
+    void setParent(const std::shared_ptr<RateLimiter> &p);
+
+  private:
+    /**
+     * Adds the tokens earned since the last refill. The mutex must be held.
+     */
+    void refill(const boost::posix_time::ptime &now);
+};
+}  // namespace smpp
+#endif  // SMPP_RATELIMITER_H_
@@ -0,0 +1,354 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#include "smpp/sessionpool.h"
+#include <condition_variable>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+using boost::asio::ip::tcp;
+using boost::posix_time::ptime;
+using boost::system::error_code;
+
+namespace smpp {
+/**
+ * Result of SessionPool::sendSms, filled in by its handler, possibly on another thread.
+ */
+struct PoolSendResult {
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool done;
+    error_code error;
+    SendSmsResult result;
+
+    PoolSendResult() :
+        mutex(), condition(), done(false), error(), result() {
+    }
+
+    bool isDone() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return done;
+    }
+};
+
+static void storePoolResult(const shared_ptr<PoolSendResult> &sync, const error_code &error,
+                            const SendSmsResult &result) {
+    std::lock_guard<std::mutex> lock(sync->mutex);
+    sync->done = true;
+    sync->error = error;
+    sync->result = result;
+    sync->condition.notify_all();
+}
+
+SessionPool::SessionPool(boost::asio::io_service &_ios, const int _strategy) :
+    ios(_ios),
+    mutex(),
+    sessions(),
+    strategy(_strategy),
+    next(0),
+    metrics(),
+    clock(new SystemClock()),
+    throttleBackoff(boost::posix_time::milliseconds(1000)),
+    lifeline(new bool(true)) {
+}
+
+void SessionPool::addSession(const shared_ptr<SmppClient> &client, const unsigned int weight) {
+    if (weight == 0) {
+        throw SmppException("Session weight must be at least 1");
+    }
+
+    Session session = { client, weight, 0, 0, 0, true, ptime(boost::posix_time::min_date_time) };
+    std::lock_guard<std::mutex> lock(mutex);
+    sessions.push_back(session);
+}
+
+void SessionPool::connect(const tcp::endpoint &endpoint, const string &login,
+                          const string &password, const int count, const unsigned int windowSize) {
+    for (int i = 0; i < count; i++) {
+        shared_ptr<tcp::socket> socket(new tcp::socket(ios));
+        error_code error;
+        socket->connect(endpoint, error);
+
+        if (error) {
+            throw TransportException(boost::system::system_error(error).what());
+        }
+
+        // pipelined submits are small, Nagle would hold them back
+        socket->set_option(tcp::no_delay(true));
+        shared_ptr<SmppClient> client(new SmppClient(socket));
+        client->setWindowSize(windowSize);
+        client->bindTransmitter(login, password);
+        addSession(client);
+    }
+}
+
+bool SessionPool::isAvailable(const Session &session, const ptime &now) const {
+    return session.healthy && session.client->isBound() && now >= session.suspendedUntil;
+}
+
+size_t SessionPool::getAvailableCount() const {
+    ptime now = clock->steadyTime();
+    size_t n = 0;
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (size_t i = 0; i < sessions.size(); i++) {
+        if (isAvailable(sessions[i], now)) {
+            n++;
+        }
+    }
+
+    return n;
+}
+
+size_t SessionPool::pickSession() {
+    ptime now = clock->steadyTime();
+    size_t picked = sessions.size();
+
+    if (strategy == WEIGHTED_ROUND_ROBIN) {
+        // smooth weighted round-robin: every session gains its weight, the one ahead is picked and pays the total
+        int total = 0;
+
+        for (size_t i = 0; i < sessions.size(); i++) {
+            if (!isAvailable(sessions[i], now)) {
+                continue;
+            }
+
+            sessions[i].currentWeight += sessions[i].weight;
+            total += sessions[i].weight;
+
+            if (picked == sessions.size() || sessions[i].currentWeight > sessions[picked].currentWeight) {
+                picked = i;
+            }
+        }
+
+        if (picked != sessions.size()) {
+            sessions[picked].currentWeight -= total;
+        }
+    } else {
+        double least = std::numeric_limits<double>::max();
+
+        for (size_t n = 0; n < sessions.size(); n++) {
+            size_t i = (next + n) % sessions.size();
+
+            if (!isAvailable(sessions[i], now)) {
+                continue;
+            }
+
+            double load = static_cast<double>(sessions[i].outstanding) / sessions[i].weight;
+
+            if (load < least) {
+                least = load;
+                picked = i;
+            }
+        }
+
+        next++;
+    }
+
+    if (picked == sessions.size()) {
+        throw SmppException("No session available");
+    }
+
+    return picked;
+}
+
+void SessionPool::asyncSendSms(const SmppAddress &sender, const SmppAddress &receiver, const string &shortMessage,
+                               const boost::function<void(const error_code &, const SendSmsResult &)> &handler) {
+    startSendSms(sender, receiver, shortMessage, false, handler);
+}
+
+shared_ptr<SmppClient> SessionPool::startSendSms(const SmppAddress &sender, const SmppAddress &receiver,
+        const string &shortMessage, const bool sync,
+        const boost::function<void(const error_code &, const SendSmsResult &)> &handler) {
+    ptime start = clock->steadyTime();
+    size_t index;
+    shared_ptr<SmppClient> client;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        index = pickSession();
+        Session &session = sessions[index];
+        client = session.client;
+
+        // the thread would wait for a handler it should be running itself
+        if (sync && !client->getRunIoService() && ios.get_executor().running_in_this_thread()) {
+            throw SmppException("Synchronous call from a thread running the io_service");
+        }
+
+        if (metrics.started.is_not_a_date_time()) {
+            metrics.started = start;
+        }
+
+        // counted first, as the response may arrive on another thread before asyncSendSms returns
+        session.outstanding++;
+        session.submitted++;
+        metrics.submitted++;
+    }
+
+    try {
+        client->asyncSendSms(sender, receiver, shortMessage,
+                             boost::bind(&SessionPool::handleSendSms, this, std::weak_ptr<bool>(lifeline), index,
+                                         client.get(), start, handler, _1, _2));
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (index < sessions.size() && sessions[index].client == client) {
+            sessions[index].outstanding--;
+            sessions[index].submitted--;
+        }
+
+        metrics.submitted--;
+        throw;
+    }
+
+    return client;
+}
+
+void SessionPool::handleSendSms(const std::weak_ptr<bool> &alive, const size_t index, const SmppClient* client,
+                                const ptime &start,
+                                const boost::function<void(const error_code &, const SendSmsResult &)> &handler,
+                                const error_code &error, const SendSmsResult &result) {
+    if (alive.expired()) {
+        return;
+    }
+
+    ptime now = clock->steadyTime();
+    bool throttled = error.category() == getEsmeCategory() && (error.value() == static_cast<int>(ESME_RTHROTTLED)
+                     || error.value() == static_cast<int>(ESME_RMSGQFUL));
+    std::unique_lock<std::mutex> lock(mutex);
+
+    // the session is gone if the pool was closed meanwhile
+    if (index < sessions.size() && sessions[index].client.get() == client) {
+        Session &session = sessions[index];
+        session.outstanding--;
+
+        if (throttled) {
+            session.suspendedUntil = now + throttleBackoff;
+        } else if (error && error.category() != getEsmeCategory()) {
+            session.healthy = false;
+        }
+    }
+
+    if (error) {
+        metrics.failed++;
+
+        if (throttled) {
+            metrics.throttled++;
+        }
+    } else {
+        boost::posix_time::time_duration latency = now - start;
+        metrics.succeeded++;
+        metrics.totalLatency += latency;
+
+        if (latency > metrics.maxLatency) {
+            metrics.maxLatency = latency;
+        }
+    }
+
+    // the handler may submit again
+    lock.unlock();
+    handler(error, result);
+}
+
+SendSmsResult SessionPool::sendSms(const SmppAddress &sender, const SmppAddress &receiver,
+                                   const string &shortMessage) {
+    shared_ptr<PoolSendResult> result(new PoolSendResult());
+    shared_ptr<SmppClient> client = startSendSms(sender, receiver, shortMessage, true,
+                                                 boost::bind(&storePoolResult, result, _1, _2));
+
+    if (client->getRunIoService()) {
+        while (!result->isDone()) {
+            if (ios.stopped()) {
+                ios.restart();
+            }
+
+            if (ios.run_one() == 0) {
+                throw TransportException("Connection lost");
+            }
+        }
+    } else {
+        std::unique_lock<std::mutex> lock(result->mutex);
+
+        while (!result->done) {
+            result->condition.wait(lock);
+        }
+    }
+
+    SmppClient::throwOnError(result->error);
+    return result->result;
+}
+
+void SessionPool::checkHealth() {
+    vector<std::pair<size_t, shared_ptr<SmppClient> > > bound;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (size_t i = 0; i < sessions.size(); i++) {
+            if (sessions[i].client->isBound()) {
+                bound.push_back(std::make_pair(i, sessions[i].client));
+            } else {
+                sessions[i].healthy = false;
+            }
+        }
+    }
+
+    // outside the lock, a client that runs the io_service may call the handler at once
+    for (size_t i = 0; i < bound.size(); i++) {
+        bound[i].second->asyncEnquireLink(boost::bind(&SessionPool::handleEnquireLink, this,
+                                          std::weak_ptr<bool>(lifeline), bound[i].first, bound[i].second.get(), _1));
+    }
+}
+
+void SessionPool::handleEnquireLink(const std::weak_ptr<bool> &alive, const size_t index, const SmppClient* client,
+                                    const error_code &error) {
+    if (alive.expired()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (index < sessions.size() && sessions[index].client.get() == client) {
+        sessions[index].healthy = !error;
+    }
+}
+
+void SessionPool::close() {
+    vector<Session> closing;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closing.swap(sessions);
+    }
+
+    for (size_t i = 0; i < closing.size(); i++) {
+        if (closing[i].client->isBound()) {
+            try {
+                closing[i].client->unbind();
+            } catch (std::exception &e) {
+                // the session is dropped anyway
+            }
+        }
+    }
+}
+
+double SessionPool::getThroughput() const {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (metrics.started.is_not_a_date_time()) {
+        return 0;
+    }
+
+    double seconds = (clock->steadyTime() - metrics.started).total_microseconds() / 1e6;
+    return seconds > 0 ? metrics.succeeded / seconds : 0;
+}
+}  // namespace smpp
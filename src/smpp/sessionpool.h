@@ -0,0 +1,256 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#ifndef SMPP_SESSIONPOOL_H_
+#define SMPP_SESSIONPOOL_H_
+
+#include <stdint.h>
+#include <utility>
+
+#include <boost/asio.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/function.hpp>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "smpp/clock.h"
+#include "smpp/smppclient.h"
+
+namespace smpp {
+
+/**
+ * Aggregate counters of a SessionPool.
+ */
+struct PoolMetrics {
+    // Messages handed to a session
+    uint64_t submitted;
+    // Messages the SMSC accepted
+    uint64_t succeeded;
+    // Messages that failed, including the throttled ones
+    uint64_t failed;
+    // Messages rejected with ESME_RTHROTTLED or ESME_RMSGQFUL
+    uint64_t throttled;
+    // Sum and maximum of the time from submit to response of the accepted messages
+    boost::posix_time::time_duration totalLatency;
+    boost::posix_time::time_duration maxLatency;
+    // Time of the first submit by the steady time of the clock, only good for measuring intervals
+    boost::posix_time::ptime started;
+
+    PoolMetrics() :
+        submitted(0), succeeded(0), failed(0), throttled(0), totalLatency(), maxLatency(),
+        started(boost::posix_time::not_a_date_time) {
+    }
+
+    /**
+     * @return Mean latency of the accepted messages.
+     */
+    boost::posix_time::time_duration getMeanLatency() const {
+        return succeeded == 0 ? boost::posix_time::time_duration() : totalLatency / static_cast<int>(succeeded);
+    }
+};
+
+/**
+ * Spreads submits over a number of binds to the same SMSC account, as SMSCs cap the throughput of each bind.
+ *
+ * Each message goes to one session, picked by least outstanding submits relative to its weight, or by smooth
+ * weighted round-robin. A session leaves the rotation when it fails on the transport or is no longer bound, and
+ * for a while when the SMSC throttles it. Health checks with enquire_link bring failed sessions back once they
+ * answer.
+ *
+ * The sessions must share one io_service. The pool may be used from many threads, and the handlers of its sessions
+ * may run on many threads of the io_service, as its state is behind a mutex. Set the clock and the backoff before
+ * the first submit. The pool must outlive the submits it has in flight.
+ */
+class SessionPool {
+  public:
+    enum {
+        LEAST_OUTSTANDING, WEIGHTED_ROUND_ROBIN
+    };
+
+  private:
+    struct Session {
+        std::shared_ptr<SmppClient> client;
+        unsigned int weight;
+        // Running weight of smooth weighted round-robin
+        int currentWeight;
+        // Submits awaiting their response
+        size_t outstanding;
+        uint64_t submitted;
+        bool healthy;
+        // Out of rotation until then, after the SMSC throttled it
+        boost::posix_time::ptime suspendedUntil;
+    };
+
+    boost::asio::io_service &ios;
+    // Guards the sessions, the rotation and the metrics
+    mutable std::mutex mutex;
+    std::vector<Session> sessions;
+    int strategy;
+    // Session to start from, so ties are spread rather than always going to the first session
+    size_t next;
+    PoolMetrics metrics;
+    std::shared_ptr<Clock> clock;
+    // How long a throttled session is out of rotation. Default is 1000 milliseconds.
+    boost::posix_time::time_duration throttleBackoff;
+    // Handlers hold a weak reference to it, so handlers run after the pool is destroyed do nothing
+    std::shared_ptr<bool> lifeline;
+
+  public:
+    /**
+     * Constructs an empty pool.
+     * @param ios io_service the sockets of the sessions use.
+     * @param strategy LEAST_OUTSTANDING or WEIGHTED_ROUND_ROBIN.
+     */
+    explicit SessionPool(boost::asio::io_service &ios, const int strategy = LEAST_OUTSTANDING);
+
+    /**
+     * Adds a session that is bound as transmitter or transceiver. Its socket must use the io_service of the pool.
+     * @param client Bound client.
+     * @param weight Share of the submits relative to the other sessions, at least 1.
+     */
+    void addSession(const std::shared_ptr<SmppClient> &client, const unsigned int weight = 1);
+
+    /**
+     * Opens a number of sessions to an SMSC, binding each as transmitter.
+     * @param endpoint SMSC to connect to.
+     * @param login SMSC login.
+     * @param password SMSC password.
+     * @param count Number of sessions to open.
+     * @param windowSize Transmit window of each session.
+     * @throw TransportException if a connection fails, SmppException if a bind is rejected.
+     */
+    void connect(const boost::asio::ip::tcp::endpoint &endpoint, const std::string &login,
+                 const std::string &password, const int count, const unsigned int windowSize = 1);
+
+    /**
+     * Sends an SMS through one of the available sessions. See SmppClient::asyncSendSms.
+     * The handler is called from the io_service of the sessions. A throttled message is not retried.
+     * @param handler Handler of the result.
+     * @throw SmppException if no session is available.
+     */
+    void asyncSendSms(const SmppAddress &sender, const SmppAddress &receiver, const std::string &shortMessage,
+                      const boost::function<void(const boost::system::error_code &, const SendSmsResult &)> &handler);
+
+    /**
+     * Sends an SMS through one of the available sessions and waits until it is answered. Like the synchronous calls
+     * of the client, it runs the io_service if the clients do, see SmppClient::setRunIoService, and otherwise waits
+     * for the threads running it.
+     * @return SMSC id of the last part and the number of parts.
+     * @throw SmppException if no session is available, the SMSC rejected the SMS or the call is made from a thread
+     * running the io_service the clients don't run, TransportException if no response arrived.
+     */
+    SendSmsResult sendSms(const SmppAddress &sender, const SmppAddress &receiver, const std::string &shortMessage);
+
+    /**
+     * Sends an enquire_link on every bound session. Sessions that answer return to the rotation, sessions that
+     * fail leave it. The results arrive as the io_service runs.
+     */
+    void checkHealth();
+
+    /**
+     * Unbinds all sessions and removes them from the pool.
+     */
+    void close();
+
+    /**
+     * @return Number of sessions in the pool.
+     */
+    size_t getSessionCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return sessions.size();
+    }
+
+    /**
+     * @return Number of sessions submits can be sent through now.
+     */
+    size_t getAvailableCount() const;
+
+    /**
+     * @param index Session, in the order they were added.
+     * @return Number of messages sent through the session.
+     */
+    uint64_t getSubmitted(const size_t index) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return sessions.at(index).submitted;
+    }
+
+    /**
+     * @param index Session, in the order they were added.
+     * @return Number of messages awaiting a response on the session.
+     */
+    size_t getOutstanding(const size_t index) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return sessions.at(index).outstanding;
+    }
+
+    /**
+     * @return Copy of the counters, as they go on changing while submits are answered.
+     */
+    PoolMetrics getMetrics() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return metrics;
+    }
+
+    /**
+     * @return Accepted messages per second since the first submit.
+     */
+    double getThroughput() const;
+
+    /**
+     * Sets how long a session the SMSC throttled is out of rotation.
+     * @param backoff Backoff in milliseconds.
+     */
+    void setThrottleBackoff(const int backoff) {
+        throttleBackoff = boost::posix_time::milliseconds(backoff);
+    }
+
+    /**
+     * Replaces the clock latencies and backoffs are measured with, by its steady time so a step of the system clock
+     * doesn't stretch them, ie. with a VirtualClock in tests.
+     * Default is a SystemClock.
+     * @param c Clock to use.
+     */
+    void setClock(const std::shared_ptr<Clock> &c) {
+        clock = c;
+    }
+
+  private:
+    /**
+     * @return True if submits can be sent through the session now.
+     */
+    bool isAvailable(const Session &session, const boost::posix_time::ptime &now) const;
+
+    /**
+     * Picks the session for the next submit. Called with the mutex held.
+     * @return Index of the session.
+     * @throw SmppException if no session is available.
+     */
+    size_t pickSession();
+
+    /**
+     * Sends an SMS through the session pickSession picks, counting it outstanding until the handler is called.
+     * @param sync True for a synchronous call, which may not wait from a thread running the io_service.
+     * @return Client of the session.
+     * @throw SmppException if no session is available.
+     */
+    std::shared_ptr<SmppClient> startSendSms(const SmppAddress &sender, const SmppAddress &receiver,
+                                             const std::string &shortMessage, const bool sync,
+                                             const boost::function<void(const boost::system::error_code &,
+                                                                        const SendSmsResult &)> &handler);
+
+    void handleSendSms(const std::weak_ptr<bool> &alive, const size_t index, const SmppClient* client,
+                       const boost::posix_time::ptime &start,
+                       const boost::function<void(const boost::system::error_code &, const SendSmsResult &)> &handler,
+                       const boost::system::error_code &error, const SendSmsResult &result);
+
+    void handleEnquireLink(const std::weak_ptr<bool> &alive, const size_t index, const SmppClient* client,
+                           const boost::system::error_code &error);
+};
+}  // namespace smpp
+#endif  // SMPP_SESSIONPOOL_H_
@@ -160,4 +160,27 @@ string getEsmeStatus(uint32_t i) {
         return "Unknown";
     }
 }
+
+/**
+ * Maps command statuses to their description.
+ */
+class EsmeCategory: public boost::system::error_category {
+  public:
+    const char* name() const BOOST_SYSTEM_NOEXCEPT {
+        return "smpp";
+    }
+
+    string message(int ev) const {
+        return getEsmeStatus(ev);
+    }
+};
+
+const boost::system::error_category &getEsmeCategory() {
+    static const EsmeCategory category;
+    return category;
+}
+
+boost::system::error_code makeEsmeError(uint32_t status) {
+    return boost::system::error_code(status, getEsmeCategory());
+}
 }  // namespace smpp
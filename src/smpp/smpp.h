@@ -8,6 +8,7 @@
 #define SMPP_SMPP_H_
 
 #include <stdint.h>
+#include <boost/system/error_code.hpp>
 #include <string>
 
 namespace smpp {
@@ -190,6 +191,18 @@ const uint8_t STATE_REJECTED = 8;
 
 std::string getEsmeStatus(uint32_t);
 
+/**
+ * Error category of SMPP command statuses, so the status of a response can be passed in a boost::system::error_code.
+ * The messages are those of getEsmeStatus.
+ */
+const boost::system::error_category &getEsmeCategory();
+
+/**
+ * @param status Command status of a response.
+ * @return error_code in the ESME category holding the status.
+ */
+boost::system::error_code makeEsmeError(uint32_t status);
+
 class SmppAddress {
   public:
     std::string value;
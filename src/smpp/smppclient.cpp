@@ -6,7 +6,11 @@
 
 #include "smpp/smppclient.h"
 #include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
 #include <list>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <utility>
@@ -28,8 +32,60 @@ using boost::asio::async_write;
 using boost::asio::buffer;
 using boost::local_time::local_date_time;
 using boost::local_time::not_a_date_time;
+using oc::tools::GsmShiftTables;
 
 namespace smpp {
+/**
+ * Set by the handler of the asynchronous call a synchronous call waits for, from the strand of the client.
+ */
+struct SyncFlag {
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool done;
+
+    SyncFlag() :
+        mutex(), condition(), done(false) {
+    }
+
+    bool isDone() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return done;
+    }
+};
+
+/**
+ * Outcome of an asynchronous call, filled in by its handler while a synchronous call waits for it.
+ */
+template<typename Result>
+struct SyncResult : public SyncFlag {
+    error_code error;
+    optional<Result> result;
+
+    SyncResult() :
+        SyncFlag(), error(), result() {
+    }
+};
+
+template<typename Result>
+static void storeResult(const shared_ptr<SyncResult<Result> > &sync, const error_code &error, const Result &result) {
+    std::lock_guard<std::mutex> lock(sync->mutex);
+    sync->error = error;
+    sync->result.emplace(result);
+    sync->done = true;
+    sync->condition.notify_all();
+}
+
+static void setFlag(const shared_ptr<bool> &flag, const error_code &error) {
+    if (!error) {
+        *flag = true;
+    }
+}
+
+template<typename Entry>
+static bool compareSequenceNo(const Entry &a, const Entry &b) {
+    return a.first < b.first;
+}
+
 SmppClient::SmppClient(shared_ptr<tcp::socket> _socket) :
     systemType("WWW"), /**/
     interfaceVersion(0x34), /**/
@@ -45,22 +101,97 @@ SmppClient::SmppClient(shared_ptr<tcp::socket> _socket) :
     nullTerminateOctetStrings(true), /**/
     csmsMethod(SmppClient::CSMS_16BIT_TAGS), /**/
     msgRefCallback(&SmppClient::defaultMessageRef), /**/
+    deliverSmHandler(), /**/
+    dataSmHandler(), /**/
+    alertNotificationHandler(), /**/
+    enquireLinkHandler(), /**/
+    unbindHandler(), /**/
+    connectionLostHandler(), /**/
     state(OPEN), /**/
     socket(_socket), /**/
+    strand(_socket->get_executor()), /**/
     seqNo(0), /**/
     pdu_queue(), /**/
+    smsQueueLimit(1000), /**/
+    windowSize(1), /**/
+    pending(), /**/
+    timeoutWheel(), /**/
+    wheelTimer(_socket->get_executor()), /**/
+    wheelRunning(false), /**/
+    wheelStart(), /**/
+    wheelBase(0), /**/
+    wheelResolution(100), /**/
+    timeoutResolution(100), /**/
+    waiting(PRIORITY_CLASSES), /**/
+    waitingMutex(), /**/
+    spool(), /**/
+    spooledInFlight(), /**/
+    latencyMutex(), /**/
+    latencyStats(PRIORITY_CLASSES), /**/
+    rateLimiter(), /**/
+    pacingTimer(_socket->get_executor()), /**/
+    pacing(false), /**/
+    submitResults(), /**/
+    submitsInFlight(0), /**/
+    writeQueue(), /**/
+    writeBatch(0), /**/
+    queuedOctets(0), /**/
+    maxWritePdus(64), /**/
+    maxWriteOctets(65536), /**/
+    writeLinger(0), /**/
+    lingerTimer(_socket->get_executor()), /**/
+    lingering(false), /**/
+    writeTimer(_socket->get_executor()), /**/
+    writeCount(0), /**/
+    writtenPduCount(0), /**/
+    reading(false), /**/
+    enquireLinkInterval(0), /**/
+    maxMissedEnquireLinks(3), /**/
+    keepaliveTimer(_socket->get_executor()), /**/
+    keepaliveRunning(false), /**/
+    receivedPdus(0), /**/
+    keepaliveReceived(0), /**/
+    keepaliveOutstanding(false), /**/
+    missedEnquireLinks(0), /**/
+    bindMode(0), /**/
+    bindLogin(), /**/
+    bindPassword(), /**/
+    reconnectEnabled(false), /**/
+    reconnectEndpoint(), /**/
+    reconnectPolicy(AT_LEAST_ONCE), /**/
+    reconnectBackoff(100), /**/
+    maxReconnectBackoff(30000), /**/
+    reconnectTimer(_socket->get_executor()), /**/
+    reconnectAttempts(0), /**/
+    reconnectJitter(std::random_device()()), /**/
+    reconnecting(false), /**/
+    rebinding(false), /**/
+    reconnectHandler(), /**/
+    multiUnsupported(false), /**/
+    submitQueue(new MpscRing<QueuedSubmit>(1024)), /**/
+    drainPosted(false), /**/
+    smsHandlers(), /**/
+    lifeline(new bool(true)), /**/
     socketWriteTimeout(5000), /**/
     socketReadTimeout(30000), /**/
-    verbose(false) {
+    verbose(false), /**/
+    runIoService(true), /**/
+    clock(new CoarseClock()) {
 }
 
 SmppClient::~SmppClient() {
     try {
-        if (state != OPEN) {
+        // a client that is reconnecting has no connection to unbind
+        if (state != OPEN && !reconnecting) {
             unbind();
         }
     } catch (std::exception &e) {
     }
+
+    // handlers still queued in the io_service must not touch the client
+    lifeline.reset();
+    error_code ec;
+    socket->cancel(ec);
 }
 
 void SmppClient::bindTransmitter(const string &login, const string &pass) {
@@ -71,24 +202,58 @@ void SmppClient::bindReceiver(const string &login, const string &pass) {
     bind(smpp::BIND_RECEIVER, login, pass);
 }
 
+void SmppClient::bindTransceiver(const string &login, const string &pass) {
+    bind(smpp::BIND_TRANSCEIVER, login, pass);
+}
+
 void SmppClient::bind(uint32_t mode, const string &login, const string &password) {
     checkConnection();
     checkState(OPEN);
-    PDU pdu = setupBindPdu(mode, login, password);
-    sendCommand(pdu);
+    shared_ptr<SyncResult<string> > result(new SyncResult<string>());
+    boost::function<void(const error_code &, const string &)> handler = boost::bind(&storeResult<string>, result,
+            _1, _2);
+    execute(boost::bind(&SmppClient::startBind, this, shared_ptr<PDU>(new PDU(setupBindPdu(mode, login, password))),
+                        handler), *result);
+    throwOnError(result->error);
+}
 
-    switch (mode) {
-    case smpp::BIND_RECEIVER:
-        state = BOUND_RX;
-        break;
+void SmppClient::startBind(const shared_ptr<PDU> &pdu,
+                           const boost::function<void(const error_code &, const string &)> &handler) {
+    sendRequest(*pdu, boost::bind(&SmppClient::handleBindResponse, this, pdu->getCommandId(), handler, _1, _2));
+}
 
-    case smpp::BIND_TRANSMITTER:
-        state = BOUND_TX;
-        break;
+void SmppClient::handleBindResponse(const uint32_t mode,
+                                    const boost::function<void(const error_code &, const string &)> &handler,
+                                    const error_code &error, PDU &resp) {
+    string systemId;
+
+    if (!error) {
+        resp >> systemId;
+
+        switch (mode) {
+        case smpp::BIND_RECEIVER:
+            state = BOUND_RX;
+            break;
+
+        case smpp::BIND_TRANSMITTER:
+            state = BOUND_TX;
+            break;
+
+        case smpp::BIND_TRANSCEIVER:
+            state = BOUND_TRX;
+            break;
+        }
+
+        startKeepalive();
     }
+
+    handler(error, systemId);
 }
 
 PDU SmppClient::setupBindPdu(uint32_t mode, const string &login, const string &password) {
+    bindMode = mode;
+    bindLogin = login;
+    bindPassword = password;
     PDU pdu(mode, 0, nextSequenceNumber());
     pdu << login;
     pdu << password;
@@ -101,16 +266,25 @@ PDU SmppClient::setupBindPdu(uint32_t mode, const string &login, const string &p
 }
 
 void SmppClient::unbind() {
-    checkConnection();
+    shared_ptr<SyncResult<bool> > result(new SyncResult<bool>());
+    boost::function<void(const error_code &)> handler = boost::bind(&storeResult<bool>, result, _1, true);
+    execute(boost::bind(&SmppClient::startUnbind, this, handler), *result);
+    throwOnError(result->error);
+}
+
+void SmppClient::startUnbind(const boost::function<void(const error_code &)> &handler) {
     PDU pdu(smpp::UNBIND, 0, nextSequenceNumber());
-    PDU resp = sendCommand(pdu);
-    uint32_t pduStatus = resp.getCommandStatus();
+    sendRequest(pdu, boost::bind(&SmppClient::handleUnbindResponse, this, handler, _1, _2));
+}
 
-    if (pduStatus != smpp::ESME_ROK) {
-        throw smpp::SmppException(smpp::getEsmeStatus(pduStatus));
+void SmppClient::handleUnbindResponse(const boost::function<void(const error_code &)> &handler,
+                                      const error_code &error, PDU &resp) {
+    if (!error) {
+        state = OPEN;
+        stopKeepalive();
     }
 
-    state = OPEN;
+    handler(error);
 }
 
 /**
@@ -118,10 +292,62 @@ void SmppClient::unbind() {
  */
 pair<string, int> SmppClient::sendSms(const SmppAddress &sender, const SmppAddress &receiver, const string &shortMessage,
                            list<TLV> tags, const uint8_t priority_flag, const string &schedule_delivery_time,
-                           const string &validity_period, const int dataCoding) {
+                           const string &validity_period, const int dataCoding, const GsmShiftTables &shiftTables) {
+    shared_ptr<SyncResult<SendSmsResult> > result(new SyncResult<SendSmsResult>());
+    boost::function<void(const error_code &, const SendSmsResult &)> handler =
+        boost::bind(&storeResult<SendSmsResult>, result, _1, _2);
+    execute(boost::bind(&SmppClient::startSendSms, this,
+                        setupSubmitSm(sender, receiver, shortMessage, tags, priority_flag, schedule_delivery_time,
+                                      validity_period, dataCoding, shiftTables), string(), priority_flag, handler),
+            *result);
+    throwOnError(result->error);
+    return *result->result;
+}
+
+vector<uint32_t> SmppClient::submitSms(const SmppAddress &sender, const SmppAddress &receiver,
+                                       const string &shortMessage, list<TLV> tags, const uint8_t priority_flag,
+                                       const string &schedule_delivery_time, const string &validity_period,
+                                       const int dataCoding, const GsmShiftTables &shiftTables) {
+    checkRunIoService();
+    vector<shared_ptr<PDU> > parts = setupSubmitSm(sender, receiver, shortMessage, tags, priority_flag,
+                                     schedule_delivery_time, validity_period, dataCoding, shiftTables);
+    vector<uint32_t> sequenceNumbers;
+
+    for (vector<shared_ptr<PDU> >::iterator itr = parts.begin(); itr != parts.end(); itr++) {
+        // back-pressure, wait for room in the window rather than queueing without bounds
+        while (pending.size() + waiting.size() >= windowSize) {
+            runOne();
+        }
+
+        uint32_t sequenceNo = (*itr)->getSequenceNo();
+        submitsInFlight++;
+        sendRequest(**itr, boost::bind(&SmppClient::storeSubmitResult, this, sequenceNo, _1, _2), string(),
+                    priority_flag);
+        sequenceNumbers.push_back(sequenceNo);
+    }
+
+    return sequenceNumbers;
+}
+
+vector<shared_ptr<PDU> > SmppClient::setupSubmitSm(const SmppAddress &sender, const SmppAddress &receiver,
+        const string &shortMessage, list<TLV> tags, const uint8_t priority_flag,
+        const string &schedule_delivery_time, const string &validity_period, const int dataCoding,
+        const GsmShiftTables &shiftTables) {
+    return setupSubmit(smpp::SUBMIT_SM, sender, vector<MultiDestination>(1, MultiDestination(receiver)), shortMessage,
+                       tags, priority_flag, schedule_delivery_time, validity_period, dataCoding, shiftTables);
+}
+
+vector<shared_ptr<PDU> > SmppClient::setupSubmit(const uint32_t commandId, const SmppAddress &sender,
+        const vector<MultiDestination> &destinations, const string &shortMessage, list<TLV> tags,
+        const uint8_t priority_flag, const string &schedule_delivery_time, const string &validity_period,
+        const int dataCoding, const GsmShiftTables &shiftTables) {
+    checkState(BOUND_TX, BOUND_TRX);
+    vector<shared_ptr<PDU> > pdus;
     int messageLen = shortMessage.length();
     int singleSmsOctetLimit = 254;  // Default SMPP standard
     int csmsSplit = -1;  // where to split
+    // National language shift tables must be announced in the UDH of every part
+    string languageUdh;
 
     switch (dataCoding) {
     case smpp::DATA_CODING_UCS2:
@@ -132,56 +358,69 @@ pair<string, int> SmppClient::sendSms(const SmppAddress &sender, const SmppAddre
     case smpp::DATA_CODING_DEFAULT:
         singleSmsOctetLimit = 160;
         csmsSplit = 152;
+        languageUdh = shiftTables.getUdhElements();
+
+        if (!languageUdh.empty()) {
+            // Each UDH octet takes the room of 8/7 septet
+            singleSmsOctetLimit -= (8 * (languageUdh.length() + 1) + 6) / 7;
+            csmsSplit -= (8 * languageUdh.length() + 6) / 7;
+        }
+
         break;
     }
 
+    // UDH for messages not needing a CSMS header
+    string udh;
+
+    if (!languageUdh.empty()) {
+        udh += static_cast<char>(languageUdh.length());
+        udh += languageUdh;
+    }
+
+    uint8_t udhEsmClass = udh.empty() ? esmClass : (esmClass | smpp::ESM_UHDI);
+
     // submit_sm if the short message could fit into one pdu.
     if (messageLen <= singleSmsOctetLimit || csmsMethod == CSMS_PAYLOAD) {
-        string smscId = submitSm(sender, receiver, shortMessage, tags, priority_flag, schedule_delivery_time, validity_period,
-                        esmClass, dataCoding);
-        return std::make_pair(smscId, 1);
+        pdus.push_back(setupSubmitSmPdu(commandId, sender, destinations, udh, shortMessage.data(), messageLen,
+                                        tags, priority_flag, schedule_delivery_time, validity_period, udhEsmClass,
+                                        dataCoding));
+        return pdus;
     }
 
-    // CSMS -> split message
-    vector<string> parts = split(shortMessage, csmsSplit);
-    vector<string>::iterator itr = parts.begin();
+    // CSMS -> split message, parts are sent straight from shortMessage
+    vector<size_t> parts = split(shortMessage, csmsSplit);
+    const char* part = shortMessage.data();
 
     if (csmsMethod == CSMS_8BIT_UDH) {
         // encode an udh with an 8bit csms reference
-        uint8_t segment = 0;
         uint8_t segments = numeric_cast<uint8_t>(parts.size());
-        string smsId;
-        uint8_t csmsRef = static_cast<uint8_t>(msgRefCallback() & 0xff);
-
-        for (; itr < parts.end(); itr++) {
-            // encode udh
-            int partSize = (*itr).size();
-            int size = 6 + partSize;
-            boost::scoped_array<uint8_t> udh(new uint8_t[size]);
-            udh[0] = 0x05;  // length of udh excluding first byte
-            udh[1] = 0x00;  //
-            udh[2] = 0x03;  // length of the header
-            udh[3] = csmsRef;
-            udh[4] = segments;
-            udh[5] = ++segment;
-            // concatenate with message part
-            copy((*itr).begin(), (*itr).end(), &udh[6]);
-            string message(reinterpret_cast<char*>(udh.get()), size);
-            smsId = submitSm(sender, receiver, message, tags, priority_flag, schedule_delivery_time, validity_period,
-                             esmClass | 0x40, dataCoding);
-        }
-
-        return std::make_pair(smsId, segments);
+        string csmsUdh(6, '\0');
+        csmsUdh[0] = static_cast<char>(5 + languageUdh.length());  // length of udh excluding first byte
+        csmsUdh[1] = 0x00;
+        csmsUdh[2] = 0x03;  // length of the header
+        csmsUdh[3] = static_cast<char>(msgRefCallback() & 0xff);
+        csmsUdh[4] = static_cast<char>(segments);
+        csmsUdh += languageUdh;
+
+        for (size_t segment = 0; segment < parts.size(); segment++) {
+            csmsUdh[5] = static_cast<char>(segment + 1);
+            pdus.push_back(setupSubmitSmPdu(commandId, sender, destinations, csmsUdh, part, parts[segment], tags,
+                                            priority_flag, schedule_delivery_time, validity_period,
+                                            esmClass | smpp::ESM_UHDI, dataCoding));
+            part += parts[segment];
+        }
+
+        return pdus;
     } else {  // csmsMethod == CSMS_16BIT_TAGS)
         tags.push_back(TLV(smpp::tags::SAR_MSG_REF_NUM, static_cast<uint16_t>(msgRefCallback())));
         tags.push_back(TLV(smpp::tags::SAR_TOTAL_SEGMENTS, boost::numeric_cast<uint8_t>(parts.size())));
         int segment = 0;
-        string smsId;
 
-        for (; itr < parts.end(); itr++) {
+        for (vector<size_t>::iterator itr = parts.begin(); itr < parts.end(); itr++) {
             tags.push_back(TLV(smpp::tags::SAR_SEGMENT_SEQNUM, ++segment));
-            smsId = submitSm(sender, receiver, (*itr), tags, priority_flag, schedule_delivery_time, validity_period,
-                             esmClass, dataCoding);
+            pdus.push_back(setupSubmitSmPdu(commandId, sender, destinations, udh, part, *itr, tags, priority_flag,
+                                            schedule_delivery_time, validity_period, udhEsmClass, dataCoding));
+            part += *itr;
             // pop SAR_SEGMENT_SEQNUM tag
             tags.pop_back();
         }
@@ -190,419 +429,1575 @@ pair<string, int> SmppClient::sendSms(const SmppAddress &sender, const SmppAddre
         tags.pop_back();
         // pop SAR_MSG_REF_NUM tag
         tags.pop_back();
-        return std::make_pair(smsId, segment);
+        return pdus;
     }
 }
 
-SMS SmppClient::readSms() {
-    // see if we're bound correct.
-    checkState(BOUND_RX);
-
-    // if  there are any messages in the queue pop the first usable one off and return it
-    if (!pdu_queue.empty()) {
-        return parseSms();
-    }
+SubmitResult SmppClient::readSubmitResult() {
+    checkRunIoService();
 
-    // fill queue until we get a DELIVER_SM command
-    try {
-        bool b = false;
-
-        while (!b) {
-            PDU pdu = readPdu(true);
+    while (submitResults.empty()) {
+        if (submitsInFlight == 0) {
+            throw SmppException("No submits outstanding");
+        }
 
-            if (pdu.getCommandId() == ENQUIRE_LINK) {
-                PDU resp = PDU(ENQUIRE_LINK_RESP, 0, pdu.getSequenceNo());
-                sendPdu(resp);
-                continue;
-            }
+        runOne();
+    }
 
-            if (pdu.null) {
-                break;
-            }
+    SubmitResult result = submitResults.front();
+    submitResults.pop_front();
+    return result;
+}
 
-            if (!pdu.null) {
-                pdu_queue.push_back(pdu);    // save pdu for reading later
-            }
+void SmppClient::storeSubmitResult(const uint32_t sequenceNo, const error_code &error, PDU &resp) {
+    submitsInFlight--;
+    SubmitResult result;
+    result.sequenceNo = sequenceNo;
+    result.commandStatus = resp.null ? smpp::ESME_RUNKNOWNERR : resp.getCommandStatus();
+    result.error = error;
 
-            b = pdu.getCommandId() == DELIVER_SM;
-        }
-    } catch (std::exception &e) {
-        throw smpp::TransportException(e.what());
+    if (!error && resp.getCommandId() == smpp::SUBMIT_SM_RESP) {
+        resp >> result.messageId;
     }
 
-    return parseSms();
+    submitResults.push_back(result);
 }
 
-QuerySmResult SmppClient::querySm(std::string messageid, SmppAddress source) {
-    PDU pdu = PDU(QUERY_SM, 0, nextSequenceNumber());
-    pdu << messageid;
-    pdu << source.ton;
-    pdu << source.npi;
-    pdu << source.value;
-    PDU reply = sendCommand(pdu);
-    string msgid;
-    string final_date;
-    uint8_t message_state;
-    uint8_t error_code;
-    reply >> msgid;
-    reply >> final_date;
-    reply >> message_state;
-    reply >> error_code;
-    local_date_time ldt(not_a_date_time);
-
-    if (final_date.length() > 1) {
-        smpp::timeformat::DatePair p = smpp::timeformat::parseSmppTimestamp(final_date);
-        ldt = p.first;
+bool SmppClient::trySubmit(const string &tenant, const SmppAddress &sender, const SmppAddress &receiver,
+                           const string &shortMessage, const list<TLV> &tags, const uint8_t priority_flag,
+                           const string &schedule_delivery_time, const string &validity_period, const int dataCoding,
+                           const GsmShiftTables &shiftTables,
+                           const boost::function<void(const error_code &, const SendSmsResult &)> &handler) {
+    QueuedSubmit submit = { setupSubmitSm(sender, receiver, shortMessage, tags, priority_flag, schedule_delivery_time,
+                                          validity_period, dataCoding, shiftTables), tenant, priority_flag, handler
+                          };
+
+    if (!submitQueue->tryPush(submit)) {
+        return false;
     }
 
-    return QuerySmResult(msgid, ldt, message_state, error_code);
-}
+    // one drain at a time is posted, it picks up everything queued until it finishes
+    if (!drainPosted.exchange(true)) {
+        boost::asio::post(strand, boost::bind(&SmppClient::drainSubmitQueue, this, std::weak_ptr<bool>(lifeline)));
+    }
 
-void SmppClient::enquireLink() {
-    PDU pdu = PDU(ENQUIRE_LINK, 0, nextSequenceNumber());
-    sendCommand(pdu);
+    return true;
 }
 
-SMS SmppClient::parseSms() {
-    if (pdu_queue.empty()) {
-        return SMS();
+void SmppClient::drainSubmitQueue(const std::weak_ptr<bool> &alive) {
+    if (alive.expired()) {
+        return;
     }
 
-    list<PDU>::iterator it = pdu_queue.begin();
+    QueuedSubmit submit;
 
-    while (it != pdu_queue.end()) {
-        if ((*it).getCommandId() == DELIVER_SM) {
-            SMS sms(*it);
-            // send response to smsc
-            PDU resp = PDU(DELIVER_SM_RESP, 0x0, (*it).getSequenceNo());
-            resp << 0x0;
-            sendPdu(resp);
-            // remove sms from queue
-            pdu_queue.erase(it);
-            return sms;
+    while (true) {
+        while (submitQueue->tryPop(&submit)) {
+            startSendSms(submit.parts, submit.tenant, submit.priority, submit.handler);
         }
 
-        if ((*it).getCommandId() == ALERT_NOTIFICATION) {
-            it = pdu_queue.erase(it);
-            continue;
-        }
+        drainPosted = false;
 
-        if ((*it).getCommandId() == DATA_SM) {
-            PDU resp = PDU(DATA_SM_RESP, 0x0, (*it).getSequenceNo());
-            resp << 0x0;
-            sendPdu(resp);
-            it = pdu_queue.erase(it);
-            continue;
+        // a producer that found the flag still set relies on this drain for its SMS
+        if (!submitQueue->ready() || drainPosted.exchange(true)) {
+            return;
         }
+    }
+}
+
+/**
+ * Progress of the parts of an SMS sent with startSendSms.
+ */
+struct SendSmsState {
+    size_t remaining;
+    error_code error;
+    SendSmsResult result;
+    boost::function<void(const error_code &, const SendSmsResult &)> handler;
+};
+
+static void handleSendSmsPart(const shared_ptr<SendSmsState> &state, const bool last, const error_code &error,
+                              PDU &resp) {
+    if (error && !state->error) {
+        state->error = error;
+    }
 
-        ++it;
+    // the SMSC id of the last part is the one reported
+    if (!error && last) {
+        resp >> state->result.first;
     }
 
-    return SMS();
+    if (--state->remaining == 0) {
+        state->handler(state->error, state->result);
+    }
 }
 
-vector<string> SmppClient::split(const string &shortMessage, const int split) {
-    vector<string> parts;
-    int len = shortMessage.length();
-    int pos = 0;
-    int n = split;
+void SmppClient::startSendSms(const vector<shared_ptr<PDU> > &parts, const string &tenant, const uint8_t priority,
+                              const boost::function<void(const error_code &, const SendSmsResult &)> &handler) {
+    shared_ptr<SendSmsState> state(new SendSmsState());
+    state->remaining = parts.size();
+    state->result = SendSmsResult("", parts.size());
+    state->handler = handler;
 
-    while (pos < len) {
-        if (static_cast<int>(shortMessage[pos + n - 1]) == 0x1b) {  // do not split at escape char
-            n--;
-        }
+    for (size_t i = 0; i < parts.size(); i++) {
+        sendRequest(*parts[i], boost::bind(&handleSendSmsPart, state, i + 1 == parts.size(), _1, _2), tenant,
+                    priority);
+    }
+}
 
-        parts.push_back(shortMessage.substr(pos, n));
-        pos += n;
-        n = split;
+/**
+ * Progress of a sendMulti. The destinations are sent in chunks, one SUBMIT_MULTI per part of each chunk.
+ */
+struct SendMultiState {
+    struct Chunk {
+        vector<MultiDestination> destinations;
+        vector<shared_ptr<PDU> > parts;
+        // Parts not answered yet
+        size_t remaining;
+        // Set if the SMSC rejected SUBMIT_MULTI for the chunk
+        bool rejected;
+    };
+
+    vector<Chunk> chunks;
+    // PDUs not answered yet
+    size_t remaining;
+    error_code error;
+    SendMultiResult result;
+    boost::function<void(const error_code &, const SendMultiResult &)> handler;
+
+    // The SMS, to send it with SUBMIT_SM if the SMSC rejects SUBMIT_MULTI
+    SmppAddress sender;
+    string shortMessage;
+    list<TLV> tags;
+    uint8_t priorityFlag;
+    string scheduleDeliveryTime;
+    string validityPeriod;
+    int dataCoding;
+    GsmShiftTables shiftTables;
+
+    explicit SendMultiState(const SmppAddress &_sender) :
+        chunks(), remaining(0), error(), result(), handler(), sender(_sender), shortMessage(), tags(),
+        priorityFlag(0), scheduleDeliveryTime(), validityPeriod(), dataCoding(0), shiftTables() {
+        result.pdus = 0;
+        result.fallback = false;
+    }
 
-        if (pos + n > len) {
-            n = len - pos;
+    void addUnsuccessful(const SmppAddress &address, const uint32_t status) {
+        // every part of a message reports the same destinations
+        for (size_t i = 0; i < result.unsuccessful.size(); i++) {
+            const SmppAddress &known = result.unsuccessful[i].address;
+
+            if (known.value == address.value && known.ton == address.ton && known.npi == address.npi) {
+                return;
+            }
         }
+
+        UnsuccessfulDelivery delivery = { address, status };
+        result.unsuccessful.push_back(delivery);
     }
+};
 
-    return parts;
+/**
+ * @return True if the response says the SMSC does not support SUBMIT_MULTI, rather than rejecting this one.
+ */
+static bool isMultiUnsupported(const error_code &error, PDU &resp) {
+    if (resp.null) {
+        return false;
+    }
+
+    return resp.getCommandId() == smpp::GENERIC_NACK
+           || (error.category() == getEsmeCategory() && error.value() == static_cast<int>(smpp::ESME_RINVCMDID));
 }
 
-string SmppClient::submitSm(const SmppAddress &sender, const SmppAddress &receiver, const string &shortMessage,
-                            list<TLV> tags, const uint8_t priority_flag, const string &schedule_delivery_time,
-                            const string &validity_period, const int esmClassOpt, const int dataCoding) {
-    checkState(BOUND_TX);
-    PDU pdu(smpp::SUBMIT_SM, 0, nextSequenceNumber());
-    pdu << serviceType;
-    pdu << sender;
-    pdu << receiver;
-    pdu << esmClassOpt;
-    pdu << protocolId;
-    pdu << priority_flag;
-    pdu << schedule_delivery_time;
-    pdu << validity_period;
-    pdu << registeredDelivery;
-    pdu << replaceIfPresentFlag;
-    pdu << dataCoding;
-    pdu << smDefaultMsgId;
+SendMultiResult SmppClient::sendMulti(const SmppAddress &sender, const vector<MultiDestination> &destinations,
+                                      const string &shortMessage, const list<TLV> &tags,
+                                      const uint8_t priority_flag, const string &schedule_delivery_time,
+                                      const string &validity_period, const int dataCoding,
+                                      const GsmShiftTables &shiftTables) {
+    shared_ptr<SyncResult<SendMultiResult> > result(new SyncResult<SendMultiResult>());
+    boost::function<void(const error_code &, const SendMultiResult &)> handler =
+        boost::bind(&storeResult<SendMultiResult>, result, _1, _2);
+    execute(boost::bind(&SmppClient::startSendMulti, this,
+                        setupSendMulti(sender, destinations, shortMessage, tags, priority_flag,
+                                       schedule_delivery_time, validity_period, dataCoding, shiftTables), handler),
+            *result);
+    throwOnError(result->error);
+    return *result->result;
+}
 
-    if (csmsMethod == CSMS_PAYLOAD) {
-        pdu << 0;  // sm_length = 0
-        pdu << TLV(smpp::tags::MESSAGE_PAYLOAD, shortMessage);
-    } else {
-        pdu.setNullTerminateOctetStrings(nullTerminateOctetStrings);
-        pdu << boost::numeric_cast<uint8_t>(shortMessage.length()) + (nullTerminateOctetStrings ? 1 : 0);
-        pdu << shortMessage;
-        pdu.setNullTerminateOctetStrings(true);
-    }
+shared_ptr<SendMultiState> SmppClient::setupSendMulti(const SmppAddress &sender,
+        const vector<MultiDestination> &destinations, const string &shortMessage, const list<TLV> &tags,
+        const uint8_t priority_flag, const string &schedule_delivery_time, const string &validity_period,
+        const int dataCoding, const GsmShiftTables &shiftTables) {
+    checkState(BOUND_TX, BOUND_TRX);
 
-    // add  optional tags.
-    for (list<TLV>::iterator itr = tags.begin(); itr != tags.end(); itr++) {
-        pdu << *itr;
+    if (destinations.empty()) {
+        throw SmppException("No destinations");
     }
 
-    PDU resp = sendCommand(pdu);
-    string messageid;
-    resp >> messageid;
-    return messageid;
-}
+    shared_ptr<SendMultiState> state(new SendMultiState(sender));
+    state->shortMessage = shortMessage;
+    state->tags = tags;
+    state->priorityFlag = priority_flag;
+    state->scheduleDeliveryTime = schedule_delivery_time;
+    state->validityPeriod = validity_period;
+    state->dataCoding = dataCoding;
+    state->shiftTables = shiftTables;
+
+    for (size_t first = 0; first < destinations.size(); first += MAX_MULTI_DESTINATIONS) {
+        SendMultiState::Chunk chunk;
+        chunk.destinations.assign(destinations.begin() + first,
+                                  destinations.begin() + std::min(first + MAX_MULTI_DESTINATIONS,
+                                          destinations.size()));
+        chunk.remaining = 0;
+        chunk.rejected = multiUnsupported;
+
+        if (!chunk.rejected) {
+            chunk.parts = setupSubmit(smpp::SUBMIT_MULTI, sender, chunk.destinations, shortMessage, tags,
+                                      priority_flag, schedule_delivery_time, validity_period, dataCoding,
+                                      shiftTables);
+        }
 
-uint32_t SmppClient::nextSequenceNumber() {
-    if (++seqNo > 0x7FFFFFFF) {
-        throw SmppException("Ran out of sequence numbers");
+        state->chunks.push_back(chunk);
     }
 
-    return seqNo;
+    return state;
 }
 
-void SmppClient::sendPdu(PDU &pdu) {
-    checkConnection();
-    optional<error_code> ioResult;
-    optional<error_code> timerResult;
+void SmppClient::startSendMulti(const shared_ptr<SendMultiState> &state,
+                                const boost::function<void(const error_code &, const SendMultiResult &)> &handler) {
+    state->handler = handler;
+    // held until every PDU is sent, so responses arriving meanwhile don't finish early
+    state->remaining++;
 
-    if (verbose) {
-        LOG(INFO) << pdu;
-    }
+    for (size_t i = 0; i < state->chunks.size(); i++) {
+        SendMultiState::Chunk &chunk = state->chunks[i];
 
-    deadline_timer timer(getIoService());
-    timer.expires_from_now(boost::posix_time::milliseconds(socketWriteTimeout));
-    timer.async_wait(boost::bind(&SmppClient::handleTimeout, this, &timerResult, _1));
-    async_write(*socket, buffer(pdu.getOctets().get(), pdu.getSize()),
-                boost::bind(&SmppClient::writeHandler, this, &ioResult, _1));
-    socketExecute();
+        // the SMSC may have rejected SUBMIT_MULTI since the chunk was set up
+        if (chunk.rejected || multiUnsupported) {
+            chunk.rejected = true;
+            sendMultiFallback(state, chunk.destinations);
+            continue;
+        }
 
-    if (ioResult) {
-        timer.cancel();
-    } else if (timerResult) {
-        socket->cancel();
+        chunk.remaining = chunk.parts.size();
+        state->remaining += chunk.parts.size();
+        state->result.pdus += chunk.parts.size();
+
+        for (size_t part = 0; part < chunk.parts.size(); part++) {
+            sendRequest(*chunk.parts[part], boost::bind(&SmppClient::handleSendMultiPart, this, state, i,
+                        part + 1 == chunk.parts.size(), _1, _2), string(), state->priorityFlag);
+        }
     }
 
-    socketExecute();
+    state->remaining--;
+    finishSendMulti(state);
 }
 
-PDU SmppClient::sendCommand(PDU &pdu) {
-    sendPdu(pdu);
-    PDU resp = readPduResponse(pdu.getSequenceNo(), pdu.getCommandId());
+void SmppClient::sendMultiFallback(const shared_ptr<SendMultiState> &state,
+                                   const vector<MultiDestination> &destinations) {
+    state->result.fallback = true;
 
-    switch (resp.getCommandStatus()) {
-    case smpp::ESME_RINVPASWD:
-        throw smpp::InvalidPasswordException(smpp::getEsmeStatus(resp.getCommandStatus()));
-        break;
+    for (vector<MultiDestination>::const_iterator itr = destinations.begin(); itr != destinations.end(); itr++) {
+        if (itr->flag != smpp::DEST_FLAG_SME) {
+            // only the SMSC can expand a distribution list
+            state->addUnsuccessful(SmppAddress(itr->listName), smpp::ESME_RINVCMDID);
+            continue;
+        }
 
-    case smpp::ESME_RINVSYSID:
-        throw smpp::InvalidSystemIdException(smpp::getEsmeStatus(resp.getCommandStatus()));
-        break;
+        vector<shared_ptr<PDU> > parts = setupSubmit(smpp::SUBMIT_SM, state->sender,
+                                         vector<MultiDestination>(1, *itr), state->shortMessage, state->tags,
+                                         state->priorityFlag, state->scheduleDeliveryTime, state->validityPeriod,
+                                         state->dataCoding, state->shiftTables);
+        state->remaining += parts.size();
+        state->result.pdus += parts.size();
 
-    case smpp::ESME_RINVSRCADR:
-        throw smpp::InvalidSourceAddressException(smpp::getEsmeStatus(resp.getCommandStatus()));
-        break;
+        for (size_t part = 0; part < parts.size(); part++) {
+            sendRequest(*parts[part], boost::bind(&SmppClient::handleSendMultiFallback, this, state, itr->address,
+                                                  part + 1 == parts.size(), _1, _2), string(), state->priorityFlag);
+        }
+    }
+}
 
-    case smpp::ESME_RINVDSTADR:
-        throw smpp::InvalidDestinationAddressException(smpp::getEsmeStatus(resp.getCommandStatus()));
-        break;
+void SmppClient::handleSendMultiPart(const shared_ptr<SendMultiState> &state, const size_t index, const bool last,
+                                     const error_code &error, PDU &resp) {
+    SendMultiState::Chunk &chunk = state->chunks[index];
+    chunk.remaining--;
+
+    if (isMultiUnsupported(error, resp)) {
+        multiUnsupported = true;
+        chunk.rejected = true;
+    } else if (error) {
+        if (!state->error) {
+            state->error = error;
+        }
+    } else {
+        string messageId;
+        uint8_t count = 0;
+        resp >> messageId;
+        resp >> count;
+
+        if (last) {
+            state->result.messageId = messageId;
+        }
+
+        for (int i = 0; i < count; i++) {
+            SmppAddress address("");
+            uint32_t status;
+            resp >> address.ton;
+            resp >> address.npi;
+            resp >> address.value;
+            resp >> status;
+            state->addUnsuccessful(address, status);
+        }
     }
 
-    if (resp.getCommandStatus() != smpp::ESME_ROK) {
-        throw smpp::SmppException(smpp::getEsmeStatus(resp.getCommandStatus()));
+    // the chunk is sent as SUBMIT_SM once all of its parts are answered
+    if (chunk.remaining == 0 && chunk.rejected && !state->error) {
+        sendMultiFallback(state, chunk.destinations);
     }
 
-    return resp;
+    state->remaining--;
+    finishSendMulti(state);
 }
 
-PDU SmppClient::readPdu(const bool &isBlocking) {
-    // return NULL pdu if there is nothing on the wire for us.
-    if (!isBlocking && !socketPeek()) {
-        return PDU();
+void SmppClient::handleSendMultiFallback(const shared_ptr<SendMultiState> &state, const SmppAddress &address,
+        const bool last, const error_code &error, PDU &resp) {
+    if (error.category() == getEsmeCategory()) {
+        state->addUnsuccessful(address, error.value());
+    } else if (error) {
+        if (!state->error) {
+            state->error = error;
+        }
+    } else if (last) {
+        resp >> state->result.messageId;
     }
 
-    readPduBlocking();
+    state->remaining--;
+    finishSendMulti(state);
+}
 
-    // There are no pdus to be read return a null pdu.
-    if (pdu_queue.empty()) {
-        return PDU();
+void SmppClient::finishSendMulti(const shared_ptr<SendMultiState> &state) {
+    if (state->remaining == 0 && state->handler) {
+        boost::function<void(const error_code &, const SendMultiResult &)> handler;
+        handler.swap(state->handler);
+        handler(state->error, state->result);
     }
+}
 
-    // Return last the pdu inserted into the queue.
-    PDU pdu = pdu_queue.back();
-    pdu_queue.pop_back();
+SMS SmppClient::readSms() {
+    checkRunIoService();
+    // see if we're bound correct.
+    checkState(BOUND_RX, BOUND_TRX);
+    SMS sms = parseSms();
 
-    if (verbose) {
-        LOG(INFO) << pdu;
+    if (!sms.is_null) {
+        return sms;
     }
 
-    return pdu;
-}
-
-bool SmppClient::socketPeek() {
-    // prepare our read
-    shared_array<uint8_t> pduHeader(new uint8_t[4]);
-    async_read(*socket, buffer(pduHeader.get(), 4),
-               boost::bind(&smpp::SmppClient::readPduHeaderHandler, this, _1, _2, pduHeader));
-    size_t handlersCalled = getIoService().poll_one();
-    getIoService().reset();
-    socket->cancel();
-    socketExecute();
-    return handlersCalled != 0;
-}
-
-void SmppClient::readPduBlocking() {
-    optional<error_code> ioResult;
-    optional<error_code> timerResult;
-    shared_array<uint8_t> pduHeader(new uint8_t[4]);
-    async_read(*socket, boost::asio::buffer(pduHeader.get(), 4),
-               boost::bind(&SmppClient::readPduHeaderHandlerBlocking, this, &ioResult, _1, _2, pduHeader));
+    // run the read loop until a DELIVER_SM is queued or the read times out
+    startRead();
+    shared_ptr<bool> timedOut(new bool(false));
     deadline_timer timer(getIoService());
     timer.expires_from_now(boost::posix_time::milliseconds(socketReadTimeout));
-    timer.async_wait(boost::bind(&SmppClient::handleTimeout, this, &timerResult, _1));
-    socketExecute();
+    timer.async_wait(boost::bind(&setFlag, timedOut, _1));
 
-    if (ioResult) {
-        timer.cancel();
-    } else if (timerResult) {
-        socket->cancel();
+    while (sms.is_null && !*timedOut) {
+        runOne();
+        sms = parseSms();
     }
 
-    socketExecute();
+    return sms;
 }
 
-void SmppClient::handleTimeout(optional<error_code>* opt, const error_code &error) {
-    opt->reset(error);
+void SmppClient::startReadSms(const boost::function<void(const error_code &, const SMS &)> &handler) {
+    checkState(BOUND_RX, BOUND_TRX);
+    smsHandlers.push_back(handler);
+    deliverSms();
+    startRead();
 }
 
-void SmppClient::writeHandler(optional<error_code>* opt, const error_code &error) {
-    opt->reset(error);
+void SmppClient::deliverSms() {
+    while (!smsHandlers.empty()) {
+        SMS sms = parseSms();
 
-    if (error) {
-        throw TransportException(system_error(error).what());
+        if (sms.is_null) {
+            return;
+        }
+
+        boost::function<void(const error_code &, const SMS &)> handler = smsHandlers.front();
+        smsHandlers.pop_front();
+        handler(error_code(), sms);
     }
 }
 
-void SmppClient::socketExecute() {
-    getIoService().run_one();
-    getIoService().reset();
+QuerySmResult SmppClient::querySm(std::string messageid, SmppAddress source) {
+    shared_ptr<SyncResult<QuerySmResult> > result(new SyncResult<QuerySmResult>());
+    boost::function<void(const error_code &, const QuerySmResult &)> handler =
+        boost::bind(&storeResult<QuerySmResult>, result, _1, _2);
+    execute(boost::bind(&SmppClient::startQuerySm, this, setupQuerySm(messageid, source), handler), *result);
+    throwOnError(result->error);
+    return *result->result;
+}
+
+shared_ptr<PDU> SmppClient::setupQuerySm(const string &messageid, const SmppAddress &source) {
+    shared_ptr<PDU> pdu(new PDU(QUERY_SM, 0, nextSequenceNumber()));
+    *pdu << messageid;
+    *pdu << source.ton;
+    *pdu << source.npi;
+    *pdu << source.value;
+    return pdu;
+}
+
+void SmppClient::startQuerySm(const shared_ptr<PDU> &pdu,
+                              const boost::function<void(const error_code &, const QuerySmResult &)> &handler) {
+    sendRequest(*pdu, boost::bind(&SmppClient::handleQuerySmResponse, this, handler, _1, _2));
 }
 
-void SmppClient::readPduHeaderHandler(const error_code &error, size_t len, const shared_array<uint8_t> &pduLength) {
+void SmppClient::handleQuerySmResponse(const boost::function<void(const error_code &, const QuerySmResult &)>
+                                       &handler, const error_code &error, PDU &reply) {
     if (error) {
-        if (error == boost::asio::error::operation_aborted) {
-            // Not treated as an error
+        handler(error, QuerySmResult("", local_date_time(not_a_date_time), 0, 0));
+        return;
+    }
+
+    string msgid;
+    string final_date;
+    uint8_t message_state;
+    uint8_t error_code;
+    reply >> msgid;
+    reply >> final_date;
+    reply >> message_state;
+    reply >> error_code;
+    local_date_time ldt(not_a_date_time);
+
+    if (final_date.length() > 1) {
+        try {
+            smpp::timeformat::DatePair p = smpp::timeformat::parseSmppTimestamp(final_date, *clock);
+            ldt = p.first;
+        } catch (SmppException &e) {
+            // thrown out of a completion handler it would reach io_service::run, and the query is no longer pending
+            handler(boost::system::errc::make_error_code(boost::system::errc::protocol_error),
+                    QuerySmResult(msgid, ldt, message_state, error_code));
             return;
         }
-
-        throw TransportException(system_error(error).what());
     }
 
-    uint32_t i = PDU::getPduLength(pduLength);
-    shared_array<uint8_t> pduBuffer(new uint8_t[i]);
-    // start reading after the size mark of the pdu
-    async_read(*socket, buffer(pduBuffer.get(), i - 4),
-               boost::bind(&smpp::SmppClient::readPduBodyHandler, this, _1, _2, pduLength, pduBuffer));
-    socketExecute();
+    handler(error, QuerySmResult(msgid, ldt, message_state, error_code));
 }
 
-void SmppClient::readPduHeaderHandlerBlocking(optional<error_code>* opt, const error_code &error, size_t read,
-        shared_array<uint8_t> pduLength) {
-    if (error) {
-        if (error == boost::asio::error::operation_aborted) {
-            // Not treated as an error
-            return;
-        }
+void SmppClient::enquireLink() {
+    shared_ptr<SyncResult<bool> > result(new SyncResult<bool>());
+    boost::function<void(const error_code &)> handler = boost::bind(&storeResult<bool>, result, _1, true);
+    execute(boost::bind(&SmppClient::startEnquireLink, this, handler), *result);
+    throwOnError(result->error);
+}
 
-        throw TransportException(system_error(error).what());
+void SmppClient::startEnquireLink(const boost::function<void(const error_code &)> &handler) {
+    PDU pdu = PDU(ENQUIRE_LINK, 0, nextSequenceNumber());
+    // the response has no body, only the error is passed on
+    sendRequest(pdu, boost::bind(handler, _1));
+}
+
+void SmppClient::startKeepalive() {
+    if (enquireLinkInterval <= 0) {
+        return;
     }
 
-    opt->reset(error);
-    uint32_t i = PDU::getPduLength(pduLength);
-    shared_array<uint8_t> pduBuffer(new uint8_t[i - 4]);
-    // start reading after the size mark of the pdu
-    async_read(*socket, buffer(pduBuffer.get(), i - 4),
-               boost::bind(&smpp::SmppClient::readPduBodyHandler, this, _1, _2, pduLength, pduBuffer));
-    socketExecute();
+    keepaliveRunning = true;
+    keepaliveReceived = receivedPdus;
+    missedEnquireLinks = 0;
+    keepaliveTimer.expires_after(std::chrono::milliseconds(enquireLinkInterval));
+    keepaliveTimer.async_wait(boost::asio::bind_executor(strand, boost::bind(&SmppClient::handleKeepalive, this,
+                              std::weak_ptr<bool>(lifeline), _1)));
 }
 
-void SmppClient::readPduBodyHandler(const error_code &error, size_t len, shared_array<uint8_t> pduLength,
-                                    shared_array<uint8_t> pduBuffer) {
-    if (error) {
-        throw TransportException(system_error(error).what());
+void SmppClient::stopKeepalive() {
+    if (keepaliveRunning) {
+        keepaliveRunning = false;
+        keepaliveTimer.cancel();
     }
+}
 
-    PDU pdu(pduLength, pduBuffer);
-    pdu_queue.push_back(pdu);
+void SmppClient::handleKeepalive(const std::weak_ptr<bool> &alive, const error_code &error) {
+    if (alive.expired() || error || !keepaliveRunning) {
+        return;
+    }
+
+    if (state == OPEN) {
+        keepaliveRunning = false;
+        return;
+    }
+
+    if (receivedPdus != keepaliveReceived) {
+        keepaliveReceived = receivedPdus;
+        missedEnquireLinks = 0;
+    } else if (keepaliveOutstanding) {
+        // a whole interval went by without the response
+        missedEnquireLinks++;
+    } else {
+        keepaliveOutstanding = true;
+        startEnquireLink(boost::bind(&SmppClient::handleKeepaliveResponse, this, _1));
+    }
+
+    if (missedEnquireLinks >= maxMissedEnquireLinks) {
+        dropConnection(boost::asio::error::timed_out);
+        return;
+    }
+
+    keepaliveTimer.expires_after(std::chrono::milliseconds(enquireLinkInterval));
+    keepaliveTimer.async_wait(boost::asio::bind_executor(strand, boost::bind(&SmppClient::handleKeepalive, this,
+                              std::weak_ptr<bool>(lifeline), _1)));
 }
 
-// blocks until response is read
-PDU SmppClient::readPduResponse(const uint32_t &sequence, const uint32_t &commandId) {
-    uint32_t response = GENERIC_NACK | commandId;
-    list<PDU>::iterator it = pdu_queue.begin();
+void SmppClient::handleKeepaliveResponse(const error_code &error) {
+    keepaliveOutstanding = false;
 
-    while (it != pdu_queue.end()) {
-        PDU pdu = (*it);
+    // the read timeout is shorter than the interval
+    if (error == boost::asio::error::timed_out && keepaliveRunning) {
+        missedEnquireLinks++;
 
-        if (pdu.getSequenceNo() == sequence && pdu.getCommandId() == response) {
-            it = pdu_queue.erase(it);
-            return pdu;
+        if (missedEnquireLinks >= maxMissedEnquireLinks) {
+            dropConnection(error);
         }
+    }
+}
 
-        it++;
+void SmppClient::dropConnection(const error_code &error) {
+    if (state == OPEN || reconnecting) {
+        return;
     }
 
-    while (true) {
-        PDU pdu = readPdu(true);
+    if (verbose) {
+        LOG(INFO) << "Connection lost: " << error.message();
+    }
 
-        if (!pdu.null) {
-            if ((pdu.getSequenceNo() == sequence && (pdu.getCommandId() == response
-                    || pdu.getCommandId() == GENERIC_NACK))
-                    || (pdu.getSequenceNo() == 0 && pdu.getCommandId() == GENERIC_NACK)) {
-                return pdu;
-            }
+    stopKeepalive();
+    error_code ec;
+    socket->close(ec);
+
+    if (reconnectEnabled) {
+        reconnecting = true;
+        reconnectAttempts = 0;
+
+        // PDUs not yet written belong to the lost connection, the write in progress fails on its own
+        while (writeQueue.size() > writeBatch) {
+            queuedOctets -= writeQueue.back().second;
+            writeQueue.pop_back();
         }
+
+        if (lingering) {
+            lingering = false;
+            lingerTimer.cancel();
+        }
+
+        scheduleReconnect();
+        recoverRequests(error);
+    } else {
+        state = OPEN;
+        failRequests(error);
     }
 
-    PDU pdu;
-    return pdu;
+    if (connectionLostHandler) {
+        connectionLostHandler(error);
+    }
 }
 
-void smpp::SmppClient::enquireLinkRespond() {
-    list<PDU>::iterator it = pdu_queue.begin();
+void SmppClient::recoverRequests(const error_code &error) {
+    vector<pair<uint32_t, PendingRequest> > lost = takePending();
+    vector<ResponseHandler> failed;
+    std::deque<Request> resend;
+
+    for (size_t i = 0; i < lost.size(); i++) {
+        const Request &request = lost[i].second.request;
 
-    while (it != pdu_queue.end()) {
-        PDU pdu = (*it);
+        if (reconnectPolicy == AT_LEAST_ONCE && (request.commandId == smpp::SUBMIT_SM
+                || request.commandId == smpp::SUBMIT_MULTI)) {
+            resend.push_back(request);
+        } else {
+            failed.push_back(request.handler);
+            commitSpooled(request);
+        }
+    }
 
-        if (pdu.getCommandId() == ENQUIRE_LINK) {
-            PDU resp = PDU(ENQUIRE_LINK_RESP, 0, pdu.getSequenceNo());
-            sendCommand(resp);
+    {
+        std::lock_guard<std::mutex> lock(waitingMutex);
+
+        // ahead of the requests of their tenant and priority that were never sent
+        for (size_t i = resend.size(); i-- > 0;) {
+            waiting.pushFront(resend[i].tenant, resend[i].priority, resend[i]);
         }
+    }
 
-        it++;
+    for (size_t i = 0; i < failed.size(); i++) {
+        PDU resp;
+        failed[i](error, resp);
     }
+}
 
-    PDU pdu = readPdu(false);
+void SmppClient::scheduleReconnect() {
+    // doubles with each failed attempt, and a random delay within the upper half of it spreads the clients out
+    int64_t backoff = reconnectBackoff;
 
-    if (!pdu.null && pdu.getCommandId() == ENQUIRE_LINK) {
-        PDU resp = PDU(ENQUIRE_LINK_RESP, 0, pdu.getSequenceNo());
-        sendPdu(resp);
+    for (int i = 0; i < reconnectAttempts && backoff < maxReconnectBackoff; i++) {
+        backoff *= 2;
     }
+
+    backoff = std::min<int64_t>(backoff, maxReconnectBackoff);
+    std::uniform_int_distribution<int64_t> jitter(backoff / 2, backoff);
+    reconnectAttempts++;
+    reconnectTimer.expires_after(std::chrono::milliseconds(jitter(reconnectJitter)));
+    reconnectTimer.async_wait(boost::asio::bind_executor(strand, boost::bind(&SmppClient::handleReconnectTimer, this,
+                              std::weak_ptr<bool>(lifeline), _1)));
 }
 
-void SmppClient::checkConnection() {
-    if (!socket->is_open()) {
-        throw smpp::TransportException("Socket is closed");
+void SmppClient::handleReconnectTimer(const std::weak_ptr<bool> &alive, const error_code &error) {
+    if (alive.expired() || error) {
+        return;
+    }
+
+    error_code ec;
+    socket->close(ec);
+    socket->async_connect(reconnectEndpoint, boost::asio::bind_executor(strand, boost::bind(
+                              &SmppClient::handleReconnect, this, std::weak_ptr<bool>(lifeline), _1)));
+}
+
+void SmppClient::handleReconnect(const std::weak_ptr<bool> &alive, const error_code &error) {
+    if (alive.expired()) {
+        return;
+    }
+
+    if (error) {
+        if (verbose) {
+            LOG(INFO) << "Reconnect failed: " << error.message();
+        }
+
+        error_code ec;
+        socket->close(ec);
+        scheduleReconnect();
+        return;
+    }
+
+    // pipelined submits are small, Nagle would hold them back
+    error_code ec;
+    socket->set_option(tcp::no_delay(true), ec);
+    rebinding = true;
+    startRead();
+    PDU pdu = setupBindPdu(bindMode, bindLogin, bindPassword);
+
+    if (verbose) {
+        LOG(INFO) << pdu;
+    }
+
+    // sent ahead of the requests held back
+    ResponseHandler handler = boost::bind(&SmppClient::handleRebindResponse, this, _1, _2);
+    Request request = { pdu.getCommandId(), pdu.getSequenceNo(), pdu.getOctets(), pdu.getSize(), handler };
+    transmit(request);
+}
+
+void SmppClient::handleRebindResponse(const error_code &error, PDU &resp) {
+    rebinding = false;
+
+    if (error) {
+        if (verbose) {
+            LOG(INFO) << "Rebind failed: " << error.message();
+        }
+
+        error_code ec;
+        socket->close(ec);
+        scheduleReconnect();
+        return;
+    }
+
+    reconnecting = false;
+    startKeepalive();
+
+    if (reconnectHandler) {
+        reconnectHandler();
+    }
+
+    transmitWaiting();
+}
+
+SMS SmppClient::parseSms() {
+    if (pdu_queue.empty()) {
+        return SMS();
+    }
+
+    SMS sms(pdu_queue.front());
+    // send response to smsc
+    PDU resp = PDU(DELIVER_SM_RESP, 0x0, pdu_queue.front().getSequenceNo());
+    resp << 0x0;
+    sendPdu(resp);
+    pdu_queue.pop_front();
+    return sms;
+}
+
+vector<size_t> SmppClient::split(const string &shortMessage, const int split) {
+    vector<size_t> parts;
+    int len = shortMessage.length();
+    int pos = 0;
+    int n = split;
+
+    while (pos < len) {
+        if (static_cast<int>(shortMessage[pos + n - 1]) == 0x1b) {  // do not split at escape char
+            n--;
+        }
+
+        parts.push_back(n);
+        pos += n;
+        n = split;
+
+        if (pos + n > len) {
+            n = len - pos;
+        }
+    }
+
+    return parts;
+}
+
+shared_ptr<PDU> SmppClient::setupSubmitSmPdu(const uint32_t commandId, const SmppAddress &sender,
+                                             const vector<MultiDestination> &destinations,
+                                             const string &udh, const char* shortMessage,
+                                             const size_t &messageLen, const list<TLV> &tags,
+                                             const uint8_t priority_flag, const string &schedule_delivery_time,
+                                             const string &validity_period, const int esmClassOpt,
+                                             const int dataCoding) {
+    shared_ptr<PDU> pdu(new PDU(commandId, 0, nextSequenceNumber()));
+    *pdu << serviceType;
+    *pdu << sender;
+
+    if (commandId == smpp::SUBMIT_MULTI) {
+        *pdu << static_cast<uint8_t>(destinations.size());
+
+        for (vector<MultiDestination>::const_iterator itr = destinations.begin(); itr != destinations.end(); itr++) {
+            *pdu << itr->flag;
+
+            if (itr->flag == smpp::DEST_FLAG_SME) {
+                *pdu << itr->address;
+            } else {
+                *pdu << itr->listName;
+            }
+        }
+    } else {
+        *pdu << destinations.front().address;
+    }
+
+    *pdu << esmClassOpt;
+    *pdu << protocolId;
+    *pdu << priority_flag;
+    *pdu << schedule_delivery_time;
+    *pdu << validity_period;
+    *pdu << registeredDelivery;
+    *pdu << replaceIfPresentFlag;
+    *pdu << dataCoding;
+    *pdu << smDefaultMsgId;
+
+    if (csmsMethod == CSMS_PAYLOAD) {
+        *pdu << 0;  // sm_length = 0
+        *pdu << smpp::tags::MESSAGE_PAYLOAD;
+        *pdu << boost::numeric_cast<uint16_t>(udh.length() + messageLen);
+    } else {
+        *pdu << boost::numeric_cast<uint8_t>(udh.length() + messageLen) + (nullTerminateOctetStrings ? 1 : 0);
+    }
+
+    pdu->addOctets(reinterpret_cast<const uint8_t*>(udh.data()), udh.length());
+    pdu->addOctets(reinterpret_cast<const uint8_t*>(shortMessage), messageLen);
+
+    if (csmsMethod != CSMS_PAYLOAD && nullTerminateOctetStrings) {
+        *pdu << 0;
+    }
+
+    // add  optional tags.
+    for (list<TLV>::const_iterator itr = tags.begin(); itr != tags.end(); itr++) {
+        *pdu << *itr;
+    }
+
+    return pdu;
+}
+
+uint32_t SmppClient::nextSequenceNumber() {
+    // called from any thread building a PDU
+    uint32_t n = ++seqNo;
+
+    if (n > 0x7FFFFFFF) {
+        throw SmppException("Ran out of sequence numbers");
+    }
+
+    return n;
+}
+
+void SmppClient::sendPdu(PDU &pdu) {
+    // responses are dropped once the socket is closed, the SMSC sees the connection go anyway
+    if (!socket->is_open() || reconnecting) {
+        return;
+    }
+
+    if (verbose) {
+        LOG(INFO) << pdu;
+    }
+
+    queueWrite(pdu.getOctets(), pdu.getSize());
+}
+
+void SmppClient::sendRequest(PDU &pdu, const ResponseHandler &handler, const string &tenant, const uint8_t priority) {
+    if (!socket->is_open() && !reconnecting) {
+        PDU resp;
+        handler(boost::asio::error::not_connected, resp);
+        return;
+    }
+
+    if (verbose) {
+        LOG(INFO) << pdu;
+    }
+
+    Request request = { pdu.getCommandId(), pdu.getSequenceNo(), pdu.getOctets(), pdu.getSize(), handler, priority,
+                        tenant, std::chrono::steady_clock::now(), 0
+                      };
+
+    if (spool && (request.commandId == smpp::SUBMIT_SM || request.commandId == smpp::SUBMIT_MULTI)) {
+        request.spoolId = spool->append(request.octets.get(), request.size);
+        spooledInFlight.insert(request.spoolId);
+    }
+
+    enqueueRequest(request);
+}
+
+void SmppClient::enqueueRequest(const Request &request) {
+    startRead();
+
+    {
+        std::lock_guard<std::mutex> lock(waitingMutex);
+        waiting.push(request.tenant, request.priority, request);
+    }
+
+    transmitWaiting();
+}
+
+/**
+ * Hands the response to a submit sent again by resendSpooled to the application.
+ */
+static void handleSpooledResponse(const boost::function<void(const error_code &, const SubmitResult &)> &handler,
+                                  const uint32_t sequenceNo, const error_code &error, PDU &resp) {
+    SubmitResult result;
+    result.sequenceNo = sequenceNo;
+    result.commandStatus = resp.null ? smpp::ESME_RUNKNOWNERR : resp.getCommandStatus();
+    result.error = error;
+
+    if (!error && resp.getCommandId() == smpp::SUBMIT_SM_RESP) {
+        resp >> result.messageId;
+    }
+
+    handler(error, result);
+}
+
+size_t SmppClient::resendSpooled(const boost::function<void(const error_code &, const SubmitResult &)> &handler) {
+    if (!spool) {
+        throw SmppException("No spool to resend from");
+    }
+
+    checkState(BOUND_TX, BOUND_TRX);
+    shared_ptr<SyncResult<size_t> > result(new SyncResult<size_t>());
+    boost::function<void(const error_code &, const size_t &)> done = boost::bind(&storeResult<size_t>, result, _1,
+            _2);
+    execute(boost::bind(&SmppClient::startResendSpooled, this, handler, done), *result);
+    return *result->result;
+}
+
+void SmppClient::collectSpooled(vector<Request>* requests,
+                                const boost::function<void(const error_code &, const SubmitResult &)> &handler,
+                                const uint64_t id, const uint8_t* data, const uint32_t size) {
+    if (spooledInFlight.count(id) != 0) {
+        return;
+    }
+
+    shared_array<uint8_t> octets(new uint8_t[size]);
+    memcpy(octets.get(), data, size);
+    uint32_t commandId;
+    memcpy(&commandId, octets.get() + 4, sizeof(commandId));
+    // the sequence numbers of the old session may be taken already
+    uint32_t sequenceNo = nextSequenceNumber();
+    uint32_t beSequenceNo = htonl(sequenceNo);
+    memcpy(octets.get() + 12, &beSequenceNo, sizeof(beSequenceNo));
+    Request request = { ntohl(commandId), sequenceNo, octets, static_cast<int>(size),
+                        boost::bind(&handleSpooledResponse, handler, sequenceNo, _1, _2), 0, "",
+                        std::chrono::steady_clock::now(), id
+                      };
+    requests->push_back(request);
+}
+
+void SmppClient::startResendSpooled(const boost::function<void(const error_code &, const SubmitResult &)> &handler,
+                                    const boost::function<void(const error_code &, const size_t &)> &done) {
+    // the spool is only used from the strand
+    vector<Request> requests;
+    spool->replay(boost::bind(&SmppClient::collectSpooled, this, &requests, handler, _1, _2, _3));
+
+    for (size_t i = 0; i < requests.size(); i++) {
+        spooledInFlight.insert(requests[i].spoolId);
+        enqueueRequest(requests[i]);
+    }
+
+    done(error_code(), requests.size());
+}
+
+void SmppClient::transmit(const Request &request) {
+    startTimeoutWheel();
+    PendingRequest &entry = pending[request.sequenceNo];
+    entry.request = request;
+    entry.sent = std::chrono::steady_clock::now();
+    // the tick under way is partly over, so one more keeps the request from timing out early
+    entry.timeout = timeoutWheel.schedule(request.sequenceNo,
+                                          (socketReadTimeout + wheelResolution - 1) / wheelResolution + 1);
+    queueWrite(request.octets, request.size);
+}
+
+void SmppClient::transmitWaiting() {
+    while (pending.size() < windowSize && !pacing && !reconnecting) {
+        std::unique_lock<std::mutex> lock(waitingMutex);
+        Request* next = waiting.front();
+
+        // nothing waiting, or only tenants at their cap
+        if (!next) {
+            return;
+        }
+
+        if (rateLimiter && (next->commandId == smpp::SUBMIT_SM || next->commandId == smpp::SUBMIT_MULTI)) {
+            boost::posix_time::time_duration delay = rateLimiter->acquire();
+
+            if (!delay.is_zero()) {
+                lock.unlock();
+                pacing = true;
+                pacingTimer.expires_after(std::chrono::microseconds(delay.total_microseconds()));
+                pacingTimer.async_wait(boost::asio::bind_executor(strand, boost::bind(
+                                           &SmppClient::handlePacingTimeout, this, std::weak_ptr<bool>(lifeline), _1)));
+                return;
+            }
+        }
+
+        Request request = *next;
+        waiting.pop();
+        lock.unlock();
+        transmit(request);
+    }
+}
+
+void SmppClient::completeRequest(PendingMap::iterator it, PDU &resp) {
+    uint32_t status = resp.getCommandStatus();
+    error_code error = status == smpp::ESME_ROK ? error_code() : makeEsmeError(status);
+
+    if (rateLimiter && (resp.getCommandId() == smpp::SUBMIT_SM_RESP
+                        || resp.getCommandId() == smpp::SUBMIT_MULTI_RESP)) {
+        if (status == smpp::ESME_RTHROTTLED || status == smpp::ESME_RMSGQFUL) {
+            rateLimiter->onThrottled();
+        } else if (status == smpp::ESME_ROK) {
+            rateLimiter->onAccepted();
+        }
+    }
+
+    if (resp.getCommandId() == smpp::SUBMIT_SM_RESP || resp.getCommandId() == smpp::SUBMIT_MULTI_RESP) {
+        recordLatency(it->second);
+    }
+
+    commitSpooled(it->second.request);
+    ResponseHandler handler = it->second.request.handler;
+    releaseTenant(it->second.request, true);
+    timeoutWheel.cancel(it->second.timeout);
+    pending.erase(it);
+
+    // the wheel stops when idle, so the io_service runs out of work
+    if (timeoutWheel.empty() && wheelRunning) {
+        wheelRunning = false;
+        wheelTimer.cancel();
+    }
+
+    transmitWaiting();
+    handler(error, resp);
+}
+
+void SmppClient::recordLatency(const PendingRequest &entry) {
+    std::chrono::microseconds queueTime =
+        std::chrono::duration_cast<std::chrono::microseconds>(entry.sent - entry.request.queued);
+    std::chrono::microseconds responseTime =
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - entry.request.queued);
+    std::lock_guard<std::mutex> lock(latencyMutex);
+    LatencyStats &stats = latencyStats[std::min<uint8_t>(entry.request.priority, PRIORITY_CLASSES - 1)];
+    stats.count++;
+    stats.totalQueueTime += queueTime;
+    stats.maxQueueTime = std::max(stats.maxQueueTime, queueTime);
+    stats.totalResponseTime += responseTime;
+    stats.maxResponseTime = std::max(stats.maxResponseTime, responseTime);
+}
+
+void SmppClient::releaseTenant(const Request &request, const bool answered) {
+    std::lock_guard<std::mutex> lock(waitingMutex);
+    waiting.complete(request.tenant, answered);
+}
+
+void SmppClient::commitSpooled(const Request &request) {
+    if (spool && request.spoolId != 0) {
+        spool->commit(request.spoolId);
+        spooledInFlight.erase(request.spoolId);
+    }
+}
+
+void SmppClient::handlePacingTimeout(const std::weak_ptr<bool> &alive, const error_code &error) {
+    if (alive.expired()) {
+        return;
+    }
+
+    pacing = false;
+
+    if (!error) {
+        transmitWaiting();
+    }
+}
+
+void SmppClient::startTimeoutWheel() {
+    if (wheelRunning) {
+        return;
+    }
+
+    wheelRunning = true;
+    wheelStart = std::chrono::steady_clock::now();
+    wheelBase = timeoutWheel.getTick();
+    wheelResolution = timeoutResolution;
+    armTimeoutWheel();
+}
+
+void SmppClient::armTimeoutWheel() {
+    uint64_t ticks = timeoutWheel.getTick() + 1 - wheelBase;
+    wheelTimer.expires_at(wheelStart + std::chrono::milliseconds(wheelResolution) * static_cast<int64_t>(ticks));
+    wheelTimer.async_wait(boost::asio::bind_executor(strand, boost::bind(&SmppClient::handleWheelTimeout, this,
+                          std::weak_ptr<bool>(lifeline), _1)));
+}
+
+void SmppClient::handleWheelTimeout(const std::weak_ptr<bool> &alive, const error_code &error) {
+    if (alive.expired() || error || !wheelRunning) {
+        return;
+    }
+
+    uint64_t elapsed = (std::chrono::steady_clock::now() - wheelStart) / std::chrono::milliseconds(wheelResolution);
+    vector<uint32_t> expired;
+    timeoutWheel.advance(wheelBase + elapsed, &expired);
+    vector<ResponseHandler> handlers;
+
+    for (size_t i = 0; i < expired.size(); i++) {
+        PendingMap::iterator it = pending.find(expired[i]);
+
+        if (it != pending.end()) {
+            handlers.push_back(it->second.request.handler);
+            releaseTenant(it->second.request, false);
+            commitSpooled(it->second.request);
+            pending.erase(it);
+        }
+    }
+
+    transmitWaiting();
+
+    if (timeoutWheel.empty()) {
+        wheelRunning = false;
+    } else {
+        armTimeoutWheel();
+    }
+
+    for (size_t i = 0; i < handlers.size(); i++) {
+        PDU resp;
+        handlers[i](boost::asio::error::timed_out, resp);
+    }
+}
+
+vector<pair<uint32_t, SmppClient::PendingRequest> > SmppClient::takePending() {
+    // in the order they were sent, the map has none
+    vector<pair<uint32_t, PendingRequest> > taken(pending.begin(), pending.end());
+    pending.clear();
+
+    for (size_t i = 0; i < taken.size(); i++) {
+        releaseTenant(taken[i].second.request, false);
+    }
+
+    std::sort(taken.begin(), taken.end(), &compareSequenceNo<pair<uint32_t, PendingRequest> >);
+    timeoutWheel.clear();
+
+    if (wheelRunning) {
+        wheelRunning = false;
+        wheelTimer.cancel();
+    }
+
+    return taken;
+}
+
+void SmppClient::failRequests(const error_code &error) {
+    vector<pair<uint32_t, PendingRequest> > failed = takePending();
+    vector<Request> held;
+
+    {
+        std::lock_guard<std::mutex> lock(waitingMutex);
+        waiting.takeAll(&held);
+    }
+
+    for (size_t i = 0; i < failed.size(); i++) {
+        PDU resp;
+        commitSpooled(failed[i].second.request);
+        failed[i].second.request.handler(error, resp);
+    }
+
+    for (size_t i = 0; i < held.size(); i++) {
+        PDU resp;
+        commitSpooled(held[i]);
+        held[i].handler(error, resp);
+    }
+
+    std::deque<boost::function<void(const error_code &, const SMS &)> > readers;
+    readers.swap(smsHandlers);
+
+    for (size_t i = 0; i < readers.size(); i++) {
+        readers[i](error, SMS());
+    }
+}
+
+void SmppClient::queueWrite(const shared_array<uint8_t> &octets, const int size) {
+    writeQueue.push_back(std::make_pair(octets, size));
+    queuedOctets += size;
+
+    // the write in progress is followed by one of everything queued meanwhile
+    if (writeBatch > 0) {
+        return;
+    }
+
+    if (writeLinger > 0 && writeQueue.size() < maxWritePdus && queuedOctets < maxWriteOctets) {
+        if (!lingering) {
+            lingering = true;
+            lingerTimer.expires_after(std::chrono::milliseconds(writeLinger));
+            lingerTimer.async_wait(boost::asio::bind_executor(strand, boost::bind(&SmppClient::handleWriteLinger,
+                                   this, std::weak_ptr<bool>(lifeline), _1)));
+        }
+
+        return;
+    }
+
+    startWrite();
+}
+
+void SmppClient::startWrite() {
+    if (lingering) {
+        lingering = false;
+        lingerTimer.cancel();
+    }
+
+    std::weak_ptr<bool> alive(lifeline);
+    vector<boost::asio::const_buffer> buffers;
+    size_t octets = 0;
+
+    // the octets stay in the queue until the write completes
+    while (buffers.size() < writeQueue.size() && buffers.size() < maxWritePdus
+            && (buffers.empty() || octets + writeQueue[buffers.size()].second <= maxWriteOctets)) {
+        buffers.push_back(buffer(writeQueue[buffers.size()].first.get(), writeQueue[buffers.size()].second));
+        octets += writeQueue[buffers.size() - 1].second;
+    }
+
+    writeBatch = buffers.size();
+    async_write(*socket, buffers,
+                boost::asio::bind_executor(strand, boost::bind(&SmppClient::handleWrite, this, alive, _1)));
+    writeTimer.expires_from_now(boost::posix_time::milliseconds(socketWriteTimeout));
+    writeTimer.async_wait(boost::asio::bind_executor(strand, boost::bind(&SmppClient::handleWriteTimeout, this,
+                          alive, _1)));
+}
+
+void SmppClient::handleWriteLinger(const std::weak_ptr<bool> &alive, const error_code &error) {
+    if (alive.expired() || error || !lingering) {
+        return;
+    }
+
+    lingering = false;
+
+    if (writeBatch == 0 && !writeQueue.empty()) {
+        startWrite();
+    }
+}
+
+void SmppClient::handleWrite(const std::weak_ptr<bool> &alive, const error_code &error) {
+    if (alive.expired()) {
+        return;
+    }
+
+    writeTimer.cancel();
+
+    if (error) {
+        writeQueue.clear();
+        writeBatch = 0;
+        queuedOctets = 0;
+
+        // the read of a lost connection fails as well, or a failed rebind times out
+        if (reconnecting) {
+            return;
+        }
+
+        if (state != OPEN) {
+            dropConnection(error);
+        } else {
+            failRequests(error);
+        }
+
+        return;
+    }
+
+    writeCount++;
+    writtenPduCount += writeBatch;
+
+    for (; writeBatch > 0; writeBatch--) {
+        queuedOctets -= writeQueue.front().second;
+        writeQueue.pop_front();
+    }
+
+    if (!writeQueue.empty()) {
+        startWrite();
+    }
+}
+
+void SmppClient::setPriorityScheduling(const int mode, const vector<unsigned int> &weights) {
+    std::lock_guard<std::mutex> lock(waitingMutex);
+
+    if (mode == STRICT_PRIORITY) {
+        waiting.setMode(PriorityScheduler<Request>::STRICT);
+        return;
+    }
+
+    vector<unsigned int> classWeights = weights;
+
+    if (classWeights.empty()) {
+        for (unsigned int i = 0; i < PRIORITY_CLASSES; i++) {
+            classWeights.push_back(1 << i);
+        }
+    }
+
+    waiting.setMode(PriorityScheduler<Request>::WEIGHTED, classWeights);
+}
+
+void SmppClient::setTenant(const string &tenant, const unsigned int weight, const size_t maxInFlight) {
+    std::lock_guard<std::mutex> lock(waitingMutex);
+    waiting.setTenant(tenant, weight, maxInFlight);
+}
+
+std::map<string, TenantStats> SmppClient::getTenantStats() const {
+    std::lock_guard<std::mutex> lock(waitingMutex);
+    return waiting.getStats();
+}
+
+LatencyStats SmppClient::getLatencyStats(const uint8_t priority) const {
+    std::lock_guard<std::mutex> lock(latencyMutex);
+    return latencyStats[std::min<uint8_t>(priority, PRIORITY_CLASSES - 1)];
+}
+
+void SmppClient::resetLatencyStats() {
+    std::lock_guard<std::mutex> lock(latencyMutex);
+    latencyStats.assign(latencyStats.size(), LatencyStats());
+}
+
+void SmppClient::setNoDelay(const bool noDelay) {
+    error_code error;
+    socket->set_option(tcp::no_delay(noDelay), error);
+
+    if (error) {
+        throw TransportException(system_error(error).what());
+    }
+}
+
+void SmppClient::handleWriteTimeout(const std::weak_ptr<bool> &alive, const error_code &error) {
+    // the timer is re-armed for each write, a stale expiry is not a timeout
+    if (alive.expired() || error || writeTimer.expires_at() > deadline_timer::traits_type::now()) {
+        return;
+    }
+
+    error_code ec;
+    socket->cancel(ec);
+}
+
+void SmppClient::startRead() {
+    // while reconnecting the socket is only read once connected
+    if (reading || !socket->is_open() || (reconnecting && !rebinding)) {
+        return;
+    }
+
+    reading = true;
+    shared_array<uint8_t> pduLength(new uint8_t[HEADERFIELD_SIZE]);
+    async_read(*socket, buffer(pduLength.get(), HEADERFIELD_SIZE),
+               boost::asio::bind_executor(strand, boost::bind(&SmppClient::handleReadHeader, this,
+                                          std::weak_ptr<bool>(lifeline), pduLength, _1)));
+}
+
+void SmppClient::handleReadHeader(const std::weak_ptr<bool> &alive, shared_array<uint8_t> pduLength,
+                                  const error_code &error) {
+    if (alive.expired()) {
+        return;
+    }
+
+    if (error) {
+        reading = false;
+        handleReadError(error);
+        return;
+    }
+
+    uint32_t len = PDU::getPduLength(pduLength);
+
+    if (len < HEADER_SIZE) {
+        // the stream is out of step, so whatever follows can't be read as PDUs either
+        reading = false;
+        error_code ec;
+        socket->close(ec);
+        handleReadError(boost::system::errc::make_error_code(boost::system::errc::protocol_error));
+        return;
+    }
+
+    shared_array<uint8_t> pduBuffer(new uint8_t[len - HEADERFIELD_SIZE]);
+    // start reading after the size mark of the pdu
+    async_read(*socket, buffer(pduBuffer.get(), len - HEADERFIELD_SIZE),
+               boost::asio::bind_executor(strand, boost::bind(&SmppClient::handleReadBody, this, alive, pduLength,
+                                          pduBuffer, _1)));
+}
+
+void SmppClient::handleReadBody(const std::weak_ptr<bool> &alive, shared_array<uint8_t> pduLength,
+                                shared_array<uint8_t> pduBuffer, const error_code &error) {
+    if (alive.expired()) {
+        return;
+    }
+
+    reading = false;
+
+    if (error) {
+        handleReadError(error);
+        return;
+    }
+
+    PDU pdu(pduLength, pduBuffer);
+    handlePdu(pdu);
+    startRead();
+}
+
+void SmppClient::handleReadError(const error_code &error) {
+    // a read cancelled by closing the socket, that has since been reconnected, is not an error of the new connection
+    if (error == boost::asio::error::operation_aborted && socket->is_open()) {
+        startRead();
+        return;
+    }
+
+    if (reconnecting) {
+        // the new connection failed before the bind was answered, which fails the bind
+        if (rebinding) {
+            error_code ec;
+            socket->close(ec);
+            recoverRequests(error);
+        }
+
+        return;
+    }
+
+    if (state != OPEN) {
+        dropConnection(error);
+    } else {
+        failRequests(error);
+    }
+}
+
+void SmppClient::handlePdu(PDU &pdu) {
+    clock->update();
+    receivedPdus++;
+
+    if (verbose) {
+        LOG(INFO) << pdu;
+    }
+
+    uint32_t commandId = pdu.getCommandId();
+
+    if (commandId & GENERIC_NACK) {
+        PendingMap::iterator it = pending.find(pdu.getSequenceNo());
+
+        // a generic_nack without sequence number rejects a request the SMSC couldn't parse, take the oldest
+        if (it == pending.end() && commandId == GENERIC_NACK && pdu.getSequenceNo() == 0) {
+            for (PendingMap::iterator i = pending.begin(); i != pending.end(); i++) {
+                if (it == pending.end() || i->first < it->first) {
+                    it = i;
+                }
+            }
+        }
+
+        if (it != pending.end()) {
+            completeRequest(it, pdu);
+        } else if (verbose) {
+            LOG(INFO) << "Dropped response to unknown request " << pdu.getSequenceNo();
+        }
+
+        return;
+    }
+
+    switch (commandId) {
+    case ENQUIRE_LINK: {
+        PDU resp = PDU(ENQUIRE_LINK_RESP, 0, pdu.getSequenceNo());
+        sendPdu(resp);
+
+        if (enquireLinkHandler) {
+            enquireLinkHandler();
+        }
+
+        return;
+    }
+
+    case UNBIND: {
+        // the SMSC ends the session
+        PDU resp = PDU(UNBIND_RESP, 0, pdu.getSequenceNo());
+        sendPdu(resp);
+        state = OPEN;
+        stopKeepalive();
+
+        if (unbindHandler) {
+            unbindHandler();
+        }
+
+        return;
+    }
+
+    case DELIVER_SM: {
+        if (deliverSmHandler) {
+            PDU resp = PDU(DELIVER_SM_RESP, 0, pdu.getSequenceNo());
+            resp << 0x0;
+            sendPdu(resp);
+            SMS sms(pdu);
+            deliverSmHandler(sms);
+            return;
+        }
+
+        if (pdu_queue.size() < smsQueueLimit) {
+            // answered once it is read
+            pdu_queue.push_back(pdu);
+            deliverSms();
+            return;
+        }
+
+        // the SMSC retries it later
+        PDU resp = PDU(DELIVER_SM_RESP, ESME_RMSGQFUL, pdu.getSequenceNo());
+        resp << 0x0;
+        sendPdu(resp);
+        return;
+    }
+
+    case DATA_SM: {
+        PDU resp = PDU(DATA_SM_RESP, 0, pdu.getSequenceNo());
+        resp << 0x0;
+        sendPdu(resp);
+
+        if (dataSmHandler) {
+            dataSmHandler(pdu);
+        }
+
+        return;
+    }
+
+    case ALERT_NOTIFICATION:
+        if (alertNotificationHandler) {
+            alertNotificationHandler(pdu);
+        }
+
+        return;
+    }
+
+    // a request the client doesn't support
+    PDU resp = PDU(GENERIC_NACK, ESME_RINVCMDID, pdu.getSequenceNo());
+    sendPdu(resp);
+}
+
+void SmppClient::runOne() {
+    if (getIoService().stopped()) {
+        getIoService().restart();
+    }
+
+    if (getIoService().run_one() == 0) {
+        throw TransportException("Connection lost");
+    }
+
+    clock->update();
+}
+
+void SmppClient::execute(const boost::function<void()> &start, SyncFlag &sync) {
+    // the thread would wait for a handler it should be running itself
+    if (!runIoService && getIoService().get_executor().running_in_this_thread()) {
+        throw SmppException("Synchronous call from a thread running the io_service");
+    }
+
+    boost::asio::dispatch(strand, start);
+
+    if (runIoService) {
+        while (!sync.isDone()) {
+            runOne();
+        }
+
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(sync.mutex);
+
+    while (!sync.done) {
+        sync.condition.wait(lock);
+    }
+}
+
+void SmppClient::checkRunIoService() {
+    if (!runIoService) {
+        throw SmppException("Only available while the client runs the io_service");
+    }
+}
+
+void SmppClient::throwOnError(const error_code &error) {
+    if (!error) {
+        return;
+    }
+
+    if (error.category() == getEsmeCategory()) {
+        checkCommandStatus(error.value());
+    }
+
+    throw TransportException(system_error(error).what());
+}
+
+void SmppClient::checkCommandStatus(const uint32_t status) {
+    switch (status) {
+    case smpp::ESME_RINVPASWD:
+        throw smpp::InvalidPasswordException(smpp::getEsmeStatus(status));
+        break;
+
+    case smpp::ESME_RINVSYSID:
+        throw smpp::InvalidSystemIdException(smpp::getEsmeStatus(status));
+        break;
+
+    case smpp::ESME_RINVSRCADR:
+        throw smpp::InvalidSourceAddressException(smpp::getEsmeStatus(status));
+        break;
+
+    case smpp::ESME_RINVDSTADR:
+        throw smpp::InvalidDestinationAddressException(smpp::getEsmeStatus(status));
+        break;
+    }
+
+    if (status != smpp::ESME_ROK) {
+        throw smpp::SmppException(smpp::getEsmeStatus(status));
+    }
+}
+
+void smpp::SmppClient::enquireLinkRespond() {
+    if (!runIoService) {
+        return;
+    }
+
+    startRead();
+
+    if (getIoService().stopped()) {
+        getIoService().restart();
+    }
+
+    getIoService().poll();
+    clock->update();
+}
+
+void SmppClient::checkConnection() {
+    if (!socket->is_open()) {
+        throw smpp::TransportException("Socket is closed");
     }
 }
 
@@ -612,8 +2007,14 @@ void SmppClient::checkState(int state) {
     }
 }
 
+void SmppClient::checkState(const int state, const int alternative) {
+    if (this->state != state && this->state != alternative) {
+        throw smpp::SmppException("Client in wrong state");
+    }
+}
+
 uint16_t SmppClient::defaultMessageRef() {
-    static int ref = 0;
+    static std::atomic<unsigned int> ref(0);
     return (ref++ % 0xffff);
 }
 
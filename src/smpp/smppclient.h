@@ -9,6 +9,9 @@
 
 #include <stdint.h>
 
+// Boost.Asio 1.74 uses std::exchange without including <utility> when built as C++20
+#include <utility>
+
 #include <boost/scoped_array.hpp>
 #include <boost/asio.hpp>
 #include <boost/asio/version.hpp>
@@ -20,32 +23,141 @@
 #include <boost/function.hpp>
 #include <boost/bind/bind.hpp>
 #include <boost/numeric/conversion/cast.hpp>
+#include <boost/optional.hpp>
 
 #include <glog/logging.h>
 
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <list>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <random>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+#include "smpp/clock.h"
 #include "smpp/exceptions.h"
+#include "smpp/fairscheduler.h"
+#include "smpp/gsmencoding.h"
+#include "smpp/mpscring.h"
 #include "smpp/pdu.h"
+#include "smpp/priorityscheduler.h"
+#include "smpp/ratelimiter.h"
 #include "smpp/smpp.h"
 #include "smpp/sms.h"
+#include "smpp/spool.h"
 #include "smpp/timeformat.h"
+#include "smpp/timerwheel.h"
 #include "smpp/tlv.h"
 
 namespace smpp {
 
 typedef boost::tuple<std::string, boost::local_time::local_date_time, int, int> QuerySmResult;
 
+// SMSC id of the last part and the number of parts sent
+typedef std::pair<std::string, int> SendSmsResult;
+
+/**
+ * Response to a submit_sm sent with SmppClient::submitSms.
+ */
+struct SubmitResult {
+    // Sequence number of the submit_sm
+    uint32_t sequenceNo;
+    // Command status of the response, ESME_ROK on success
+    uint32_t commandStatus;
+    // SMSC message id, empty unless the submit succeeded
+    std::string messageId;
+    // Set if the submit failed. In the ESME category if the SMSC rejected it, otherwise no response arrived,
+    // ie. the request timed out or the connection was lost, and commandStatus is ESME_RUNKNOWNERR.
+    boost::system::error_code error;
+};
+
+/**
+ * Destination of a submit_multi: an SME address, or the name of a distribution list kept at the SMSC.
+ */
+struct MultiDestination {
+    // DEST_FLAG_SME or DEST_FLAG_DISTLIST
+    uint8_t flag;
+    SmppAddress address;
+    std::string listName;
+
+    MultiDestination(const SmppAddress &_address) :  // NOLINT(runtime/explicit)
+        flag(smpp::DEST_FLAG_SME), address(_address), listName() {
+    }
+
+    explicit MultiDestination(const std::string &_listName) :
+        flag(smpp::DEST_FLAG_DISTLIST), address(""), listName(_listName) {
+    }
+};
+
+/**
+ * Destination the SMSC could not send a submit_multi to.
+ */
+struct UnsuccessfulDelivery {
+    // Address of the SME, or the name of the distribution list as value if it could not be used at all
+    SmppAddress address;
+    // Command status the SMSC gave for the destination
+    uint32_t status;
+};
+
+/**
+ * Result of SmppClient::sendMulti.
+ */
+struct SendMultiResult {
+    // SMSC id of the last part of the last PDU answered
+    std::string messageId;
+    // Number of submit_multi, or submit_sm after a fallback, sent
+    int pdus;
+    // Destinations that were not accepted
+    std::vector<UnsuccessfulDelivery> unsuccessful;
+    // True if the SMSC rejected submit_multi, so the destinations were sent one submit_sm each
+    bool fallback;
+};
+
+/**
+ * Latencies of the answered submits of a priority class, counted from when they were queued.
+ */
+struct LatencyStats {
+    // Submits answered
+    uint64_t count;
+    // Time from queued to written, summed over the submits and the longest
+    std::chrono::microseconds totalQueueTime;
+    std::chrono::microseconds maxQueueTime;
+    // Time from queued to answered, summed over the submits and the longest
+    std::chrono::microseconds totalResponseTime;
+    std::chrono::microseconds maxResponseTime;
+
+    LatencyStats() :
+        count(0), totalQueueTime(0), maxQueueTime(0), totalResponseTime(0), maxResponseTime(0) {
+    }
+};
+
+// Maximum number of destinations in one submit_multi, SMPP v3.4 - 4.5.1
+const size_t MAX_MULTI_DESTINATIONS = 254;
+
+// Completion of a synchronous call, see smppclient.cpp
+struct SyncFlag;
+
+// Progress of a sendMulti, see smppclient.cpp
+struct SendMultiState;
+
 /**
  * Class for sending and receiving SMSes through the SMPP protocol.
  * This clients goal is to simplify sending an SMS and receiving
  * delivery reports and therefore not all features of the SMPP protocol is
  * implemented.
+ *
+ * The client does its I/O on a strand of the io_service of the socket. By default the synchronous calls run the
+ * io_service until they complete, so the client is used from one thread. With setRunIoService(false) the
+ * application runs the io_service from any number of threads instead, and the calls, synchronous or not, may be
+ * made from many threads at once.
  */
 class SmppClient {
   public:
@@ -54,6 +166,19 @@ class SmppClient {
         CSMS_PAYLOAD, CSMS_16BIT_TAGS, CSMS_8BIT_UDH
     };
 
+    // What happens on reconnect to submits the lost connection left unanswered
+    enum {
+        AT_LEAST_ONCE, AT_MOST_ONCE
+    };
+
+    // How the priority classes of queued submits share the window
+    enum {
+        STRICT_PRIORITY, WEIGHTED_PRIORITY
+    };
+
+    // Number of priority classes, one per priority_flag of GSM, 0 to 3
+    static const uint8_t PRIORITY_CLASSES = 4;
+
   private:
     enum {
         OPEN, BOUND_TX, BOUND_RX, BOUND_TRX
@@ -80,16 +205,181 @@ class SmppClient {
 
     boost::function<uint16_t()> msgRefCallback;
 
-    int state;
+    // Handlers of PDUs initiated by the SMSC, see onDeliverSm
+    boost::function<void(const SMS &)> deliverSmHandler;
+    boost::function<void(PDU &)> dataSmHandler;
+    boost::function<void(PDU &)> alertNotificationHandler;
+    boost::function<void()> enquireLinkHandler;
+    boost::function<void()> unbindHandler;
+    boost::function<void(const boost::system::error_code &)> connectionLostHandler;
+
+    std::atomic<int> state;
     std::shared_ptr<boost::asio::ip::tcp::socket> socket;
-    uint32_t seqNo;
-    std::list<PDU> pdu_queue;
+    // Serialises the handlers of the client when the io_service is run from several threads
+    boost::asio::strand<boost::asio::ip::tcp::socket::executor_type> strand;
+    std::atomic<uint32_t> seqNo;
+    // DELIVER_SMs waiting for readSms or asyncReadSms, unanswered until they are read
+    std::deque<PDU> pdu_queue;
+    // Maximum length of pdu_queue, further DELIVER_SMs are rejected. Default is 1000.
+    size_t smsQueueLimit;
+
+    /**
+     * Called with the response to a request, or with an error and a null PDU if none arrived.
+     * If the SMSC rejected the request the error is in the ESME category.
+     */
+    typedef boost::function<void(const boost::system::error_code &, PDU &)> ResponseHandler;
+
+    /**
+     * A request ready to be written, and the handler of its response.
+     */
+    struct Request {
+        uint32_t commandId;
+        uint32_t sequenceNo;
+        boost::shared_array<uint8_t> octets;
+        int size;
+        ResponseHandler handler;
+        // Class it is queued in, the priority_flag of a submit, 0 for other requests
+        uint8_t priority;
+        // Tenant it is queued for, see setTenant
+        std::string tenant;
+        std::chrono::steady_clock::time_point queued;
+        // Record of a submit in the spool, 0 if it isn't spooled
+        uint64_t spoolId;
+    };
+
+    /**
+     * A request written to the SMSC, awaiting its response.
+     */
+    struct PendingRequest {
+        // Kept to send it again on a new connection
+        Request request;
+        // Entry of the request in the timeout wheel
+        TimerWheel::Handle timeout;
+        std::chrono::steady_clock::time_point sent;
+    };
+
+    // Maximum number of requests awaiting a response. Default is 1, ie. no pipelining.
+    unsigned int windowSize;
+    typedef std::unordered_map<uint32_t, PendingRequest> PendingMap;
+
+    // Requests awaiting their response, by sequence number
+    PendingMap pending;
+    // Times out the pending requests that get no response within the socket read timeout
+    TimerWheel timeoutWheel;
+    // Advances the wheel each tick, it only runs while requests are pending
+    boost::asio::steady_timer wheelTimer;
+    bool wheelRunning;
+    // Time the running wheel was at tick wheelBase, its ticks are counted from there
+    std::chrono::steady_clock::time_point wheelStart;
+    uint64_t wheelBase;
+    // Tick length of the running wheel in milliseconds
+    int wheelResolution;
+    // Tick length of the wheel in milliseconds, once it starts again. Default is 100 milliseconds.
+    int timeoutResolution;
+    // Requests held back until the window has room, or the rate limiter allows them, by tenant and priority class
+    FairScheduler<Request> waiting;
+    // Guards waiting, whose stats are read from any thread
+    mutable std::mutex waitingMutex;
+    // Journals the submits until they are answered, null for none
+    std::shared_ptr<Spool> spool;
+    // Spool records of the submits queued or in flight, which resendSpooled leaves to this session
+    std::unordered_set<uint64_t> spooledInFlight;
+    // Latencies of the answered submits by priority class, read from any thread
+    mutable std::mutex latencyMutex;
+    std::vector<LatencyStats> latencyStats;
+    // Paces submits, null if they are not limited
+    std::shared_ptr<RateLimiter> rateLimiter;
+    // Wakes the window when the rate limiter has a token again
+    boost::asio::steady_timer pacingTimer;
+    bool pacing;
+    // Responses to submits sent with submitSms, not yet collected by readSubmitResult
+    std::deque<SubmitResult> submitResults;
+    // Submits sent with submitSms still awaiting their response
+    size_t submitsInFlight;
+    // PDUs to be written, the first writeBatch of them are being written
+    std::deque<std::pair<boost::shared_array<uint8_t>, int> > writeQueue;
+    // Number of PDUs the write in progress gathers, 0 if none is in progress
+    size_t writeBatch;
+    // Octets in writeQueue
+    size_t queuedOctets;
+    // Most PDUs and octets gathered into one write. Default is 64 PDUs and 65536 octets.
+    size_t maxWritePdus;
+    size_t maxWriteOctets;
+    // Milliseconds a PDU may wait for others to share its write, 0 to write at once. Default is 0.
+    int writeLinger;
+    boost::asio::steady_timer lingerTimer;
+    bool lingering;
+    boost::asio::deadline_timer writeTimer;
+    // Writes to the socket, and PDUs written by them
+    std::atomic<uint64_t> writeCount;
+    std::atomic<uint64_t> writtenPduCount;
+    // True while the read loop has a read outstanding on the socket
+    bool reading;
+    // Milliseconds without an inbound PDU before a keepalive enquire_link is sent, 0 for none. Default is 0.
+    int enquireLinkInterval;
+    // Keepalives in a row that may go unanswered before the link is dead. Default is 3.
+    int maxMissedEnquireLinks;
+    boost::asio::steady_timer keepaliveTimer;
+    bool keepaliveRunning;
+    // Inbound PDUs, any of them shows the link is alive
+    uint64_t receivedPdus;
+    // receivedPdus when the keepalive last looked
+    uint64_t keepaliveReceived;
+    // True while a keepalive enquire_link awaits its response
+    bool keepaliveOutstanding;
+    int missedEnquireLinks;
+    // Bind to restore after a reconnect
+    uint32_t bindMode;
+    std::string bindLogin;
+    std::string bindPassword;
+    // True if a lost connection is reconnected
+    bool reconnectEnabled;
+    boost::asio::ip::tcp::endpoint reconnectEndpoint;
+    int reconnectPolicy;
+    // Backoff before the first and at most before any reconnect attempt, in milliseconds
+    int reconnectBackoff;
+    int maxReconnectBackoff;
+    boost::asio::steady_timer reconnectTimer;
+    // Failed attempts since the connection was lost
+    int reconnectAttempts;
+    // Picks the delay within the backoff, so clients that lost the same SMSC don't come back at once
+    std::mt19937 reconnectJitter;
+    // True from the loss of the connection until the client is bound again, requests are held back meanwhile
+    std::atomic<bool> reconnecting;
+    // True while the bind on the new connection awaits its response
+    bool rebinding;
+    boost::function<void()> reconnectHandler;
+    // Set once the SMSC rejected a submit_multi, later ones go straight to submit_sm
+    std::atomic<bool> multiUnsupported;
+    /**
+     * An SMS queued by trySubmit.
+     */
+    struct QueuedSubmit {
+        std::vector<std::shared_ptr<PDU> > parts;
+        std::string tenant;
+        uint8_t priority;
+        boost::function<void(const boost::system::error_code &, const SendSmsResult &)> handler;
+    };
+
+    // SMSes queued by trySubmit from any thread, sent from the strand
+    std::unique_ptr<MpscRing<QueuedSubmit> > submitQueue;
+    // True while a drain of submitQueue is posted to the strand or running
+    std::atomic<bool> drainPosted;
+    // Handlers of asyncReadSms waiting for a DELIVER_SM
+    std::deque<boost::function<void(const boost::system::error_code &, const SMS &)> > smsHandlers;
+    // Handlers hold a weak reference to it, so handlers run after the client is destroyed do nothing
+    std::shared_ptr<bool> lifeline;
     // Socket write timeout in milliseconds. Default is 5000 milliseconds.
     int socketWriteTimeout;
     // Socket read timeout in milliseconds. Default is 30000 milliseconds.
     int socketReadTimeout;
 
     bool verbose;
+    // True if the synchronous calls run the io_service, false if the application runs it
+    bool runIoService;
+
+    // Updated each time the I/O loop runs, read when resolving timestamps
+    std::shared_ptr<Clock> clock;
 
   public:
     /**
@@ -113,6 +403,13 @@ class SmppClient {
      */
     void bindReceiver(const std::string &login, const std::string &password);
 
+    /**
+     * Binds the client in transceiver mode, so it can both send and receive SMSes on one connection.
+     * @param login SMSC login
+     * @param password SMSC password.
+     */
+    void bindTransceiver(const std::string &login, const std::string &password);
+
     /**
      * Unbinds the client.
      */
@@ -131,15 +428,358 @@ class SmppClient {
      * @param schedule_delivery_time
      * @param validity_period
      * @param dataCoding
+     * @param shiftTables National language tables the message was encoded with, announced in the UDH of each part.
      * @return SMSC sms id.
      */
     std::pair<std::string, int> sendSms(const SmppAddress &sender, const SmppAddress &receiver, const std::string &shortMessage,
                         std::list<TLV> tags = std::list<TLV>(), const uint8_t priority_flag = 0,
                         const std::string &schedule_delivery_time = "", const std::string &validity_period = "",
-                        const int dataCoding = smpp::DATA_CODING_DEFAULT);
+                        const int dataCoding = smpp::DATA_CODING_DEFAULT,
+                        const oc::tools::GsmShiftTables &shiftTables = oc::tools::GsmShiftTables());
+    /**
+     * Sends an SMS to a number of destinations with submit_multi, packing up to MAX_MULTI_DESTINATIONS in each PDU.
+     * The SMS is split into multiple if it doesn't fit into one, like with sendSms.
+     *
+     * If the SMSC does not support submit_multi, it sends the SMS with one submit_sm per SME instead, through the
+     * transmit window, and later calls skip submit_multi. Distribution lists can't be sent to then, they are
+     * returned as unsuccessful.
+     *
+     * @param sender
+     * @param destinations SME addresses or distribution list names, an SmppAddress converts to a destination.
+     * @param shortMessage
+     * @param tags
+     * @param priority_flag
+     * @param schedule_delivery_time
+     * @param validity_period
+     * @param dataCoding
+     * @param shiftTables National language tables the message was encoded with, announced in the UDH of each part.
+     * @return SMSC id, number of PDUs sent and the destinations the SMSC did not accept.
+     * @throw SmppException if there are no destinations or the SMSC rejected the SMS as a whole.
+     */
+    SendMultiResult sendMulti(const SmppAddress &sender, const std::vector<MultiDestination> &destinations,
+                              const std::string &shortMessage, const std::list<TLV> &tags = std::list<TLV>(),
+                              const uint8_t priority_flag = 0, const std::string &schedule_delivery_time = "",
+                              const std::string &validity_period = "",
+                              const int dataCoding = smpp::DATA_CODING_DEFAULT,
+                              const oc::tools::GsmShiftTables &shiftTables = oc::tools::GsmShiftTables());
+
+    /**
+     * Sends an SMS without waiting for the responses, so up to the window size of submits are in flight at once.
+     * If the window is full it blocks reading responses until there is room for the next part.
+     * The responses are collected with readSubmitResult.
+     * Only available while the client runs the io_service, see setRunIoService.
+     *
+     * @param sender
+     * @param receiver
+     * @param shortMessage
+     * @param tags
+     * @param priority_flag
+     * @param schedule_delivery_time
+     * @param validity_period
+     * @param dataCoding
+     * @param shiftTables National language tables the message was encoded with, announced in the UDH of each part.
+     * @return Sequence numbers of the submit_sm PDUs, one per part.
+     */
+    std::vector<uint32_t> submitSms(const SmppAddress &sender, const SmppAddress &receiver,
+                                    const std::string &shortMessage, std::list<TLV> tags = std::list<TLV>(),
+                                    const uint8_t priority_flag = 0, const std::string &schedule_delivery_time = "",
+                                    const std::string &validity_period = "",
+                                    const int dataCoding = smpp::DATA_CODING_DEFAULT,
+                                    const oc::tools::GsmShiftTables &shiftTables = oc::tools::GsmShiftTables());
+
+    /**
+     * Returns the next response to a submit sent with submitSms, in the order the SMSC answered.
+     * Blocks until one arrives. A failed submit is returned with its status and error, not thrown.
+     * Only available while the client runs the io_service, see setRunIoService.
+     * @return Response to one of the outstanding submits.
+     * @throw SmppException if no submits are outstanding.
+     */
+    SubmitResult readSubmitResult();
+
+    /**
+     * @return Number of submits sent with submitSms, whose responses are not collected yet.
+     */
+    size_t getOutstanding() const {
+        return submitsInFlight + submitResults.size();
+    }
+
+    /**
+     * Sends an SMS asynchronously, with the default options of sendSms.
+     * See the full overload.
+     */
+    template<typename CompletionToken>
+    BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(boost::system::error_code, SendSmsResult))
+    asyncSendSms(const SmppAddress &sender, const SmppAddress &receiver, const std::string &shortMessage,
+                 CompletionToken &&token) {
+        return asyncSendSms(sender, receiver, shortMessage, std::list<TLV>(), 0, "", "", smpp::DATA_CODING_DEFAULT,
+                            oc::tools::GsmShiftTables(), std::forward<CompletionToken>(token));
+    }
+
+    /**
+     * Sends an SMS asynchronously. The parts go through the transmit window, if it's full they are held back
+     * until there is room, so one thread can have any number of messages in flight.
+     *
+     * The completion token decides how the result is delivered: a handler
+     * void(boost::system::error_code, SendSmsResult), boost::asio::use_future or boost::asio::use_awaitable.
+     * It completes when all parts are answered, with the SMSC id of the last part, or with the error of the first
+     * part that failed. A part rejected by the SMSC gives an error in the ESME category.
+     * The io_service of the socket must be run for the call to progress.
+     *
+     * @param sender
+     * @param receiver
+     * @param shortMessage
+     * @param tags
+     * @param priority_flag
+     * @param schedule_delivery_time
+     * @param validity_period
+     * @param dataCoding
+     * @param shiftTables National language tables the message was encoded with, announced in the UDH of each part.
+     * @param token Completion token.
+     */
+    template<typename CompletionToken>
+    BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(boost::system::error_code, SendSmsResult))
+    asyncSendSms(const SmppAddress &sender, const SmppAddress &receiver, const std::string &shortMessage,
+                 const std::list<TLV> &tags, const uint8_t priority_flag, const std::string &schedule_delivery_time,
+                 const std::string &validity_period, const int dataCoding,
+                 const oc::tools::GsmShiftTables &shiftTables, CompletionToken &&token) {
+        return asyncSendSms(std::string(), sender, receiver, shortMessage, tags, priority_flag,
+                            schedule_delivery_time, validity_period, dataCoding, shiftTables,
+                            std::forward<CompletionToken>(token));
+    }
+
+    /**
+     * Sends an SMS of a tenant asynchronously, with the default options of sendSms. See the full overload.
+     */
+    template<typename CompletionToken>
+    BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(boost::system::error_code, SendSmsResult))
+    asyncSendSms(const std::string &tenant, const SmppAddress &sender, const SmppAddress &receiver,
+                 const std::string &shortMessage, CompletionToken &&token) {
+        return asyncSendSms(tenant, sender, receiver, shortMessage, std::list<TLV>(), 0, "", "",
+                            smpp::DATA_CODING_DEFAULT, oc::tools::GsmShiftTables(),
+                            std::forward<CompletionToken>(token));
+    }
+
+    /**
+     * Sends an SMS of a tenant asynchronously. The parts wait for room in the window in the queue of the tenant,
+     * and the tenants take turns by their weights, see setTenant. SMSes sent without a tenant belong to the
+     * tenant "". Otherwise as the overload without a tenant.
+     *
+     * @param tenant Id of the tenant.
+     * @param sender
+     * @param receiver
+     * @param shortMessage
+     * @param tags
+     * @param priority_flag
+     * @param schedule_delivery_time
+     * @param validity_period
+     * @param dataCoding
+     * @param shiftTables National language tables the message was encoded with, announced in the UDH of each part.
+     * @param token Completion token.
+     */
+    template<typename CompletionToken>
+    BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(boost::system::error_code, SendSmsResult))
+    asyncSendSms(const std::string &tenant, const SmppAddress &sender, const SmppAddress &receiver,
+                 const std::string &shortMessage, const std::list<TLV> &tags, const uint8_t priority_flag,
+                 const std::string &schedule_delivery_time, const std::string &validity_period,
+                 const int dataCoding, const oc::tools::GsmShiftTables &shiftTables, CompletionToken &&token) {
+        std::vector<std::shared_ptr<PDU> > parts = setupSubmitSm(sender, receiver, shortMessage, tags,
+                priority_flag, schedule_delivery_time, validity_period, dataCoding, shiftTables);
+        return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code, SendSmsResult)>(
+                   Initiation<SendSmsResult>(strand), token,
+                   boost::bind(&SmppClient::startSendSms, this, parts, tenant, priority_flag, _1));
+    }
+
+    /**
+     * Queues an SMS to be sent, with the default options of sendSms. See the full overload.
+     */
+    bool trySubmit(const SmppAddress &sender, const SmppAddress &receiver, const std::string &shortMessage,
+                   const boost::function<void(const boost::system::error_code &, const SendSmsResult &)> &handler) {
+        return trySubmit(std::string(), sender, receiver, shortMessage, std::list<TLV>(), 0, "", "",
+                         smpp::DATA_CODING_DEFAULT, oc::tools::GsmShiftTables(), handler);
+    }
+
+    /**
+     * Queues an SMS of a tenant to be sent, with the default options of sendSms. See the full overload.
+     */
+    bool trySubmit(const std::string &tenant, const SmppAddress &sender, const SmppAddress &receiver,
+                   const std::string &shortMessage,
+                   const boost::function<void(const boost::system::error_code &, const SendSmsResult &)> &handler) {
+        return trySubmit(tenant, sender, receiver, shortMessage, std::list<TLV>(), 0, "", "",
+                         smpp::DATA_CODING_DEFAULT, oc::tools::GsmShiftTables(), handler);
+    }
+
+    /**
+     * Queues an SMS to be sent, as the overload with a tenant, for the tenant "".
+     */
+    bool trySubmit(const SmppAddress &sender, const SmppAddress &receiver, const std::string &shortMessage,
+                   const std::list<TLV> &tags, const uint8_t priority_flag, const std::string &schedule_delivery_time,
+                   const std::string &validity_period, const int dataCoding,
+                   const oc::tools::GsmShiftTables &shiftTables,
+                   const boost::function<void(const boost::system::error_code &, const SendSmsResult &)> &handler) {
+        return trySubmit(std::string(), sender, receiver, shortMessage, tags, priority_flag, schedule_delivery_time,
+                         validity_period, dataCoding, shiftTables, handler);
+    }
+
+    /**
+     * Queues an SMS to be sent, without waiting and without taking a lock, so any number of threads can feed one
+     * bind. The PDUs are built by the calling thread, and the io_service sends the queued SMSes in batches as
+     * asyncSendSms does. Unlike asyncSendSms the queue is bounded: if it is full the SMS is not queued, and the
+     * caller can retry later or shed the load. Sequence numbers and message references are allocated atomically,
+     * so a msgRefCallback must be thread safe too.
+     *
+     * @param tenant Id of the tenant, see asyncSendSms.
+     * @param sender
+     * @param receiver
+     * @param shortMessage
+     * @param tags
+     * @param priority_flag
+     * @param schedule_delivery_time
+     * @param validity_period
+     * @param dataCoding
+     * @param shiftTables National language tables the message was encoded with, announced in the UDH of each part.
+     * @param handler Called from the io_service with the result, as for asyncSendSms. Not called if the SMS
+     * wasn't queued.
+     * @return False if the queue is full.
+     * @throw SmppException if the client is not bound to transmit.
+     */
+    bool trySubmit(const std::string &tenant, const SmppAddress &sender, const SmppAddress &receiver,
+                   const std::string &shortMessage, const std::list<TLV> &tags, const uint8_t priority_flag,
+                   const std::string &schedule_delivery_time, const std::string &validity_period,
+                   const int dataCoding, const oc::tools::GsmShiftTables &shiftTables,
+                   const boost::function<void(const boost::system::error_code &, const SendSmsResult &)> &handler);
+
+    /**
+     * Sets how many SMSes trySubmit can queue. Call it before trySubmit is used.
+     * @param capacity Number of SMSes, rounded up to a power of two. Default is 1024.
+     */
+    void setSubmitQueueCapacity(const size_t capacity) {
+        submitQueue.reset(new MpscRing<QueuedSubmit>(capacity));
+    }
+
+    size_t getSubmitQueueCapacity() const {
+        return submitQueue->capacity();
+    }
+
+    /**
+     * Sends an SMS to a number of destinations asynchronously, with the default options of sendMulti.
+     * The completion token decides how the result is delivered: a handler
+     * void(boost::system::error_code, SendMultiResult), boost::asio::use_future or boost::asio::use_awaitable.
+     * See sendMulti.
+     *
+     * @param sender
+     * @param destinations SME addresses or distribution list names.
+     * @param shortMessage
+     * @param token Completion token.
+     */
+    template<typename CompletionToken>
+    BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(boost::system::error_code, SendMultiResult))
+    asyncSendMulti(const SmppAddress &sender, const std::vector<MultiDestination> &destinations,
+                   const std::string &shortMessage, CompletionToken &&token) {
+        std::shared_ptr<SendMultiState> state = setupSendMulti(sender, destinations, shortMessage, std::list<TLV>(),
+                0, "", "", smpp::DATA_CODING_DEFAULT, oc::tools::GsmShiftTables());
+        return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code, SendMultiResult)>(
+                   Initiation<SendMultiResult>(strand), token,
+                   boost::bind(&SmppClient::startSendMulti, this, state, _1));
+    }
+
+    /**
+     * Queries the SMSC asynchronously about the state of a previously sent SMS.
+     * The completion token decides how the result is delivered: a handler
+     * void(boost::system::error_code, QuerySmResult), boost::asio::use_future or boost::asio::use_awaitable.
+     * See querySm.
+     *
+     * @param messageid
+     * @param source
+     * @param token Completion token.
+     */
+    template<typename CompletionToken>
+    BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(boost::system::error_code, QuerySmResult))
+    asyncQuerySm(const std::string &messageid, const SmppAddress &source, CompletionToken &&token) {
+        std::shared_ptr<PDU> pdu = setupQuerySm(messageid, source);
+        return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code, QuerySmResult)>(
+                   Initiation<QuerySmResult>(strand), token,
+                   boost::bind(&SmppClient::startQuerySm, this, pdu, _1));
+    }
+
+    /**
+     * Binds the client asynchronously in transmitter mode.
+     * The completion token decides how the result is delivered: a handler
+     * void(boost::system::error_code, std::string) called with the system id of the SMSC,
+     * boost::asio::use_future or boost::asio::use_awaitable.
+     *
+     * @param login SMSC login.
+     * @param password SMSC password.
+     * @param token Completion token.
+     */
+    template<typename CompletionToken>
+    BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(boost::system::error_code, std::string))
+    asyncBindTransmitter(const std::string &login, const std::string &password, CompletionToken &&token) {
+        return asyncBind(smpp::BIND_TRANSMITTER, login, password, std::forward<CompletionToken>(token));
+    }
+
+    /**
+     * Binds the client asynchronously in receiver mode. See asyncBindTransmitter.
+     */
+    template<typename CompletionToken>
+    BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(boost::system::error_code, std::string))
+    asyncBindReceiver(const std::string &login, const std::string &password, CompletionToken &&token) {
+        return asyncBind(smpp::BIND_RECEIVER, login, password, std::forward<CompletionToken>(token));
+    }
+
+    /**
+     * Binds the client asynchronously in transceiver mode. See asyncBindTransmitter.
+     */
+    template<typename CompletionToken>
+    BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(boost::system::error_code, std::string))
+    asyncBindTransceiver(const std::string &login, const std::string &password, CompletionToken &&token) {
+        return asyncBind(smpp::BIND_TRANSCEIVER, login, password, std::forward<CompletionToken>(token));
+    }
+
+    /**
+     * Unbinds the client asynchronously.
+     * The completion token decides how the result is delivered: a handler void(boost::system::error_code),
+     * boost::asio::use_future or boost::asio::use_awaitable.
+     * @param token Completion token.
+     */
+    template<typename CompletionToken>
+    BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(boost::system::error_code))
+    asyncUnbind(CompletionToken &&token) {
+        return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code)>(
+                   Initiation<void>(strand), token, boost::bind(&SmppClient::startUnbind, this, _1));
+    }
+
+    /**
+     * Sends an enquire link asynchronously, ie. to check the health of an idle connection.
+     * The completion token decides how the result is delivered: a handler void(boost::system::error_code),
+     * boost::asio::use_future or boost::asio::use_awaitable.
+     * @param token Completion token.
+     */
+    template<typename CompletionToken>
+    BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(boost::system::error_code))
+    asyncEnquireLink(CompletionToken &&token) {
+        return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code)>(
+                   Initiation<void>(strand), token,
+                   boost::bind(&SmppClient::startEnquireLink, this, _1));
+    }
+
+    /**
+     * Waits asynchronously for the next SMS from the SMSC. Unlike readSms it does not time out,
+     * it completes when a DELIVER_SM arrives or the connection is lost.
+     * The completion token decides how the result is delivered: a handler
+     * void(boost::system::error_code, SMS), boost::asio::use_future or boost::asio::use_awaitable.
+     * @param token Completion token.
+     */
+    template<typename CompletionToken>
+    BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(boost::system::error_code, SMS))
+    asyncReadSms(CompletionToken &&token) {
+        return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code, SMS)>(
+                   Initiation<SMS>(strand), token, boost::bind(&SmppClient::startReadSms, this, _1));
+    }
+
     /**
      * Returns the first SMS in the PDU queue,
      * or does a blocking read on the socket until we receive an SMS from the SMSC.
+     * Only available while the client runs the io_service, use asyncReadSms or onDeliverSm otherwise.
      */
     smpp::SMS readSms();
 
@@ -162,8 +802,9 @@ class SmppClient {
     void enquireLink();
 
     /**
-     * Checks if the SMSC has sent us a enquire link command.
-     * If they have, a response is sent.
+     * Runs the handlers that are ready without blocking, so enquire links the SMSC has sent are answered.
+     * Enquire links are answered by the read loop as they arrive, whenever the io_service runs, so it does nothing
+     * when the application runs the io_service.
      */
     void enquireLinkRespond();
 
@@ -279,6 +920,37 @@ class SmppClient {
         return csmsMethod;
     }
 
+    /**
+     * Sets the transmit window, the number of requests that may await a response at once.
+     * SMSCs usually allow 10 or more per bind. Default is 1.
+     * @param size Window size, at least 1.
+     */
+    void setWindowSize(const unsigned int &size) {
+        if (size == 0) {
+            throw SmppException("Window size must be at least 1");
+        }
+
+        windowSize = size;
+    }
+
+    unsigned int getWindowSize() const {
+        return windowSize;
+    }
+
+    /**
+     * Paces submits, SUBMIT_SM and SUBMIT_MULTI, with a rate limiter, which adapts its rate when the SMSC throttles
+     * them. Share one limiter between the clients of an account to keep the account within its contracted rate.
+     * Submits waiting for the limiter are held back like submits waiting for room in the window.
+     * @param limiter Rate limiter, or null to send submits as fast as the window allows. Default is null.
+     */
+    void setRateLimiter(const std::shared_ptr<RateLimiter> &limiter) {
+        rateLimiter = limiter;
+    }
+
+    std::shared_ptr<RateLimiter> getRateLimiter() const {
+        return rateLimiter;
+    }
+
     /**
      * Sets the socket read timeout in milliseconds. Default is 5000 milliseconds.
      * @param timeout Socket read timeout in milliseconds.
@@ -295,6 +967,145 @@ class SmppClient {
         return socketReadTimeout;
     }
 
+    /**
+     * Sets how precisely requests time out. Timeouts are rounded up to a whole number of ticks, plus one, so a
+     * request that gets no response fails up to this much later than the socket read timeout. Timeouts are
+     * checked once per tick, however many requests are pending. It takes effect once no request is pending.
+     * @param resolution Tick length in milliseconds, at least 1. Default is 100 milliseconds.
+     */
+    void setTimeoutResolution(const int resolution) {
+        if (resolution <= 0) {
+            throw SmppException("Timeout resolution must be at least 1 millisecond");
+        }
+
+        timeoutResolution = resolution;
+    }
+
+    int getTimeoutResolution() const {
+        return timeoutResolution;
+    }
+
+    /**
+     * Sets how many queued PDUs may be gathered into one write on the socket. PDUs queue up while a write is in
+     * progress, and are written together once it completes.
+     * @param pdus Most PDUs per write, at least 1. Default is 64.
+     * @param octets Most octets per write, a single larger PDU is still written. Default is 65536.
+     */
+    void setMaxWriteBatch(const size_t pdus, const size_t octets = 65536) {
+        if (pdus == 0) {
+            throw SmppException("Write batch must hold at least 1 PDU");
+        }
+
+        maxWritePdus = pdus;
+        maxWriteOctets = octets;
+    }
+
+    /**
+     * Lets a PDU wait for others before it is written, when no write is in progress, so a burst of PDUs needs fewer
+     * writes. The wait ends early once a full batch is queued. It adds up to the linger to the latency of each
+     * request, so it suits bulk sending.
+     * @param linger Most milliseconds a PDU waits, 0 to write it at once. Default is 0.
+     */
+    void setWriteLinger(const int linger) {
+        writeLinger = linger;
+    }
+
+    int getWriteLinger() const {
+        return writeLinger;
+    }
+
+    /**
+     * Turns Nagle's algorithm off or on for the socket. With it on the kernel holds back small writes while data
+     * is unacknowledged, which delays pipelined requests.
+     * @param noDelay True to send writes at once.
+     * @throw TransportException if the option can't be set.
+     */
+    void setNoDelay(const bool noDelay);
+
+    /**
+     * Sets the order submits held back by the window or the rate limiter are sent in. They are queued by their
+     * priority_flag, so urgent ones like one-time passwords overtake queued bulk. Submits of the same priority, and
+     * requests that aren't submits, which go with priority 0, keep their order.
+     * STRICT_PRIORITY, the default, always sends the highest priority first, so lower ones wait as long as higher
+     * ones are queued. WEIGHTED_PRIORITY gives each priority that has submits queued as many turns per round as its
+     * weight, highest first, so bulk slows down but keeps moving.
+     * Call it before sending.
+     *
+     * @param mode STRICT_PRIORITY or WEIGHTED_PRIORITY.
+     * @param weights Turns per round of priority 0 to 3, used by WEIGHTED_PRIORITY. Default is 1, 2, 4 and 8.
+     * @throw SmppException if there isn't a weight of at least 1 per priority.
+     */
+    void setPriorityScheduling(const int mode, const std::vector<unsigned int> &weights = std::vector<unsigned int>());
+
+    /**
+     * Sets the share of the window of a tenant. Tenants with requests waiting for room in the window take turns by
+     * deficit round robin: in a round each gets as many turns as its weight, so one tenant with a large campaign
+     * queued can't hold back the others. Tenants that haven't been set have weight 1 and no cap.
+     *
+     * @param tenant Id of the tenant, as given to asyncSendSms or trySubmit.
+     * @param weight Turns per round, at least 1.
+     * @param maxInFlight Cap on the requests of the tenant awaiting a response, 0 for none. A tenant at its cap is
+     * passed over until one is answered.
+     * @throw SmppException if the weight is 0.
+     */
+    void setTenant(const std::string &tenant, const unsigned int weight, const size_t maxInFlight = 0);
+
+    /**
+     * The requests of a tenant sent and answered only ever grow, so the throughput of a tenant is the increase
+     * between two calls divided by the time between them.
+     * @return Queue depth and throughput of each tenant seen, including the tenant "" of requests sent without one.
+     */
+    std::map<std::string, TenantStats> getTenantStats() const;
+
+    /**
+     * @param priority priority_flag of the submits, higher ones count as 3.
+     * @return Latencies of the answered submits of the priority since the client was constructed or reset.
+     */
+    LatencyStats getLatencyStats(const uint8_t priority) const;
+
+    /**
+     * Clears the latencies of all priorities.
+     */
+    void resetLatencyStats();
+
+    /**
+     * Journals the submits in a spool, so the ones not answered yet survive a crash. Each SUBMIT_SM and
+     * SUBMIT_MULTI is copied into the spool as it is queued, and committed once its handler is called, whether the
+     * SMSC answered it, it timed out or it was lost with the connection. Only the submits still queued or in flight
+     * when the process dies stay in the spool. Call it before sending.
+     * @param _spool Spool, or null to stop journaling.
+     */
+    void setSpool(const std::shared_ptr<Spool> &_spool) {
+        spool = _spool;
+    }
+
+    /**
+     * Sends the submits left in the spool again, in the order they were spooled, with new sequence numbers. Use it
+     * after a restart, once bound, so an SMS the application had handed over is sent at least once. The submits
+     * this client still has queued or in flight are left alone. They go through the window with priority 0 and the
+     * tenant "". Waits until they are queued, like the other synchronous calls.
+     *
+     * @param handler Called from the io_service with the result of each submit.
+     * @return Number of submits sent again.
+     * @throw SmppException if there is no spool, the client is not bound to transmit, or it is called from a thread
+     * running the io_service while the application runs it.
+     */
+    size_t resendSpooled(const boost::function<void(const boost::system::error_code &, const SubmitResult &)> &handler);
+
+    /**
+     * @return Number of writes on the socket.
+     */
+    uint64_t getWriteCount() const {
+        return writeCount;
+    }
+
+    /**
+     * @return Number of PDUs written on the socket, getWriteCount() of them at a time.
+     */
+    uint64_t getWrittenPduCount() const {
+        return writtenPduCount;
+    }
+
     /**
      * Sets the socket write timeout in milliseconds. Default is 30000 milliseconds.
      * @param timeout Socket write timeout in milliseconds.
@@ -319,6 +1130,48 @@ class SmppClient {
         return verbose;
     }
 
+    /**
+     * Sets whether the synchronous calls run the io_service of the socket until they complete. Default is true.
+     *
+     * Set it to false when threads of the application run the io_service. The synchronous calls then wait for
+     * those threads to complete them, and may be made from many threads at once, but not from a thread running
+     * the io_service. submitSms, readSubmitResult and readSms are not available. Set the options and handlers
+     * before binding, and destroy the client only after unbinding it and stopping the threads.
+     * @param b False if the application runs the io_service.
+     */
+    void setRunIoService(const bool b) {
+        runIoService = b;
+    }
+
+    bool getRunIoService() const {
+        return runIoService;
+    }
+
+    /**
+     * Replaces the clock the client resolves timestamps against, ie. with a VirtualClock in tests.
+     * The client calls update() on it each time its I/O loop runs. Default is a CoarseClock.
+     * @param c Clock to use.
+     */
+    void setClock(const std::shared_ptr<Clock> &c) {
+        clock = c;
+    }
+
+    /**
+     * Returns the clock of the client, which is at most one I/O loop iteration behind the system time.
+     * @return Clock of the client.
+     */
+    const Clock &getClock() const {
+        return *clock;
+    }
+
+    /**
+     * Throws the exception matching an error passed to a handler of the asynchronous calls, the same exception the
+     * synchronous call would have thrown.
+     * @param error Error passed to the handler.
+     * @throw SmppException or one of its subclasses for an error in the ESME category, TransportException otherwise.
+     */
+    static void throwOnError(const boost::system::error_code &error);
+
     /**
      * Set callback method for generating message references.
      * The returned integer must be modulo 65535 (0xffff)
@@ -328,6 +1181,145 @@ class SmppClient {
         msgRefCallback = cb;
     }
 
+    /**
+     * Registers a handler for DELIVER_SM, called from the read loop as each one arrives.
+     * The DELIVER_SM_RESP is sent before the handler is called. While a handler is registered, SMSes are not
+     * queued for readSms or asyncReadSms.
+     * The read loop runs whenever the io_service of the socket runs, so a receiver only needs to run it.
+     * @param handler Handler of the SMS, or an empty function to queue SMSes again.
+     */
+    void onDeliverSm(const boost::function<void(const SMS &)> &handler) {
+        deliverSmHandler = handler;
+    }
+
+    /**
+     * Sets how many SMSes may be queued for readSms or asyncReadSms. Once the queue is full, further DELIVER_SMs
+     * are answered with ESME_RMSGQFUL so the SMSC delivers them again later.
+     * @param limit Maximum number of queued SMSes, at least 1. Default is 1000.
+     */
+    void setSmsQueueLimit(const size_t limit) {
+        if (limit == 0) {
+            throw SmppException("SMS queue limit must be at least 1");
+        }
+
+        smsQueueLimit = limit;
+    }
+
+    size_t getSmsQueueLimit() const {
+        return smsQueueLimit;
+    }
+
+    /**
+     * Registers a handler for DATA_SM. The DATA_SM_RESP is sent before the handler is called.
+     * Without a handler DATA_SM is answered and dropped.
+     * @param handler Handler of the PDU, its body is positioned after the header.
+     */
+    void onDataSm(const boost::function<void(PDU &)> &handler) {
+        dataSmHandler = handler;
+    }
+
+    /**
+     * Registers a handler for ALERT_NOTIFICATION, which has no response.
+     * Without a handler it is dropped.
+     * @param handler Handler of the PDU, its body is positioned after the header.
+     */
+    void onAlertNotification(const boost::function<void(PDU &)> &handler) {
+        alertNotificationHandler = handler;
+    }
+
+    /**
+     * Registers a handler called when the SMSC sends an ENQUIRE_LINK. It is always answered, with or without
+     * a handler.
+     */
+    void onEnquireLink(const boost::function<void()> &handler) {
+        enquireLinkHandler = handler;
+    }
+
+    /**
+     * Registers a handler called when the SMSC unbinds the client. The UNBIND is answered and the client is
+     * unbound before the handler is called.
+     */
+    void onUnbind(const boost::function<void()> &handler) {
+        unbindHandler = handler;
+    }
+
+    /**
+     * Registers a handler called when a bound client loses its connection, because the socket failed or the
+     * keepalive found the link dead. The client is unbound and its requests have failed when it is called,
+     * unless it reconnects, see setReconnect.
+     * @param handler Handler of the error, boost::asio::error::timed_out for a dead link.
+     */
+    void onConnectionLost(const boost::function<void(const boost::system::error_code &)> &handler) {
+        connectionLostHandler = handler;
+    }
+
+    /**
+     * Sends an ENQUIRE_LINK whenever the SMSC has sent nothing for a while, so SMSCs that drop idle binds keep
+     * the bind, and a dead link is noticed. Traffic from the SMSC, including the responses to submits, puts off the
+     * keepalive. The link is dead once a number of keepalives in a row go unanswered, then the socket is closed and
+     * the onConnectionLost handler is called. Takes effect from the next bind, and runs while the io_service runs.
+     * @param interval Milliseconds without an inbound PDU, 0 for no keepalive. Default is 0.
+     * @param maxMissed Unanswered keepalives after which the link is dead, at least 1. Default is 3.
+     */
+    void setEnquireLinkInterval(const int interval, const int maxMissed = 3) {
+        if (maxMissed < 1) {
+            throw SmppException("At least 1 missed enquire link must be allowed");
+        }
+
+        enquireLinkInterval = interval;
+        maxMissedEnquireLinks = maxMissed;
+    }
+
+    int getEnquireLinkInterval() const {
+        return enquireLinkInterval;
+    }
+
+    /**
+     * Makes the client reconnect and bind again when a bound client loses its connection, instead of failing its
+     * requests. Attempts are spaced by a backoff that doubles up to a maximum, with random jitter, and go on until
+     * one succeeds. Meanwhile the client stays bound to the application: requests are held back and sent once it
+     * is bound again, so synchronous calls block across the reconnect.
+     * Submits sent on the lost connection that got no response may or may not have been accepted. AT_LEAST_ONCE
+     * sends them again, so an SMS may arrive twice. AT_MOST_ONCE fails them with the error of the connection, so
+     * an SMS may be lost. Other requests sent on the lost connection fail.
+     * @param endpoint SMSC to connect to.
+     * @param policy AT_LEAST_ONCE or AT_MOST_ONCE.
+     */
+    void setReconnect(const boost::asio::ip::tcp::endpoint &endpoint, const int policy = AT_LEAST_ONCE) {
+        reconnectEndpoint = endpoint;
+        reconnectPolicy = policy;
+        reconnectEnabled = true;
+    }
+
+    /**
+     * Sets the backoff between reconnect attempts.
+     * @param initial Milliseconds before the first attempt, at least 1. Default is 100 milliseconds.
+     * @param maximum Milliseconds the backoff grows to. Default is 30000 milliseconds.
+     */
+    void setReconnectBackoff(const int initial, const int maximum) {
+        if (initial <= 0 || maximum < initial) {
+            throw SmppException("Reconnect backoff must be at least 1 millisecond and no more than its maximum");
+        }
+
+        reconnectBackoff = initial;
+        maxReconnectBackoff = maximum;
+    }
+
+    /**
+     * @return True while the client reconnects after losing its connection.
+     */
+    bool isReconnecting() const {
+        return reconnecting;
+    }
+
+    /**
+     * Registers a handler called when the client is bound again after a reconnect, before the requests held back
+     * are sent.
+     */
+    void onReconnect(const boost::function<void()> &handler) {
+        reconnectHandler = handler;
+    }
+
   private:
     /**
      * Binds the client to be in the mode specified in the mode parameter.
@@ -337,8 +1329,92 @@ class SmppClient {
      */
     void bind(uint32_t mode, const std::string &login, const std::string &password);
 
+    template<typename CompletionToken>
+    BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(boost::system::error_code, std::string))
+    asyncBind(const uint32_t mode, const std::string &login, const std::string &password, CompletionToken &&token) {
+        checkConnection();
+        checkState(OPEN);
+        std::shared_ptr<PDU> pdu(new PDU(setupBindPdu(mode, login, password)));
+        return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code, std::string)>(
+                   Initiation<std::string>(strand), token,
+                   boost::bind(&SmppClient::startBind, this, pdu, _1));
+    }
+
+    /**
+     * Sends a bind PDU and moves the client to the bound state when the SMSC accepts it.
+     */
+    void startBind(const std::shared_ptr<PDU> &pdu,
+                   const boost::function<void(const boost::system::error_code &, const std::string &)> &handler);
+
+    void handleBindResponse(const uint32_t mode,
+                            const boost::function<void(const boost::system::error_code &, const std::string &)>
+                            &handler, const boost::system::error_code &error, PDU &resp);
+
+    /**
+     * Sends an UNBIND and moves the client to the open state when it is answered.
+     */
+    void startUnbind(const boost::function<void(const boost::system::error_code &)> &handler);
+
+    void handleUnbindResponse(const boost::function<void(const boost::system::error_code &)> &handler,
+                              const boost::system::error_code &error, PDU &resp);
+
+    /**
+     * Sends an ENQUIRE_LINK and calls the handler when it is answered.
+     */
+    void startEnquireLink(const boost::function<void(const boost::system::error_code &)> &handler);
+
+    /**
+     * Starts the keepalive of a bound client, if it has an interval.
+     */
+    void startKeepalive();
+
+    void stopKeepalive();
+
+    void handleKeepalive(const std::weak_ptr<bool> &alive, const boost::system::error_code &error);
+
+    void handleKeepaliveResponse(const boost::system::error_code &error);
+
     /**
-     * Constructs a PDU for binding the client.
+     * Closes the connection of a bound client that is lost, fails its requests or starts to reconnect, and calls
+     * the onConnectionLost handler.
+     */
+    void dropConnection(const boost::system::error_code &error);
+
+    /**
+     * Removes the requests awaiting a response, and stops their timeouts.
+     * @return The requests in the order they were sent.
+     */
+    std::vector<std::pair<uint32_t, PendingRequest> > takePending();
+
+    /**
+     * Holds back the unanswered submits of a lost connection to be sent again, or fails them, according to the
+     * reconnect policy. Other unanswered requests fail.
+     */
+    void recoverRequests(const boost::system::error_code &error);
+
+    /**
+     * Waits out the backoff before the next reconnect attempt.
+     */
+    void scheduleReconnect();
+
+    void handleReconnectTimer(const std::weak_ptr<bool> &alive, const boost::system::error_code &error);
+
+    void handleReconnect(const std::weak_ptr<bool> &alive, const boost::system::error_code &error);
+
+    void handleRebindResponse(const boost::system::error_code &error, PDU &resp);
+
+    /**
+     * Hands the next SMS to the handler, now if one is queued or else when it arrives.
+     */
+    void startReadSms(const boost::function<void(const boost::system::error_code &, const SMS &)> &handler);
+
+    /**
+     * Hands queued SMSes to the waiting handlers of asyncReadSms.
+     */
+    void deliverSms();
+
+    /**
+     * Constructs a PDU for binding the client, and remembers the parameters to bind again after a reconnect.
      * @param mode Mode to bind client in.
      * @param login SMSC login.
      * @param password SMSC password.
@@ -355,32 +1431,163 @@ class SmppClient {
     smpp::SMS parseSms();
 
     /**
-     * Splits a string, without leaving a dangling escape character, into an vector of substrings of a given length,
+     * Splits a string, without leaving a dangling escape character, into parts of a given length.
      *
      * @param shortMessage String to split.
-     * @param split How long each substring should be.
-     * @return Vector of substrings.
+     * @param split How long each part should be.
+     * @return Vector of part lengths.
+     */
+    std::vector<size_t> split(const std::string &shortMessage, const int split);
+
+    /**
+     * Constructs the SUBMIT_SM pdus for an SMS, one per part if it has to be split.
+     * @return PDUs to send, in order.
+     */
+    std::vector<std::shared_ptr<PDU> > setupSubmitSm(const SmppAddress &sender, const SmppAddress &receiver,
+            const std::string &shortMessage, std::list<TLV> tags, const uint8_t priority_flag,
+            const std::string &schedule_delivery_time, const std::string &validity_period, const int dataCoding,
+            const oc::tools::GsmShiftTables &shiftTables);
+
+    /**
+     * Constructs the SUBMIT_SM or SUBMIT_MULTI pdus for an SMS, one per part if it has to be split.
+     * @param commandId SUBMIT_SM, with one SME destination, or SUBMIT_MULTI.
+     * @return PDUs to send, in order.
+     */
+    std::vector<std::shared_ptr<PDU> > setupSubmit(const uint32_t commandId, const SmppAddress &sender,
+            const std::vector<MultiDestination> &destinations, const std::string &shortMessage,
+            std::list<TLV> tags, const uint8_t priority_flag, const std::string &schedule_delivery_time,
+            const std::string &validity_period, const int dataCoding, const oc::tools::GsmShiftTables &shiftTables);
+
+    /**
+     * Constructs the state of a sendMulti, with its SUBMIT_MULTI pdus unless the SMSC is known not to support them.
+     * @throw SmppException if there are no destinations.
      */
-    std::vector<std::string> split(const std::string &shortMessage, const int split);
+    std::shared_ptr<SendMultiState> setupSendMulti(const SmppAddress &sender,
+            const std::vector<MultiDestination> &destinations, const std::string &shortMessage,
+            const std::list<TLV> &tags, const uint8_t priority_flag, const std::string &schedule_delivery_time,
+            const std::string &validity_period, const int dataCoding, const oc::tools::GsmShiftTables &shiftTables);
 
     /**
-     * Sends a SUBMIT_SM pdu with the required details for sending an SMS to the SMSC.
-     * It blocks until it gets a response from the SMSC.
+     * Constructs a SUBMIT_SM or SUBMIT_MULTI pdu with the required details for sending an SMS to the SMSC.
+     * The UDH and the message are written straight into the PDU.
      *
+     * @param commandId SUBMIT_SM or SUBMIT_MULTI.
      * @param sender
-     * @param receiver
+     * @param destinations Receiver of a SUBMIT_SM, or destinations of a SUBMIT_MULTI.
+     * @param udh UDH to put in front of the message, may be empty.
      * @param shortMessage
+     * @param messageLen
      * @param tags
      * @param priority_flag
      * @param schedule_delivery_time
      * @param validity_period
      * @param esmClassOpts;
-     * @return SMSC sms id.
+     * @return SUBMIT_SM pdu.
+     */
+    std::shared_ptr<PDU> setupSubmitSmPdu(const uint32_t commandId, const SmppAddress &sender,
+                                          const std::vector<MultiDestination> &destinations,
+                                          const std::string &udh, const char* shortMessage, const size_t &messageLen,
+                                          const std::list<TLV> &tags, const uint8_t priority_flag,
+                                          const std::string &schedule_delivery_time,
+                                          const std::string &validity_period, const int esmClassOpts,
+                                          const int dataCoding = smpp::DATA_CODING_DEFAULT);
+
+    /**
+     * Constructs a QUERY_SM pdu.
+     */
+    std::shared_ptr<PDU> setupQuerySm(const std::string &messageid, const SmppAddress &source);
+
+    /**
+     * Sends the parts of an SMS and calls the handler when all are answered.
+     */
+    void startSendSms(const std::vector<std::shared_ptr<PDU> > &parts, const std::string &tenant,
+                      const uint8_t priority,
+                      const boost::function<void(const boost::system::error_code &, const SendSmsResult &)> &handler);
+
+    /**
+     * Queues a request in the window of its tenant, and sends it if there is room.
+     */
+    void enqueueRequest(const Request &request);
+
+    /**
+     * Copies a spooled submit into a request with a new sequence number, for resendSpooled. Skips the ones this
+     * session still has queued or in flight.
+     */
+    void collectSpooled(std::vector<Request>* requests,
+                        const boost::function<void(const boost::system::error_code &, const SubmitResult &)> &handler,
+                        const uint64_t id, const uint8_t* data, const uint32_t size);
+
+    /**
+     * Replays the spool and queues the submits of resendSpooled.
+     * @param done Called with the number of submits queued.
+     */
+    void startResendSpooled(
+            const boost::function<void(const boost::system::error_code &, const SubmitResult &)> &handler,
+            const boost::function<void(const boost::system::error_code &, const size_t &)> &done);
+
+    /**
+     * Takes a request that left the window out of the in-flight count of its tenant.
+     * @param answered True if it got a response.
+     */
+    void releaseTenant(const Request &request, const bool answered);
+
+    /**
+     * Commits a spooled submit once its outcome is reported to the application, answered or failed, so it isn't
+     * sent again after a crash and doesn't keep its spool segment in use.
+     */
+    void commitSpooled(const Request &request);
+
+    /**
+     * Adds the latencies of an answered submit to the stats of its priority.
+     */
+    void recordLatency(const PendingRequest &entry);
+
+    /**
+     * Sends the SMSes queued by trySubmit.
+     */
+    void drainSubmitQueue(const std::weak_ptr<bool> &alive);
+
+    /**
+     * Sends the SUBMIT_MULTI pdus of a sendMulti, or its SUBMIT_SM pdus if the SMSC doesn't support them, and calls
+     * the handler when all are answered.
+     */
+    void startSendMulti(const std::shared_ptr<SendMultiState> &state,
+                        const boost::function<void(const boost::system::error_code &, const SendMultiResult &)>
+                        &handler);
+
+    /**
+     * Sends the SMS of a sendMulti with one SUBMIT_SM per SME destination.
+     */
+    void sendMultiFallback(const std::shared_ptr<SendMultiState> &state,
+                           const std::vector<MultiDestination> &destinations);
+
+    void handleSendMultiPart(const std::shared_ptr<SendMultiState> &state, const size_t index, const bool last,
+                             const boost::system::error_code &error, PDU &resp);
+
+    void handleSendMultiFallback(const std::shared_ptr<SendMultiState> &state, const SmppAddress &address,
+                                 const bool last, const boost::system::error_code &error, PDU &resp);
+
+    /**
+     * Completes a sendMulti once all of its pdus are answered.
+     */
+    void finishSendMulti(const std::shared_ptr<SendMultiState> &state);
+
+    /**
+     * Sends a QUERY_SM and calls the handler with the parsed response.
      */
-    std::string submitSm(const SmppAddress &sender, const SmppAddress &receiver, const std::string &shortMessage,
-                         std::list<TLV> tags, const uint8_t priority_flag, const std::string &schedule_delivery_time,
-                         const std::string &validity_period, const int esmClassOpts, const int dataCoding =
-                             smpp::DATA_CODING_DEFAULT);
+    void startQuerySm(const std::shared_ptr<PDU> &pdu,
+                      const boost::function<void(const boost::system::error_code &, const QuerySmResult &)> &handler);
+
+    /**
+     * Parses a QUERY_SM_RESP for startQuerySm.
+     */
+    void handleQuerySmResponse(const boost::function<void(const boost::system::error_code &, const QuerySmResult &)>
+                               &handler, const boost::system::error_code &error, PDU &resp);
+
+    /**
+     * Stores the response to a submit sent with submitSms for readSubmitResult.
+     */
+    void storeSubmitResult(const uint32_t sequenceNo, const boost::system::error_code &error, PDU &resp);
 
     /**
      * @return Returns the next sequence number.
@@ -389,79 +1596,125 @@ class SmppClient {
     uint32_t nextSequenceNumber();
 
     /**
-     * Sends one PDU to the SMSC.
+     * Queues one PDU, that has no response, for writing to the SMSC. It is dropped if the socket is closed.
      */
     void sendPdu(PDU &pdu);
 
     /**
-     * Sends one PDU to the SMSC and blocks until we a response to it.
-     * @param pdu PDU to send.
-     * @return PDU PDU response to the one we sent.
+     * Sends a request through the transmit window. If the window is full it is held back until a response
+     * makes room. The handler is called with the response, or with an error if it times out or the connection is
+     * lost. Handlers are called from the I/O loop, on the strand.
+     * @param pdu Request to send.
+     * @param handler Handler for the response.
+     * @param tenant Tenant whose turn it waits for.
+     * @param priority priority_flag of a submit, the class it waits in. 0 for other requests.
+     */
+    void sendRequest(PDU &pdu, const ResponseHandler &handler, const std::string &tenant = "",
+                     const uint8_t priority = 0);
+
+    /**
+     * Writes a request and starts its response timer.
      */
-    smpp::PDU sendCommand(PDU &pdu);
+    void transmit(const Request &request);
 
     /**
-     * Returns one PDU from SMSC.
+     * Transmits requests held back by the window, as long as it has room and the rate limiter allows them.
      */
-    PDU readPdu(const bool &);
+    void transmitWaiting();
 
-    void readPduBlocking();
+    void handlePacingTimeout(const std::weak_ptr<bool> &alive, const boost::system::error_code &error);
 
-    void handleTimeout(boost::optional<boost::system::error_code>* opt, const boost::system::error_code &error);
+    /**
+     * Hands a response to the handler of its request.
+     */
+    void completeRequest(PendingMap::iterator it, PDU &resp);
 
     /**
-     * Async write handler.
-     * @param
-     * @throw TransportException if an error occurred.
+     * Starts the timeout wheel unless it runs.
      */
-    void writeHandler(boost::optional<boost::system::error_code>* opt, const boost::system::error_code &error);
+    void startTimeoutWheel();
 
     /**
-     * Peeks at the socket and returns true if there is data to be read.
-     * @return True if there is data to be read.
+     * Waits for the next tick of the timeout wheel.
      */
-    bool socketPeek();
+    void armTimeoutWheel();
 
     /**
-     * Executes any pending async operations on the socket.
+     * Advances the timeout wheel to the current tick, and fails the requests that expired.
      */
-    void socketExecute();
+    void handleWheelTimeout(const std::weak_ptr<bool> &alive, const boost::system::error_code &error);
 
     /**
-     * Handler for reading a PDU header.
-     * If we read a valid PDU header on the socket, the readPduBodyHandler is invoked.
-     * @param error Boost error code
-     * @param read Bytes read
+     * Fails all pending and held back requests with the error, ie. when the connection is lost.
      */
-    void readPduHeaderHandler(const boost::system::error_code &error, size_t read,
-                              const boost::shared_array<uint8_t> &pduLength);
+    void failRequests(const boost::system::error_code &error);
 
-    void readPduHeaderHandlerBlocking(boost::optional<boost::system::error_code>* opt,
-                                      const boost::system::error_code &error, size_t read,
-                                      boost::shared_array<uint8_t> pduLength);
+    /**
+     * Queues octets for writing, writes happen one at a time in the order they were queued.
+     */
+    void queueWrite(const boost::shared_array<uint8_t> &octets, const int size);
 
     /**
-     * Handler for reading a PDU body.
-     * Reads a PDU body on the socket and pushes it onto the PDU queue.
-     *
-     * @param error Boost error code
-     * @param read Bytes read
+     * Writes as many queued PDUs as one batch holds.
      */
-    void readPduBodyHandler(const boost::system::error_code &error, size_t read, boost::shared_array<uint8_t> pduLength,
-                            boost::shared_array<uint8_t> pduBuffer);
+    void startWrite();
+
+    void handleWriteLinger(const std::weak_ptr<bool> &alive, const boost::system::error_code &error);
+
+    void handleWrite(const std::weak_ptr<bool> &alive, const boost::system::error_code &error);
+
+    void handleWriteTimeout(const std::weak_ptr<bool> &alive, const boost::system::error_code &error);
 
     /**
-     * Returns a response for a PDU we have sent,
-     * specified by its sequence number and its command id.
-     * First the PDU queue is checked for any responses,
-     * if we don't find any we do a blocking read on the socket until
-     * we get the desired response.
-     *
-     * @param sequence Sequence number to look for.
-     * @param commandId Command id to look for.
-     * @return PDU response to PDU with the given sequence number and command id.
+     * Arms the read loop unless a read is already outstanding.
+     * The loop reads one PDU at a time and hands it to handlePdu, until the connection fails.
+     */
+    void startRead();
+
+    void handleReadHeader(const std::weak_ptr<bool> &alive, boost::shared_array<uint8_t> pduLength,
+                          const boost::system::error_code &error);
+
+    void handleReadBody(const std::weak_ptr<bool> &alive, boost::shared_array<uint8_t> pduLength,
+                        boost::shared_array<uint8_t> pduBuffer, const boost::system::error_code &error);
+
+    /**
+     * Fails the pending requests when the read loop stops on an error.
+     */
+    void handleReadError(const boost::system::error_code &error);
+
+    /**
+     * Handles a PDU read from the SMSC. Responses are handed to their request, requests from the SMSC are
+     * answered and dispatched to their handler. PDUs without a handler are put in the PDU queue.
+     */
+    void handlePdu(PDU &pdu);
+
+    /**
+     * Runs one handler of the io_service, for the synchronous calls.
+     * @throw TransportException if there is nothing to run, ie. the connection is lost.
+     */
+    void runOne();
+
+    /**
+     * Starts a call on the strand and blocks until its handler sets the flag, running the io_service meanwhile
+     * unless the application runs it.
+     * @param start Starts the call.
+     * @param sync Completion flag set by the handler of the call.
+     * @throw SmppException if called from a thread running the io_service of an application.
      */
-    PDU readPduResponse(const uint32_t &sequence, const uint32_t &commandId);
+    void execute(const boost::function<void()> &start, SyncFlag &sync);
+
+    /**
+     * Checks that the synchronous calls run the io_service, for the calls only available then.
+     * @throw SmppException if the application runs the io_service.
+     */
+    void checkRunIoService();
+
+    /**
+     * Throws the exception matching the command status of a response.
+     * @param status Command status.
+     * @throw SmppException or one of its subclasses unless the status is ESME_ROK.
+     */
+    static void checkCommandStatus(const uint32_t status);
 
     /**
      * Checks the connection.
@@ -477,6 +1730,14 @@ class SmppClient {
 
     void checkState(const int state);
 
+    /**
+     * Checks if the client is in either of two states, ie. bound as transmitter or transceiver.
+     * @param state Desired state.
+     * @param alternative Other state allowed.
+     * @throw SmppException if the client is in neither state.
+     */
+    void checkState(const int state, const int alternative);
+
     /**
      * Default implementation for msgRefCallback.
      * Simple initializes a integer on the heap and increments it for each message reference.
@@ -486,16 +1747,98 @@ class SmppClient {
     static uint16_t defaultMessageRef();
 
     /**
-     * Calls io_service or get_io_service on the current socket depending on the Boost.Asio version
-     * In Boost ASIO 1.6.0+/Boost 1.47 io_service is renamed to get_io_service
+     * Returns the io_service of the socket.
      */
     boost::asio::io_service &getIoService() const {
-#if defined(BOOST_ASIO_VERSION) && (BOOST_ASIO_VERSION >= 100600)
-        return socket->get_io_service();
-#else
-        return socket->io_service();
-#endif  // defined(BOOST_ASIO_VERSION) && (BOOST_ASIO_VERSION >= 100600)
+        return static_cast<boost::asio::io_service &>(socket->get_executor().context());
     }
+
+    /**
+     * Completion handler of an asynchronous call, wrapping the handler produced from a completion token.
+     * It is copyable so it fits in a boost::function, also when the handler is move only, and it hands the result
+     * to the handler through its associated executor, never inline.
+     */
+    template<typename Handler, typename Result>
+    class Completion {
+      private:
+        std::shared_ptr<Handler> handler;
+        boost::asio::ip::tcp::socket::executor_type executor;
+
+        /**
+         * Calls the handler with the result, posted to its executor.
+         */
+        struct Invoke {
+            std::shared_ptr<Handler> handler;
+            boost::system::error_code error;
+            Result result;
+
+            void operator()() {
+                (*handler)(error, result);
+            }
+        };
+
+      public:
+        Completion(Handler &&_handler, const boost::asio::ip::tcp::socket::executor_type &_executor) :
+            handler(std::make_shared<Handler>(std::move(_handler))), executor(_executor) {
+        }
+
+        void operator()(const boost::system::error_code &error, const Result &result) const {
+            Invoke invoke = { handler, error, result };
+            boost::asio::post(boost::asio::get_associated_executor(*handler, executor), invoke);
+        }
+    };
+
+    /**
+     * Completion handler of an asynchronous call without a result.
+     */
+    template<typename Handler>
+    class Completion<Handler, void> {
+      private:
+        std::shared_ptr<Handler> handler;
+        boost::asio::ip::tcp::socket::executor_type executor;
+
+        struct Invoke {
+            std::shared_ptr<Handler> handler;
+            boost::system::error_code error;
+
+            void operator()() {
+                (*handler)(error);
+            }
+        };
+
+      public:
+        Completion(Handler &&_handler, const boost::asio::ip::tcp::socket::executor_type &_executor) :
+            handler(std::make_shared<Handler>(std::move(_handler))), executor(_executor) {
+        }
+
+        void operator()(const boost::system::error_code &error) const {
+            Invoke invoke = { handler, error };
+            boost::asio::post(boost::asio::get_associated_executor(*handler, executor), invoke);
+        }
+    };
+
+    /**
+     * Initiation function object for async_initiate. Start is bound to the member function starting the call, which
+     * runs on the strand of the client.
+     */
+    template<typename Result>
+    class Initiation {
+      private:
+        boost::asio::strand<boost::asio::ip::tcp::socket::executor_type> strand;
+
+      public:
+        explicit Initiation(const boost::asio::strand<boost::asio::ip::tcp::socket::executor_type> &_strand) :
+            strand(_strand) {
+        }
+
+        template<typename Handler, typename Start>
+        void operator()(Handler &&handler, const Start &start) const {
+            Completion<typename std::decay<Handler>::type, Result> completion(std::forward<Handler>(handler),
+                    strand.get_inner_executor());
+            // the call starts on the strand, inline if the caller already runs in it
+            boost::asio::dispatch(strand, boost::bind<void>(start, completion));
+        }
+    };
 };
 }  // namespace smpp
 #endif  // SMPP_SMPPCLIENT_H_
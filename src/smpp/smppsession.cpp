@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#include "smpp/smppsession.h"
+
+#if defined(BOOST_ASIO_HAS_CO_AWAIT)
+
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+#include <list>
+#include <string>
+
+using std::list;
+using std::shared_ptr;
+using std::string;
+
+using boost::asio::awaitable;
+using boost::asio::redirect_error;
+using boost::asio::use_awaitable;
+using boost::system::error_code;
+using oc::tools::GsmShiftTables;
+
+namespace smpp {
+SmppSession::SmppSession(const shared_ptr<SmppClient> &_client) :
+    client(_client) {
+}
+
+awaitable<string> SmppSession::bindTransmitter(const string &login, const string &password) {
+    error_code error;
+    string systemId = co_await client->asyncBindTransmitter(login, password, redirect_error(use_awaitable, error));
+    SmppClient::throwOnError(error);
+    co_return systemId;
+}
+
+awaitable<string> SmppSession::bindReceiver(const string &login, const string &password) {
+    error_code error;
+    string systemId = co_await client->asyncBindReceiver(login, password, redirect_error(use_awaitable, error));
+    SmppClient::throwOnError(error);
+    co_return systemId;
+}
+
+awaitable<string> SmppSession::bindTransceiver(const string &login, const string &password) {
+    error_code error;
+    string systemId = co_await client->asyncBindTransceiver(login, password, redirect_error(use_awaitable, error));
+    SmppClient::throwOnError(error);
+    co_return systemId;
+}
+
+awaitable<void> SmppSession::unbind() {
+    error_code error;
+    co_await client->asyncUnbind(redirect_error(use_awaitable, error));
+    SmppClient::throwOnError(error);
+}
+
+awaitable<SendSmsResult> SmppSession::submit(const SmppAddress &sender, const SmppAddress &receiver,
+        const string &shortMessage, const list<TLV> &tags, const uint8_t priority_flag,
+        const string &schedule_delivery_time, const string &validity_period, const int dataCoding,
+        const GsmShiftTables &shiftTables) {
+    error_code error;
+    SendSmsResult result = co_await client->asyncSendSms(sender, receiver, shortMessage, tags, priority_flag,
+                           schedule_delivery_time, validity_period, dataCoding, shiftTables,
+                           redirect_error(use_awaitable, error));
+    SmppClient::throwOnError(error);
+    co_return result;
+}
+
+awaitable<QuerySmResult> SmppSession::querySm(const string &messageid, const SmppAddress &source) {
+    error_code error;
+    QuerySmResult result = co_await client->asyncQuerySm(messageid, source, redirect_error(use_awaitable, error));
+    SmppClient::throwOnError(error);
+    co_return result;
+}
+
+awaitable<SMS> SmppSession::nextDeliver() {
+    error_code error;
+    SMS sms = co_await client->asyncReadSms(redirect_error(use_awaitable, error));
+    SmppClient::throwOnError(error);
+    co_return sms;
+}
+}  // namespace smpp
+
+#endif  // BOOST_ASIO_HAS_CO_AWAIT
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#ifndef SMPP_SMPPSESSION_H_
+#define SMPP_SMPPSESSION_H_
+
+#include "smpp/smppclient.h"
+
+// Only available when built as C++20, see ENABLE_COROUTINES in CMakeLists.txt
+#if defined(BOOST_ASIO_HAS_CO_AWAIT)
+
+#include <boost/asio/awaitable.hpp>
+// sessions are run with co_spawn
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+
+#include <list>
+#include <memory>
+#include <string>
+
+namespace smpp {
+
+/**
+ * Coroutine interface to an SmppClient, for services that run on asio and must not block a thread per session:
+ *
+ *     co_await session.bindTransmitter("username", "password");
+ *     SendSmsResult result = co_await session.submit(from, to, message);
+ *
+ * It uses the asynchronous calls of the client, so a session costs a coroutine frame rather than a thread.
+ * Failures are thrown as the same exceptions the synchronous calls throw.
+ *
+ * The client does its I/O on a strand, so with setRunIoService(false) on the client the io_service may be run from
+ * any number of threads, and sessions on the same client may be awaited from coroutines on any of them. By default
+ * the client expects to run the io_service itself, from one thread.
+ * Unbind before the session is destroyed, the destructor of the client would otherwise unbind synchronously.
+ */
+class SmppSession {
+  private:
+    std::shared_ptr<SmppClient> client;
+
+  public:
+    /**
+     * @param client Client on a connected socket, configured as needed, ie. with a window size.
+     */
+    explicit SmppSession(const std::shared_ptr<SmppClient> &client);
+
+    SmppClient &getClient() {
+        return *client;
+    }
+
+    /**
+     * Binds in transmitter mode.
+     * @return System id of the SMSC.
+     */
+    boost::asio::awaitable<std::string> bindTransmitter(const std::string &login, const std::string &password);
+
+    /**
+     * Binds in receiver mode.
+     * @return System id of the SMSC.
+     */
+    boost::asio::awaitable<std::string> bindReceiver(const std::string &login, const std::string &password);
+
+    /**
+     * Binds in transceiver mode, so the session can both submit and wait for deliveries.
+     * @return System id of the SMSC.
+     */
+    boost::asio::awaitable<std::string> bindTransceiver(const std::string &login, const std::string &password);
+
+    boost::asio::awaitable<void> unbind();
+
+    /**
+     * Sends an SMS, see SmppClient::sendSms. Submits from concurrent coroutines share the transmit window.
+     * @return SMSC id of the last part and the number of parts.
+     */
+    boost::asio::awaitable<SendSmsResult> submit(const SmppAddress &sender, const SmppAddress &receiver,
+            const std::string &shortMessage, const std::list<TLV> &tags = std::list<TLV>(),
+            const uint8_t priority_flag = 0, const std::string &schedule_delivery_time = "",
+            const std::string &validity_period = "", const int dataCoding = smpp::DATA_CODING_DEFAULT,
+            const oc::tools::GsmShiftTables &shiftTables = oc::tools::GsmShiftTables());
+
+    /**
+     * Queries the state of a sent SMS, see SmppClient::querySm.
+     */
+    boost::asio::awaitable<QuerySmResult> querySm(const std::string &messageid, const SmppAddress &source);
+
+    /**
+     * Waits for the next SMS from the SMSC, without a timeout. Requires a receiver or transceiver bind.
+     */
+    boost::asio::awaitable<SMS> nextDeliver();
+};
+}  // namespace smpp
+
+#endif  // BOOST_ASIO_HAS_CO_AWAIT
+#endif  // SMPP_SMPPSESSION_H_
@@ -0,0 +1,350 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#include "smpp/spool.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include "smpp/exceptions.h"
+
+using std::string;
+
+namespace smpp {
+
+// Magic, unused, generation. The magic is cleared when the segment is recycled.
+static const uint32_t SEGMENT_MAGIC = 0x53504f4c;
+static const size_t SEGMENT_HEADER_SIZE = 16;
+// Type, size of the PDU, id. Type 0 ends the records of a segment.
+static const uint32_t RECORD_PDU = 1;
+static const uint32_t RECORD_COMMIT = 2;
+static const size_t RECORD_HEADER_SIZE = 16;
+
+/**
+ * @return Octets a record takes, keeping the records 8 aligned.
+ */
+static size_t recordLength(const uint32_t size) {
+    return RECORD_HEADER_SIZE + ((size + 7) & ~static_cast<size_t>(7));
+}
+
+static SmppException spoolError(const string &what, const string &path) {
+    std::stringstream ss;
+    ss << what << " " << path << ": " << strerror(errno);
+    return SmppException(ss.str());
+}
+
+Spool::Spool(const string &_path, const size_t _segmentSize) :
+    path(_path),
+    segmentSize(_segmentSize),
+    segments(),
+    freeSegments(),
+    fileCount(0),
+    uncommitted(),
+    nextId(1),
+    nextGeneration(1),
+    syncInterval(0),
+    unsynced(0) {
+    if (segmentSize < SEGMENT_HEADER_SIZE + 2 * RECORD_HEADER_SIZE) {
+        throw SmppException("Spool segments are too small");
+    }
+
+    // the files are numbered from 0 without gaps, as recycled ones are reused
+    while (true) {
+        std::stringstream ss;
+        ss << path << "." << fileCount;
+
+        if (access(ss.str().c_str(), F_OK) != 0) {
+            break;
+        }
+
+        Segment segment = openSegment(ss.str(), false);
+        fileCount++;
+
+        if (segment.generation == 0) {
+            freeSegments.push_back(segment);
+        } else {
+            segments[segment.generation] = segment;
+        }
+    }
+
+    // in generation order, so each PDU is read before its commit
+    for (std::map<uint64_t, Segment>::iterator it = segments.begin(); it != segments.end(); it++) {
+        scanSegment(&it->second);
+        nextGeneration = it->first + 1;
+    }
+
+    recycleSegments();
+
+    if (segments.empty()) {
+        startSegment();
+    }
+}
+
+Spool::~Spool() {
+    if (syncInterval != 0) {
+        try {
+            sync();
+        } catch (SmppException &e) {
+            // the kernel still writes the mappings back
+        }
+    }
+
+    for (std::map<uint64_t, Segment>::iterator it = segments.begin(); it != segments.end(); it++) {
+        closeSegment(it->second);
+    }
+
+    for (size_t i = 0; i < freeSegments.size(); i++) {
+        closeSegment(freeSegments[i]);
+    }
+}
+
+Spool::Segment Spool::openSegment(const string &segmentPath, const bool create) {
+    int fd = open(segmentPath.c_str(), O_RDWR | (create ? O_CREAT : 0), 0644);
+
+    if (fd < 0) {
+        throw spoolError("Failed to open spool segment", segmentPath);
+    }
+
+    // a new file reads as zeros, ie. no records
+    if (create && ftruncate(fd, segmentSize) != 0) {
+        close(fd);
+        throw spoolError("Failed to size spool segment", segmentPath);
+    }
+
+    struct stat info;
+
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < SEGMENT_HEADER_SIZE + 2 * RECORD_HEADER_SIZE) {
+        close(fd);
+        throw SmppException("Spool segment " + segmentPath + " is truncated");
+    }
+
+    void* map = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (map == MAP_FAILED) {
+        close(fd);
+        throw spoolError("Failed to map spool segment", segmentPath);
+    }
+
+    Segment segment;
+    segment.path = segmentPath;
+    segment.fd = fd;
+    segment.map = static_cast<uint8_t*>(map);
+    segment.size = info.st_size;
+    segment.generation = 0;
+    segment.offset = SEGMENT_HEADER_SIZE;
+    segment.dirty = 0;
+    segment.uncommitted = 0;
+
+    uint32_t magic;
+    memcpy(&magic, segment.map, sizeof(magic));
+
+    if (magic == SEGMENT_MAGIC) {
+        memcpy(&segment.generation, segment.map + 8, sizeof(segment.generation));
+    }
+
+    return segment;
+}
+
+void Spool::scanSegment(Segment* segment) {
+    size_t offset = SEGMENT_HEADER_SIZE;
+
+    while (offset + RECORD_HEADER_SIZE <= segment->size) {
+        uint8_t* at = segment->map + offset;
+        uint32_t type;
+        uint32_t size;
+        uint64_t id;
+        memcpy(&type, at, sizeof(type));
+        memcpy(&size, at + 4, sizeof(size));
+        memcpy(&id, at + 8, sizeof(id));
+
+        // the end, or a record that can't be whole
+        if ((type != RECORD_PDU && type != RECORD_COMMIT) || offset + recordLength(size) > segment->size) {
+            break;
+        }
+
+        if (type == RECORD_PDU) {
+            uncommitted[id] = segment->generation;
+            segment->uncommitted++;
+        } else {
+            std::unordered_map<uint64_t, uint64_t>::iterator it = uncommitted.find(id);
+
+            if (it != uncommitted.end()) {
+                // the segment of the PDU is this one or an earlier one, which is already scanned
+                (it->second == segment->generation ? *segment : segments[it->second]).uncommitted--;
+                uncommitted.erase(it);
+            }
+        }
+
+        nextId = std::max(nextId, id + 1);
+        offset += recordLength(size);
+    }
+
+    segment->offset = offset;
+    segment->dirty = offset;
+}
+
+void Spool::startSegment() {
+    Segment segment;
+
+    if (freeSegments.empty()) {
+        std::stringstream ss;
+        ss << path << "." << fileCount;
+        segment = openSegment(ss.str(), true);
+        fileCount++;
+    } else {
+        segment = freeSegments.back();
+        freeSegments.pop_back();
+    }
+
+    segment.generation = nextGeneration++;
+    segment.offset = SEGMENT_HEADER_SIZE;
+    segment.dirty = 0;
+    segment.uncommitted = 0;
+
+    // the records of the segment's last use end before the first one
+    memset(segment.map + SEGMENT_HEADER_SIZE, 0, sizeof(uint32_t));
+    memcpy(segment.map + 8, &segment.generation, sizeof(segment.generation));
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(segment.map, &SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC));
+    segments[segment.generation] = segment;
+}
+
+void Spool::recycleSegments() {
+    // a later segment may hold the commits of an earlier one, so they go in order
+    while (segments.size() > 1 && segments.begin()->second.uncommitted == 0) {
+        Segment segment = segments.begin()->second;
+        segments.erase(segments.begin());
+        memset(segment.map, 0, sizeof(SEGMENT_MAGIC));
+
+        if (syncInterval != 0 && msync(segment.map, SEGMENT_HEADER_SIZE, MS_SYNC) != 0) {
+            freeSegments.push_back(segment);
+            throw spoolError("Failed to sync spool segment", segment.path);
+        }
+
+        freeSegments.push_back(segment);
+    }
+}
+
+void Spool::appendRecord(const uint32_t type, const uint64_t id, const uint8_t* data, const uint32_t size) {
+    size_t length = recordLength(size);
+
+    if (length > segmentSize - SEGMENT_HEADER_SIZE) {
+        throw SmppException("PDU is too large for the spool segments");
+    }
+
+    Segment* segment = &segments.rbegin()->second;
+
+    if (segment->offset + length > segment->size) {
+        if (syncInterval != 0) {
+            syncSegment(segment);
+        }
+
+        startSegment();
+        segment = &segments.rbegin()->second;
+    }
+
+    uint8_t* at = segment->map + segment->offset;
+
+    if (size > 0) {
+        memcpy(at + RECORD_HEADER_SIZE, data, size);
+    }
+
+    memcpy(at + 4, &size, sizeof(size));
+    memcpy(at + 8, &id, sizeof(id));
+
+    // the type goes last, a record is only read once whole, and it ends the segment until the next one is
+    if (segment->offset + length + RECORD_HEADER_SIZE <= segment->size) {
+        memset(at + length, 0, sizeof(uint32_t));
+    }
+
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(at, &type, sizeof(type));
+    segment->offset += length;
+
+    if (syncInterval != 0 && ++unsynced >= syncInterval) {
+        sync();
+    }
+}
+
+uint64_t Spool::append(const uint8_t* data, const uint32_t size) {
+    uint64_t id = nextId++;
+    appendRecord(RECORD_PDU, id, data, size);
+    Segment &segment = segments.rbegin()->second;
+    uncommitted[id] = segment.generation;
+    segment.uncommitted++;
+    return id;
+}
+
+void Spool::commit(const uint64_t id) {
+    std::unordered_map<uint64_t, uint64_t>::iterator it = uncommitted.find(id);
+
+    if (it == uncommitted.end()) {
+        return;
+    }
+
+    uint64_t generation = it->second;
+    appendRecord(RECORD_COMMIT, id, NULL, 0);
+    segments[generation].uncommitted--;
+    uncommitted.erase(id);
+    recycleSegments();
+}
+
+void Spool::replay(const boost::function<void(uint64_t, const uint8_t*, uint32_t)> &visitor) const {
+    for (std::map<uint64_t, Segment>::const_iterator it = segments.begin(); it != segments.end(); it++) {
+        const Segment &segment = it->second;
+
+        for (size_t offset = SEGMENT_HEADER_SIZE; offset < segment.offset;) {
+            const uint8_t* at = segment.map + offset;
+            uint32_t type;
+            uint32_t size;
+            uint64_t id;
+            memcpy(&type, at, sizeof(type));
+            memcpy(&size, at + 4, sizeof(size));
+            memcpy(&id, at + 8, sizeof(id));
+
+            if (type == RECORD_PDU && uncommitted.count(id) != 0) {
+                visitor(id, at + RECORD_HEADER_SIZE, size);
+            }
+
+            offset += recordLength(size);
+        }
+    }
+}
+
+void Spool::syncSegment(Segment* segment) {
+    if (segment->dirty >= segment->offset) {
+        return;
+    }
+
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t start = segment->dirty / page * page;
+
+    if (msync(segment->map + start, segment->offset - start, MS_SYNC) != 0) {
+        throw spoolError("Failed to sync spool segment", segment->path);
+    }
+
+    segment->dirty = segment->offset;
+}
+
+void Spool::sync() {
+    unsynced = 0;
+
+    for (std::map<uint64_t, Segment>::iterator it = segments.begin(); it != segments.end(); it++) {
+        syncSegment(&it->second);
+    }
+}
+
+void Spool::closeSegment(const Segment &segment) {
+    munmap(segment.map, segment.size);
+    close(segment.fd);
+}
+}  // namespace smpp
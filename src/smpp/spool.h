@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#ifndef SMPP_SPOOL_H_
+#define SMPP_SPOOL_H_
+
+#include <stdint.h>
+
+#include <boost/function.hpp>
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace smpp {
+
+/**
+ * Append-only journal of encoded PDUs in memory mapped files, so the PDUs accepted by the application survive a
+ * crash of the process until the SMSC has answered them.
+ *
+ * The journal is a series of segment files, path.0, path.1 and so on, of a fixed size. A PDU is appended as a
+ * record, which is a copy into the mapping, and when its response arrives a commit record marks it done. A
+ * segment is recycled once it, and every segment before it, holds no uncommitted PDU, so the files don't grow
+ * while the SMSC keeps up. On restart the PDUs without a commit are replayed in the order they were appended.
+ *
+ * The kernel writes the mappings back on its own, which survives the process but not the machine. With a sync
+ * interval the dirty part of the mapping is flushed with msync every so many records, or call sync().
+ *
+ * Not thread safe, SmppClient uses it from its strand.
+ */
+class Spool {
+  private:
+    struct Segment {
+        std::string path;
+        int fd;
+        uint8_t* map;
+        size_t size;
+        uint64_t generation;
+        // Where the next record goes
+        size_t offset;
+        // Start of the part of the mapping written since the last sync
+        size_t dirty;
+        // PDUs in the segment without a commit
+        size_t uncommitted;
+    };
+
+    std::string path;
+    size_t segmentSize;
+    // Segments in use by generation, the last one is appended to
+    std::map<uint64_t, Segment> segments;
+    // Recycled segments, ready to append to
+    std::vector<Segment> freeSegments;
+    // Files opened, the next new one is path.fileCount
+    size_t fileCount;
+    // Generation of the segment of each uncommitted PDU, by record id
+    std::unordered_map<uint64_t, uint64_t> uncommitted;
+    uint64_t nextId;
+    uint64_t nextGeneration;
+    // Records between syncs, 0 for none
+    unsigned int syncInterval;
+    unsigned int unsynced;
+
+    /**
+     * Maps a segment file, creating it if it doesn't exist.
+     * @return The segment, with generation 0 if the file is new or was recycled.
+     * @throw SmppException if the file can't be opened or mapped.
+     */
+    Segment openSegment(const std::string &segmentPath, const bool create);
+
+    /**
+     * Reads the records of a segment from the start, to find its end and the uncommitted PDUs.
+     */
+    void scanSegment(Segment* segment);
+
+    /**
+     * Starts a new segment to append to, recycled if one is free.
+     */
+    void startSegment();
+
+    /**
+     * Frees the oldest segments while they hold no uncommitted PDU, except the one appended to.
+     */
+    void recycleSegments();
+
+    /**
+     * Appends a record to the last segment, starting a new one if it doesn't fit.
+     */
+    void appendRecord(const uint32_t type, const uint64_t id, const uint8_t* data, const uint32_t size);
+
+    void syncSegment(Segment* segment);
+
+    void closeSegment(const Segment &segment);
+
+  public:
+    /**
+     * Opens a journal, and reads what a previous process left in it.
+     * @param path Path of the segment files, without the .n suffix. The directory must exist.
+     * @param segmentSize Size of each segment file. The largest PDU must fit in one.
+     * @throw SmppException if the files can't be opened or mapped.
+     */
+    explicit Spool(const std::string &path, const size_t segmentSize = 4 << 20);
+
+    ~Spool();
+
+    Spool(const Spool &) = delete;
+    Spool &operator=(const Spool &) = delete;
+
+    /**
+     * Appends a PDU.
+     * @param data Encoded PDU.
+     * @param size Octets of the PDU.
+     * @return Id of the record, to commit it with.
+     * @throw SmppException if the PDU is larger than a segment, or a new segment can't be opened.
+     */
+    uint64_t append(const uint8_t* data, const uint32_t size);
+
+    /**
+     * Marks a PDU done, so it isn't replayed. Ids not in the journal are ignored.
+     * @param id Id append() returned, or replay() gave.
+     */
+    void commit(const uint64_t id);
+
+    /**
+     * Calls a visitor with each uncommitted PDU, in the order they were appended. The data points into the
+     * mapping, and is valid until the PDU is committed.
+     * @param visitor Called with the id, data and size of each PDU.
+     */
+    void replay(const boost::function<void(uint64_t, const uint8_t*, uint32_t)> &visitor) const;
+
+    /**
+     * Flushes the records appended since the last sync to the files with msync.
+     * @throw SmppException if msync fails.
+     */
+    void sync();
+
+    /**
+     * Sets how often the records are flushed to the files, in a batch with msync.
+     * @param records Number of records, appends and commits, between flushes. 0 leaves it to the kernel, which
+     * is the default.
+     */
+    void setSyncInterval(const unsigned int records) {
+        syncInterval = records;
+    }
+
+    /**
+     * @return Number of PDUs without a commit.
+     */
+    size_t getUncommittedCount() const {
+        return uncommitted.size();
+    }
+
+    /**
+     * @return Number of segment files in use, not counting the recycled ones.
+     */
+    size_t getSegmentCount() const {
+        return segments.size();
+    }
+
+    /**
+     * @return Number of segment files, in use or recycled.
+     */
+    size_t getFileCount() const {
+        return fileCount;
+    }
+};
+
+}  // namespace smpp
+
+#endif  // SMPP_SPOOL_H_
@@ -5,78 +5,171 @@
  */
 
 #include "smpp/timeformat.h"
+#include <cstdlib>
 #include <string>
+#include <vector>
 
-using std::setfill;
-using std::setw;
 using std::string;
 using std::stoi;
 using std::stringstream;
+using std::vector;
 
 using boost::local_time::local_date_time;
 using boost::local_time::posix_time_zone;
 using boost::local_time::time_zone_ptr;
-using boost::posix_time::from_iso_string;
 using boost::posix_time::ptime;
 using boost::posix_time::time_duration;
 using boost::posix_time::time_input_facet;
 
-using std::regex;
 using std::smatch;
 
 namespace smpp {
 namespace timeformat {
-time_duration parseRelativeTimestamp(const smatch &match) {
-    int yy = stoi(match[1]);
-    int mon = stoi(match[2]);
-    int dd = stoi(match[3]);
-    int hh = stoi(match[4]);
-    int min = stoi(match[5]);
-    int sec = stoi(match[6]);
-    int totalHours = (yy * 365 * 24) + (mon * 30 * 24) + (dd * 24) + hh;
-    time_duration td(totalHours, min, sec);
+/**
+ * The fields of a smpp timestamp on the form “YYMMDDhhmmsstnnp”.
+ */
+struct TimestampFields {
+    int yy;
+    int mon;
+    int dd;
+    int hh;
+    int min;
+    int sec;
+    int nn;
+    char p;
+};
+
+/**
+ * Parses a fixed width run of decimal digits.
+ * @return The value, or -1 if any of the chars is not a digit.
+ */
+static int parseDigits(const char* s, int width) {
+    int value = 0;
+
+    for (int i = 0; i < width; i++) {
+        if (s[i] < '0' || s[i] > '9') {
+            return -1;
+        }
+
+        value = value * 10 + (s[i] - '0');
+    }
+
+    return value;
+}
+
+/**
+ * Splits a timestamp into its fields, checking that it matches the pattern “YYMMDDhhmmsstnnp”.
+ * @return False if the timestamp has the wrong format.
+ */
+static bool parseFields(const string &time, TimestampFields* fields) {
+    if (time.length() != 16) {
+        return false;
+    }
+
+    const char* s = time.data();
+    fields->yy = parseDigits(s, 2);
+    fields->mon = parseDigits(s + 2, 2);
+    fields->dd = parseDigits(s + 4, 2);
+    fields->hh = parseDigits(s + 6, 2);
+    fields->min = parseDigits(s + 8, 2);
+    fields->sec = parseDigits(s + 10, 2);
+    fields->nn = parseDigits(s + 13, 2);
+    fields->p = s[15];
+    // the tenths of a second are not used, but must be a digit
+    return fields->yy >= 0 && fields->mon >= 0 && fields->dd >= 0 && fields->hh >= 0 && fields->min >= 0
+           && fields->sec >= 0 && parseDigits(s + 12, 1) >= 0 && fields->nn >= 0
+           && (fields->p == 'R' || fields->p == '+' || fields->p == '-');
+}
+
+static TimestampFields getFields(const smatch &match) {
+    TimestampFields fields;
+    fields.yy = stoi(match[1]);
+    fields.mon = stoi(match[2]);
+    fields.dd = stoi(match[3]);
+    fields.hh = stoi(match[4]);
+    fields.min = stoi(match[5]);
+    fields.sec = stoi(match[6]);
+    fields.nn = stoi(match[8]);
+    fields.p = string(match[9])[0];
+    return fields;
+}
+
+static time_duration getRelativeTimestamp(const TimestampFields &fields) {
+    int totalHours = (fields.yy * 365 * 24) + (fields.mon * 30 * 24) + (fields.dd * 24) + fields.hh;
+    time_duration td(totalHours, fields.min, fields.sec);
     return td;
 }
 
-local_date_time parseAbsoluteTimestamp(const smatch &match) {
-    string yy = match[1];
-    string mon = match[2];
-    string dd = match[3];
-    string hh = match[4];
-    string min = match[5];
-    string sec = match[6];
-    ptime ts(from_iso_string(string("20") + yy + mon + dd + "T" + hh + min + sec));
-    int n = stoi(match[8]);
-    int offsetHours = (n >> 2);
-    int offsetMinutes = (n % 4) * 15;
-    // construct timezone
-    stringstream gmt;
-    gmt << "GMT" << match[9] << setw(2) << setfill('0') << offsetHours << ":" << setw(2) << setfill('0')
-        << offsetMinutes;
-    time_zone_ptr zone(new boost::local_time::posix_time_zone(gmt.str()));
-    boost::local_time::local_date_time ldt(ts.date(), ts.time_of_day(), zone, false);
+static local_date_time getAbsoluteTimestamp(const TimestampFields &fields) {
+    boost::gregorian::date d(2000 + fields.yy, fields.mon, fields.dd);
+    time_duration tod(fields.hh, fields.min, fields.sec);
+    boost::local_time::local_date_time ldt(d, tod, getTimeZone(fields.p == '-' ? -fields.nn : fields.nn), false);
     return ldt;
 }
 
+/**
+ * Constructs the zones for all offsets a smpp timestamp can express.
+ */
+static vector<time_zone_ptr> buildTimeZones() {
+    vector<time_zone_ptr> zones;
+    zones.reserve(MAX_ZONE_OFFSET - MIN_ZONE_OFFSET + 1);
+
+    for (int quarterHours = MIN_ZONE_OFFSET; quarterHours <= MAX_ZONE_OFFSET; quarterHours++) {
+        int n = abs(quarterHours);
+        int offsetHours = (n >> 2);
+        int offsetMinutes = (n % 4) * 15;
+        char gmt[] = { 'G', 'M', 'T', quarterHours < 0 ? '-' : '+', static_cast<char>('0' + offsetHours / 10),
+                       static_cast<char>('0' + offsetHours % 10), ':', static_cast<char>('0' + offsetMinutes / 10),
+                       static_cast<char>('0' + offsetMinutes % 10), '\0'
+                     };
+        zones.push_back(time_zone_ptr(new posix_time_zone(gmt)));
+    }
+
+    return zones;
+}
+
+const time_zone_ptr &getTimeZone(const int quarterHours) {
+    static const vector<time_zone_ptr> zones = buildTimeZones();
+
+    if (quarterHours < MIN_ZONE_OFFSET || quarterHours > MAX_ZONE_OFFSET) {
+        throw SmppException("Time zone offset out of range");
+    }
+
+    return zones[quarterHours - MIN_ZONE_OFFSET];
+}
+
+time_duration parseRelativeTimestamp(const smatch &match) {
+    return getRelativeTimestamp(getFields(match));
+}
+
+local_date_time parseAbsoluteTimestamp(const smatch &match) {
+    return getAbsoluteTimestamp(getFields(match));
+}
+
 DatePair parseSmppTimestamp(const string &time) {
-    // Matches the pattern “YYMMDDhhmmsstnnp”
-    static const regex pattern("^(\\d{2})(\\d{2})(\\d{2})(\\d{2})(\\d{2})(\\d{2})(\\d{1})(\\d{2})([R+-])$");
-    smatch match;
+    return parseSmppTimestamp(time, getSystemClock());
+}
+
+DatePair parseSmppTimestamp(const string &time, const Clock &clock) {
+    TimestampFields fields;
+
+    if (parseFields(time, &fields)) {
+        // timestamps have a resolution of one second
+        ptime now = clock.universalTime();
+        now -= time_duration(0, 0, 0, now.time_of_day().fractional_seconds());
 
-    if (regex_match(time.begin(), time.end(), match, pattern)) {
         // relative
-        if (match[match.size() - 1] == "R") {
+        if (fields.p == 'R') {
             // parse the relative timestamp
-            time_duration td = parseRelativeTimestamp(match);
+            time_duration td = getRelativeTimestamp(fields);
             // construct a absolute timestamp based on the relative timestamp
-            time_zone_ptr zone(new posix_time_zone("GMT"));
-            local_date_time ldt = boost::local_time::local_sec_clock::local_time(zone);
+            local_date_time ldt(now, getTimeZone(0));
             ldt += td;
             return DatePair(ldt, td);
         } else {
             // parse the absolute timestamp
-            boost::local_time::local_date_time ldt = parseAbsoluteTimestamp(match);
-            boost::local_time::local_date_time lt = boost::local_time::local_sec_clock::local_time(ldt.zone());
+            boost::local_time::local_date_time ldt = getAbsoluteTimestamp(fields);
+            boost::local_time::local_date_time lt(now, ldt.zone());
             // construct a relative timestamp based on the local clock and the absolute timestamp
             boost::local_time::local_time_period ltp(ldt, lt);
             time_duration td = ltp.length();
@@ -97,26 +190,61 @@ ptime parseDlrTimestamp(const string &time) {
     return timestamp;
 }
 
-string getTimeString(const local_date_time &ldt) {
+/**
+ * Two digit decimal representations of 0 to 99, so each field is written by a single copy.
+ */
+static const char DIGIT_PAIRS[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/**
+ * Writes a value from 0 to 99 as two digits.
+ */
+static inline char* writeDigits(const int value, char* out) {
+    const char* pair = DIGIT_PAIRS + value * 2;
+    out[0] = pair[0];
+    out[1] = pair[1];
+    return out + 2;
+}
+
+char* formatTimeString(const local_date_time &ldt, char* out) {
     time_zone_ptr zone = ldt.zone();
     ptime t = ldt.local_time();
     time_duration td = t.time_of_day();
-    stringstream output;
     time_duration offset = zone->base_utc_offset();
 
     if (ldt.is_dst()) {
         offset += zone->dst_offset();
     }
 
-    string p = offset.is_negative() ? "-" : "+";
     int nn = abs((offset.hours() * 4) + (offset.minutes() / 15));
-    string d = to_iso_string(t.date());
-    output << d.substr(2, 6) << setw(2) << setfill('0') << td.hours() << setw(2) << td.minutes() << setw(2)
-           << td.seconds() << "0" << setw(2) << nn << p;
-    return output.str();
+    boost::gregorian::date::ymd_type ymd = t.date().year_month_day();
+    out = writeDigits(ymd.year % 100, out);
+    out = writeDigits(ymd.month, out);
+    out = writeDigits(ymd.day, out);
+    out = writeDigits(td.hours(), out);
+    out = writeDigits(td.minutes(), out);
+    out = writeDigits(td.seconds(), out);
+    *out++ = '0';
+    out = writeDigits(nn, out);
+    *out++ = offset.is_negative() ? '-' : '+';
+    return out;
 }
 
-string getTimeString(const time_duration &td) {
+char* formatTimeString(const time_duration &td, char* out) {
+    // the fields would be negative too
+    if (td.is_negative()) {
+        throw SmppException("Time duration is negative");
+    }
+
     int totalHours = td.hours();
     int yy = totalHours / 24 / 365;
     totalHours -= (yy * 24 * 365);
@@ -129,10 +257,50 @@ string getTimeString(const time_duration &td) {
         throw SmppException("Time duration overflows");
     }
 
-    stringstream output;
-    output << setfill('0') << setw(2) << yy << setw(2) << mon << setw(2) << dd << setw(2) << totalHours << setw(2)
-           << td.minutes() << setw(2) << td.seconds() << "000R";
-    return output.str();
+    out = writeDigits(yy, out);
+    out = writeDigits(mon, out);
+    out = writeDigits(dd, out);
+    out = writeDigits(totalHours, out);
+    out = writeDigits(td.minutes(), out);
+    out = writeDigits(td.seconds(), out);
+    *out++ = '0';
+    *out++ = '0';
+    *out++ = '0';
+    *out++ = 'R';
+    return out;
+}
+
+void getTimeString(const local_date_time &ldt, TimeString &out) {
+    *formatTimeString(ldt, out) = '\0';
+}
+
+void getTimeString(const time_duration &td, TimeString &out) {
+    *formatTimeString(td, out) = '\0';
+}
+
+string getTimeString(const local_date_time &ldt) {
+    TimeString output;
+    return string(output, formatTimeString(ldt, output));
+}
+
+string getTimeString(const time_duration &td) {
+    TimeString output;
+    return string(output, formatTimeString(td, output));
+}
+
+const char* getCachedTimeString(const time_duration &td) {
+    // the timestamp has a resolution of one second, so durations within the same second share a string
+    static thread_local int64_t cachedSeconds = -1;
+    static thread_local TimeString cached;
+    int64_t seconds = td.total_seconds();
+
+    if (seconds != cachedSeconds) {
+        cachedSeconds = -1;  // stays invalid if formatting throws
+        getTimeString(td, cached);
+        cachedSeconds = seconds;
+    }
+
+    return cached;
 }
 }  // namespace timeformat
 }  // namespace smpp
@@ -16,6 +16,7 @@
 #include <regex>
 #include <string>
 
+#include "smpp/clock.h"
 #include "smpp/exceptions.h"
 
 namespace smpp {
@@ -23,6 +24,26 @@ namespace timeformat {
 
 typedef std::pair<boost::local_time::local_date_time, boost::posix_time::time_duration> DatePair;
 
+// Length of a smpp timestamp on the form “YYMMDDhhmmsstnnp”, without the null terminator
+const size_t TIME_STRING_LENGTH = 16;
+
+// A null terminated smpp timestamp
+typedef char TimeString[TIME_STRING_LENGTH + 1];
+
+// Range of UTC offsets, in quarter hours, a time zone can have (-12:00 to +14:00)
+const int MIN_ZONE_OFFSET = -48;
+const int MAX_ZONE_OFFSET = 56;
+
+/**
+ * Returns the time zone for an UTC offset given in quarter hours, as used by smpp timestamps.
+ * The zones are created once and shared by the whole process, so timestamps parsed or built with them
+ * don't allocate a zone each.
+ * @param quarterHours Offset from UTC in quarter hours, zero for GMT.
+ * @return Time zone named GMT+hh:mm or GMT-hh:mm.
+ * @throw SmppException if the offset is outside MIN_ZONE_OFFSET to MAX_ZONE_OFFSET.
+ */
+const boost::local_time::time_zone_ptr &getTimeZone(const int quarterHours);
+
 /**
  * Parses a relative timestamp and returns it as a time_duration.
  * @param match Relative timestamp on the form of a std::smatch
@@ -47,6 +68,16 @@ boost::local_time::local_date_time parseAbsoluteTimestamp(const std::smatch &mat
  */
 DatePair parseSmppTimestamp(const std::string &time);
 
+/**
+ * Parses a smpp timestamp, resolving it against the given clock instead of the system clock.
+ * A CoarseClock kept up to date by an I/O loop makes this free of clock calls.
+ * @param time
+ * @param clock Clock to take the current time from.
+ * @return
+ * @throw SmppException.
+ */
+DatePair parseSmppTimestamp(const std::string &time, const Clock &clock);
+
 /**
  * Parses a delivery receipt timestamp and returns it as ptime.
  * @param time Timestamp to parse.
@@ -55,7 +86,8 @@ DatePair parseSmppTimestamp(const std::string &time);
 boost::posix_time::ptime parseDlrTimestamp(const std::string &time);
 
 /**
- * Returns the local_date_time as a string formatted as an absolute timestamp
+ * Returns the local_date_time as a string formatted as an absolute timestamp.
+ * Use getTimeZone for the zone of ldt to avoid constructing one per timestamp.
  * @param ldt
  * @return
  */
@@ -68,6 +100,51 @@ std::string getTimeString(const boost::local_time::local_date_time &ldt);
  */
 std::string getTimeString(const boost::posix_time::time_duration &td);
 
+/**
+ * Formats the local_date_time as an absolute timestamp into a null terminated TimeString.
+ * @param ldt
+ * @param out Buffer to write to.
+ */
+void getTimeString(const boost::local_time::local_date_time &ldt, TimeString &out);
+
+/**
+ * Formats the time_duration as a relative timestamp into a null terminated TimeString.
+ * @param td time_duration to be calculated.
+ * @param out Buffer to write to.
+ * @throw SmppException if the duration is negative, or 100 years or more.
+ */
+void getTimeString(const boost::posix_time::time_duration &td, TimeString &out);
+
+/**
+ * Writes the local_date_time as an absolute timestamp into a caller provided buffer, ie. the octets of a PDU
+ * under construction. Exactly TIME_STRING_LENGTH chars are written, no null terminator.
+ * @param ldt
+ * @param out Buffer of at least TIME_STRING_LENGTH chars.
+ * @return Pointer past the last char written.
+ */
+char* formatTimeString(const boost::local_time::local_date_time &ldt, char* out);
+
+/**
+ * Writes the time_duration as a relative timestamp into a caller provided buffer.
+ * Exactly TIME_STRING_LENGTH chars are written, no null terminator.
+ * @param td time_duration to be calculated.
+ * @param out Buffer of at least TIME_STRING_LENGTH chars.
+ * @return Pointer past the last char written.
+ * @throw SmppException if the duration is negative, or 100 years or more.
+ */
+char* formatTimeString(const boost::posix_time::time_duration &td, char* out);
+
+/**
+ * Returns the relative timestamp for the time_duration from a per thread cache holding the last duration
+ * formatted, at the one second resolution of the timestamp. Every submit of a campaign usually carries the same
+ * validity period, so only the first one is formatted.
+ * The string is valid until the next call from the same thread.
+ * @param td time_duration to be calculated.
+ * @return Null terminated relative timestamp.
+ * @throw SmppException if the duration is negative, or 100 years or more.
+ */
+const char* getCachedTimeString(const boost::posix_time::time_duration &td);
+
 }  // namespace timeformat
 }  // namespace smpp
 
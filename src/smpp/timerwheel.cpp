@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#include "smpp/timerwheel.h"
+#include <vector>
+#include "smpp/exceptions.h"
+
+using std::vector;
+
+namespace smpp {
+
+TimerWheel::TimerWheel(const size_t slotCount) :
+    slots(),
+    tick(0),
+    count(0) {
+    if (slotCount == 0) {
+        throw SmppException("Timer wheel needs at least 1 slot");
+    }
+
+    slots.resize(slotCount);
+}
+
+TimerWheel::Handle TimerWheel::schedule(const uint32_t key, const uint64_t ticks) {
+    uint64_t expiry = tick + (ticks == 0 ? 1 : ticks);
+    Slot &slot = slots[expiry % slots.size()];
+    count++;
+    return slot.insert(slot.end(), std::make_pair(key, expiry));
+}
+
+void TimerWheel::cancel(const Handle &handle) {
+    slots[handle->second % slots.size()].erase(handle);
+    count--;
+}
+
+void TimerWheel::advance(const uint64_t target, vector<uint32_t>* expired) {
+    if (target <= tick) {
+        return;
+    }
+
+    // after one turn every slot has been visited, later ticks would visit them again for nothing
+    uint64_t last = target - tick > slots.size() ? tick + slots.size() : target;
+
+    for (uint64_t t = tick + 1; t <= last && count > 0; t++) {
+        Slot &slot = slots[t % slots.size()];
+        Slot::iterator it = slot.begin();
+
+        while (it != slot.end()) {
+            if (it->second <= target) {
+                expired->push_back(it->first);
+                it = slot.erase(it);
+                count--;
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    tick = target;
+}
+
+void TimerWheel::clear() {
+    for (size_t i = 0; i < slots.size(); i++) {
+        slots[i].clear();
+    }
+
+    count = 0;
+}
+}  // namespace smpp
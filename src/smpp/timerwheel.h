@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#ifndef SMPP_TIMERWHEEL_H_
+#define SMPP_TIMERWHEEL_H_
+
+#include <stdint.h>
+
+#include <cstddef>
+#include <list>
+#include <utility>
+#include <vector>
+
+namespace smpp {
+
+/**
+ * Hashed timing wheel, expiring keys after a number of ticks.
+ *
+ * A key is scheduled into the slot of the tick it expires at, modulo the number of slots, so scheduling and
+ * cancelling cost the same however many keys are scheduled. Keys further away than one turn of the wheel share a
+ * slot with nearer ones and are passed over until their tick comes.
+ *
+ * The wheel doesn't keep time, its owner advances it, ie. from one timer firing at the resolution of the wheel.
+ */
+class TimerWheel {
+  private:
+    // Key and the tick it expires at
+    typedef std::list<std::pair<uint32_t, uint64_t> > Slot;
+
+    std::vector<Slot> slots;
+    uint64_t tick;
+    size_t count;
+
+  public:
+    /**
+     * Refers to a scheduled key, to cancel it.
+     */
+    typedef Slot::iterator Handle;
+
+    /**
+     * Constructs an empty wheel at tick 0.
+     * @param slotCount Number of slots, at least 1.
+     */
+    explicit TimerWheel(const size_t slotCount = 512);
+
+    /**
+     * Schedules a key.
+     * @param key Key to hand back when it expires.
+     * @param ticks Number of ticks from the current one, at least 1.
+     * @return Handle to cancel it with.
+     */
+    Handle schedule(const uint32_t key, const uint64_t ticks);
+
+    /**
+     * Removes a scheduled key that has not expired.
+     * @param handle Handle schedule returned.
+     */
+    void cancel(const Handle &handle);
+
+    /**
+     * Advances the wheel to a tick, removing the keys that expire by then.
+     * @param target Tick to advance to, ignored unless it is after the current one.
+     * @param expired Vector the expired keys are appended to.
+     */
+    void advance(const uint64_t target, std::vector<uint32_t>* expired);
+
+    /**
+     * Removes all keys.
+     */
+    void clear();
+
+    uint64_t getTick() const {
+        return tick;
+    }
+
+    /**
+     * @return Number of scheduled keys.
+     */
+    size_t size() const {
+        return count;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+};
+
+}  // namespace smpp
+
+#endif  // SMPP_TIMERWHEEL_H_
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2014 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ */
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <future>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include "gtest/gtest.h"
+#include "smpp/smppclient.h"
+#include "smscsimulator.h"
+
+using boost::system::error_code;
+using smpp::QuerySmResult;
+using smpp::SendSmsResult;
+using std::set;
+using std::string;
+
+class AsyncTest: public SimulatorClientTest {
+public:
+    virtual void SetUp() {
+        SimulatorClientTest::SetUp();
+        client->bindTransmitter("username", "password");
+    }
+
+    void runUntil(const bool &done) {
+        while (!done) {
+            ios.run_one();
+        }
+    }
+};
+
+// The handler is called from the io_service with the SMSC id
+TEST_F(AsyncTest, callback) {
+    bool done = false;
+    error_code error;
+    SendSmsResult result;
+    client->asyncSendSms(from, to, "message to send", [&](const error_code &e, const SendSmsResult &r) {
+        done = true;
+        error = e;
+        result = r;
+    });
+
+    ASSERT_FALSE(done);
+    runUntil(done);
+    ASSERT_FALSE(error);
+    ASSERT_EQ(result.second, 1);
+    ASSERT_EQ(result.first.substr(0, 3), "msg");
+}
+
+// One thread keeps many messages in flight, the window holds back the rest
+TEST_F(AsyncTest, manyInFlight) {
+    smsc.setReverseBatch(10);
+    client->setWindowSize(10);
+    set<string> ids;
+    int completed = 0;
+
+    for (int i = 0; i < 100; i++) {
+        client->asyncSendSms(from, to, "message to send", [&](const error_code &e, const SendSmsResult &r) {
+            completed++;
+            ASSERT_FALSE(e);
+            ids.insert(r.first);
+        });
+    }
+
+    while (completed < 100) {
+        ios.run_one();
+    }
+
+    ASSERT_EQ(ids.size(), 100u);
+    ASSERT_EQ(smsc.getMaxPending(), 10);
+}
+
+// A future completes once another thread runs the io_service
+TEST_F(AsyncTest, future) {
+    std::future<SendSmsResult> result = client->asyncSendSms(from, to, "message to send", boost::asio::use_future);
+    std::thread runner([this]() {
+        ios.run();
+    });
+
+    ASSERT_EQ(result.get().second, 1);
+    ios.stop();
+    runner.join();
+}
+
+TEST_F(AsyncTest, querySm) {
+    bool done = false;
+    boost::optional<QuerySmResult> result;
+    client->asyncQuerySm("msg1", from, [&](const error_code &e, const QuerySmResult &r) {
+        done = true;
+        ASSERT_FALSE(e);
+        result.emplace(r);
+    });
+
+    runUntil(done);
+    ASSERT_EQ(result->get<0>(), "msg1");
+    ASSERT_EQ(result->get<2>(), smpp::STATE_DELIVERED);
+}
+
+// A final_date that isn't a timestamp fails the query instead of throwing from the io_service
+TEST_F(AsyncTest, querySmMalformed) {
+    bool done = false;
+    error_code error;
+    client->asyncQuerySm("malformed", from, [&](const error_code &e, const QuerySmResult &) {
+        done = true;
+        error = e;
+    });
+
+    runUntil(done);
+    ASSERT_EQ(error, boost::system::errc::protocol_error);
+    ASSERT_EQ(client->querySm("msg1", from).get<0>(), "msg1");
+}
+
+// A command_length shorter than a header drops the connection, the stream can't be trusted after it
+TEST_F(AsyncTest, corruptLength) {
+    bool done = false;
+    error_code error;
+    client->asyncQuerySm("corrupt", from, [&](const error_code &e, const QuerySmResult &) {
+        done = true;
+        error = e;
+    });
+
+    runUntil(done);
+    ASSERT_EQ(error, boost::system::errc::protocol_error);
+    ASSERT_FALSE(client->isBound());
+    ASSERT_FALSE(socket->is_open());
+}
+
+// The client can be bound again after the socket is closed and reconnected
+TEST_F(AsyncTest, reconnect) {
+    client->unbind();
+    socket->close();
+    socket->connect(smsc.getEndpoint());
+    client->bindTransmitter("username", "password");
+    ASSERT_EQ(client->sendSms(from, to, "message to send").second, 1);
+}
+
+// Command statuses map to error codes in the ESME category
+TEST(EsmeCategoryTest, makeEsmeError) {
+    error_code error = smpp::makeEsmeError(smpp::ESME_RTHROTTLED);
+    ASSERT_EQ(error.category(), smpp::getEsmeCategory());
+    ASSERT_EQ(error.value(), static_cast<int>(smpp::ESME_RTHROTTLED));
+    ASSERT_EQ(error.message(), smpp::getEsmeStatus(smpp::ESME_RTHROTTLED));
+}
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2014 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ */
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "smpp/smppsession.h"
+#include "smscsimulator.h"
+
+using boost::asio::awaitable;
+using boost::asio::co_spawn;
+using boost::asio::detached;
+using smpp::SendSmsResult;
+using smpp::SmppAddress;
+using smpp::SmppClient;
+using smpp::SmppSession;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+class CoroutineTest: public SimulatorTest {
+public:
+    shared_ptr<SmppSession> connect() {
+        return shared_ptr<SmppSession>(new SmppSession(shared_ptr<SmppClient>(new SmppClient(connectSocket()))));
+    }
+};
+
+static awaitable<void> submitMessages(shared_ptr<SmppSession> session, SmppAddress from, SmppAddress to,
+                                      int* submitted, int* done) {
+    string systemId = co_await session->bindTransmitter("username", "password");
+    EXPECT_EQ(systemId, "simulator");
+
+    for (int i = 0; i < 10; i++) {
+        SendSmsResult result = co_await session->submit(from, to, "message to send");
+        EXPECT_EQ(result.second, 1);
+        (*submitted)++;
+    }
+
+    co_await session->unbind();
+    (*done)++;
+}
+
+// Many sessions run as coroutines on one thread
+TEST_F(CoroutineTest, manySessions) {
+    vector<shared_ptr<SmppSession> > sessions;
+    int submitted = 0;
+    int done = 0;
+
+    for (int i = 0; i < 20; i++) {
+        sessions.push_back(connect());
+        co_spawn(ios, submitMessages(sessions.back(), from, to, &submitted, &done), detached);
+    }
+
+    runUntil(done, 20);
+    ASSERT_EQ(submitted, 200);
+    ASSERT_EQ(smsc.getSubmitCount(), 200);
+}
+
+static awaitable<void> receiveMessages(shared_ptr<SmppSession> session, vector<string>* messages, int* done) {
+    co_await session->bindReceiver("username", "password");
+
+    for (int i = 0; i < 3; i++) {
+        smpp::SMS sms = co_await session->nextDeliver();
+        messages->push_back(sms.short_message);
+    }
+
+    co_await session->unbind();
+    (*done)++;
+}
+
+TEST_F(CoroutineTest, nextDeliver) {
+    smsc.setDeliveriesOnBind(3);
+    shared_ptr<SmppSession> session = connect();
+    vector<string> messages;
+    int done = 0;
+    co_spawn(ios, receiveMessages(session, &messages, &done), detached);
+    runUntil(done, 1);
+    ASSERT_EQ(messages.size(), 3u);
+    ASSERT_EQ(messages[0], "delivery 1");
+    ASSERT_EQ(messages[2], "delivery 3");
+}
+
+static awaitable<void> bindTwice(shared_ptr<SmppSession> session, bool* thrown, int* done) {
+    co_await session->bindTransmitter("username", "password");
+
+    try {
+        co_await session->bindTransmitter("username", "password");
+    } catch (smpp::SmppException &e) {
+        *thrown = true;
+    }
+
+    co_await session->unbind();
+    (*done)++;
+}
+
+// Errors are thrown as the exceptions of the synchronous calls
+TEST_F(CoroutineTest, exceptions) {
+    shared_ptr<SmppSession> session = connect();
+    bool thrown = false;
+    int done = 0;
+    co_spawn(ios, bindTwice(session, &thrown, &done), detached);
+    runUntil(done, 1);
+    ASSERT_TRUE(thrown);
+}
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -17,6 +17,110 @@ TEST(GsmEncoder, encodeDecode) {
     ASSERT_EQ(i1, o3);
 }
 
+TEST(GsmEncoder, nationalLanguage) {
+    oc::tools::GsmShiftTables turkish(oc::tools::GSM_LANGUAGE_TURKISH, oc::tools::GSM_LANGUAGE_TURKISH);
+    std::string i1("Günaydın, İstanbul'da şu an hava güneşli. Çok güzel! {€}");
+    std::string o1 = oc::tools::GsmEncoder::getGsm0338(i1, turkish);
+    ASSERT_EQ(std::string::npos, o1.find('?'));
+    ASSERT_EQ(i1, oc::tools::GsmEncoder::getUtf8(o1, turkish));
+    // ş is in the locking shift table, but must be escaped when only the single shift table is used
+    ASSERT_EQ(std::string("\x1D"), oc::tools::GsmEncoder::getGsm0338("ş", turkish));
+    ASSERT_EQ(std::string("\x1B\x73"), oc::tools::GsmEncoder::getGsm0338("ş",
+              oc::tools::GsmShiftTables(oc::tools::GSM_LANGUAGE_DEFAULT, oc::tools::GSM_LANGUAGE_TURKISH)));
+
+    oc::tools::GsmShiftTables portuguese(oc::tools::GSM_LANGUAGE_PORTUGUESE, oc::tools::GSM_LANGUAGE_PORTUGUESE);
+    std::string i2("Informações: você já está na região de São João. Ótimo!");
+    std::string o2 = oc::tools::GsmEncoder::getGsm0338(i2, portuguese);
+    ASSERT_EQ(std::string::npos, o2.find('?'));
+    ASSERT_EQ(i2, oc::tools::GsmEncoder::getUtf8(o2, portuguese));
+
+    ASSERT_EQ(std::string("\x25\x01\x01\x24\x01\x01"), turkish.getUdhElements());
+    oc::tools::GsmShiftTables spanish(oc::tools::GSM_LANGUAGE_DEFAULT, oc::tools::GSM_LANGUAGE_SPANISH);
+    ASSERT_EQ(std::string("\x24\x01\x02"), spanish.getUdhElements());
+    ASSERT_TRUE(oc::tools::GsmShiftTables().getUdhElements().empty());
+    EXPECT_THROW(oc::tools::GsmEncoder::getGsm0338(i1, oc::tools::GsmShiftTables(oc::tools::GSM_LANGUAGE_SPANISH)),
+                 std::invalid_argument);
+}
+
+TEST(GsmEncoder, findShiftTables) {
+    oc::tools::GsmShiftTables tables;
+    ASSERT_TRUE(oc::tools::GsmEncoder::findShiftTables("Plain message {with} extension chars", &tables));
+    ASSERT_TRUE(tables.isDefault());
+
+    ASSERT_TRUE(oc::tools::GsmEncoder::findShiftTables("Canción en la habitación", &tables));
+    ASSERT_EQ(oc::tools::GSM_LANGUAGE_DEFAULT, tables.lockingShift);
+    ASSERT_EQ(oc::tools::GSM_LANGUAGE_SPANISH, tables.singleShift);
+
+    // A short text fits in one part with the single shift table alone
+    ASSERT_TRUE(oc::tools::GsmEncoder::findShiftTables("Günaydın, İstanbul'da şu an hava güneşli.", &tables));
+    ASSERT_EQ(oc::tools::GSM_LANGUAGE_DEFAULT, tables.lockingShift);
+    ASSERT_EQ(oc::tools::GSM_LANGUAGE_TURKISH, tables.singleShift);
+
+    // Escaping every ş would need two parts, the locking shift table fits it into one
+    std::string turkish;
+    for (int i = 0; i < 13; i++) {
+        turkish += "şşşşş ışık ";
+    }
+    ASSERT_TRUE(oc::tools::GsmEncoder::findShiftTables(turkish.substr(0, turkish.size() - 1), &tables));
+    ASSERT_EQ(oc::tools::GSM_LANGUAGE_TURKISH, tables.lockingShift);
+    ASSERT_EQ(oc::tools::GSM_LANGUAGE_TURKISH, tables.singleShift);
+
+    // No table has Cyrillic, so it must go as UCS-2
+    ASSERT_FALSE(oc::tools::GsmEncoder::findShiftTables("Привет", &tables));
+}
+
+TEST(GsmEncoder, transliterate) {
+    oc::tools::GsmShiftTables defaultTables;
+    std::string i1("\u201cSmart\u201d quotes \u2013 and\u00a0more\u2026 \u0141\u00f3d\u017a \u2122");
+    int substitutions = -1;
+    std::string o1 = oc::tools::GsmEncoder::getGsm0338(i1, defaultTables, true, &substitutions);
+    ASSERT_EQ(std::string("\"Smart\" quotes - and more... Lodz TM"), oc::tools::GsmEncoder::getUtf8(o1));
+    ASSERT_EQ(9, substitutions);
+
+    // Without transliteration the same characters are lost
+    std::string o2 = oc::tools::GsmEncoder::getGsm0338(i1, defaultTables, false, &substitutions);
+    ASSERT_EQ(std::string("?Smart? quotes ? and?more? ??d? ?"), o2);
+    ASSERT_EQ(0, substitutions);
+
+    // Characters in the national language tables are kept
+    oc::tools::GsmShiftTables turkish(oc::tools::GSM_LANGUAGE_TURKISH, oc::tools::GSM_LANGUAGE_TURKISH);
+    std::string o3 = oc::tools::GsmEncoder::getGsm0338("\u2018ş\u2019", turkish, true, &substitutions);
+    ASSERT_EQ(std::string("'ş'"), oc::tools::GsmEncoder::getUtf8(o3, turkish));
+    ASSERT_EQ(2, substitutions);
+
+    // Transliteration lets text with smart quotes stay in the GSM alphabet
+    oc::tools::GsmShiftTables tables;
+    ASSERT_FALSE(oc::tools::GsmEncoder::findShiftTables("\u201cQuoted\u201d", &tables));
+    ASSERT_TRUE(oc::tools::GsmEncoder::findShiftTables("\u201cQuoted\u201d", &tables, true));
+    ASSERT_TRUE(tables.isDefault());
+    ASSERT_TRUE(oc::tools::GsmEncoder::findShiftTables("\u201cGünaydın\u201d", &tables, true));
+    ASSERT_EQ(oc::tools::GSM_LANGUAGE_TURKISH, tables.singleShift);
+}
+
+TEST(GsmEncoder, encodeIntoBuffer) {
+    oc::tools::GsmShiftTables defaultTables;
+    std::string input("Price: 10\u20ac {incl. VAT}");
+    uint8_t buffer[160];
+    size_t consumed = 0;
+    size_t written = oc::tools::GsmEncoder::encodeGsm0338(input, defaultTables, buffer, sizeof(buffer), &consumed);
+    ASSERT_EQ(input.length(), consumed);
+    ASSERT_EQ(oc::tools::GsmEncoder::getGsm0338(input), std::string(reinterpret_cast<char*>(buffer), written));
+
+    // Encoding stops before an escape sequence that doesn't fit, and can be resumed from there
+    written = oc::tools::GsmEncoder::encodeGsm0338(input, defaultTables, buffer, 10, &consumed);
+    ASSERT_EQ(size_t(9), written);
+    ASSERT_EQ(size_t(9), consumed);
+    written += oc::tools::GsmEncoder::encodeGsm0338(input.substr(consumed), defaultTables, buffer + written,
+               sizeof(buffer) - written, &consumed);
+    ASSERT_EQ(oc::tools::GsmEncoder::getGsm0338(input), std::string(reinterpret_cast<char*>(buffer), written));
+
+    int substitutions = 0;
+    written = oc::tools::GsmEncoder::encodeGsm0338("\u201cA\u201d", defaultTables, buffer, sizeof(buffer), NULL,
+              true, &substitutions);
+    ASSERT_EQ(std::string("\"A\""), std::string(reinterpret_cast<char*>(buffer), written));
+    ASSERT_EQ(2, substitutions);
+}
+
 int main(int argc, char** argv) {
     google::ParseCommandLineFlags(&argc, &argv, true);
     google::InitGoogleLogging(argv[0]);
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2014 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ */
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include "gtest/gtest.h"
+#include "smpp/smppclient.h"
+#include "smscsimulator.h"
+
+using smpp::SmppAddress;
+using boost::system::error_code;
+
+class KeepaliveTest: public SimulatorClientTest {
+public:
+    /**
+     * Runs the io_service for a while.
+     */
+    void runFor(const int milliseconds) {
+        std::chrono::steady_clock::time_point end =
+            std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+
+        while (std::chrono::steady_clock::now() < end) {
+            ios.poll();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+};
+
+static void storeError(error_code* lost, int* calls, const error_code &error) {
+    *lost = error;
+    (*calls)++;
+}
+
+// An idle bind is kept alive with enquire links, which stop after the unbind
+TEST_F(KeepaliveTest, idle) {
+    client->setEnquireLinkInterval(50);
+    client->bindTransmitter("username", "password");
+    runFor(400);
+    ASSERT_GE(smsc.getEnquireLinkCount(), 2);
+    ASSERT_TRUE(client->isBound());
+
+    client->unbind();
+    int count = smsc.getEnquireLinkCount();
+    runFor(200);
+    ASSERT_EQ(smsc.getEnquireLinkCount(), count);
+}
+
+// Responses to submits show the link is alive, so no enquire link is needed
+TEST_F(KeepaliveTest, busy) {
+    client->setEnquireLinkInterval(50);
+    client->bindTransmitter("username", "password");
+    SmppAddress from("CPPSMPP", smpp::TON_ALPHANUMERIC, smpp::NPI_UNKNOWN);
+    SmppAddress to("4513371337", smpp::TON_INTERNATIONAL, smpp::NPI_E164);
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + std::chrono::milliseconds(300);
+
+    while (std::chrono::steady_clock::now() < end) {
+        client->sendSms(from, to, "message to send");
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+
+    ASSERT_EQ(smsc.getEnquireLinkCount(), 0);
+}
+
+// Unanswered enquire links end the session
+TEST_F(KeepaliveTest, dead) {
+    smsc.setEnquireLinkAnswered(false);
+    client->setEnquireLinkInterval(50, 2);
+    error_code lost;
+    int calls = 0;
+    client->onConnectionLost(boost::bind(&storeError, &lost, &calls, _1));
+    client->bindTransmitter("username", "password");
+
+    for (int i = 0; i < 100 && calls == 0; i++) {
+        runFor(10);
+    }
+
+    ASSERT_EQ(calls, 1);
+    ASSERT_EQ(lost, boost::asio::error::timed_out);
+    ASSERT_FALSE(client->isBound());
+    ASSERT_FALSE(socket->is_open());
+    ASSERT_EQ(smsc.getEnquireLinkCount(), 1);
+    EXPECT_THROW(client->setEnquireLinkInterval(50, 0), smpp::SmppException);
+}
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2014 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ */
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "smpp/smppclient.h"
+#include "smscsimulator.h"
+
+using boost::system::error_code;
+using smpp::MultiDestination;
+using smpp::SendMultiResult;
+using smpp::SmppAddress;
+using std::string;
+using std::vector;
+
+class MultiTest: public SimulatorClientTest {
+public:
+    virtual void SetUp() {
+        SimulatorClientTest::SetUp();
+        client->setWindowSize(10);
+        client->bindTransmitter("username", "password");
+    }
+
+    /**
+     * @return n destinations, of which every hundredth is invalid, starting with the first.
+     */
+    static vector<MultiDestination> getDestinations(const int n) {
+        vector<MultiDestination> destinations;
+
+        for (int i = 0; i < n; i++) {
+            std::stringstream number;
+            number << (4512000000LL + i * 100 + (i % 100 == 0 ? 0 : 1));
+            destinations.push_back(SmppAddress(number.str(), smpp::TON_INTERNATIONAL, smpp::NPI_E164));
+        }
+
+        return destinations;
+    }
+};
+
+// Destinations are packed 254 to a PDU, the SMSC lists those it couldn't take
+TEST_F(MultiTest, packed) {
+    vector<MultiDestination> destinations = getDestinations(600);
+    destinations.push_back(MultiDestination("customers"));
+    SendMultiResult result = client->sendMulti(from, destinations, "message to send");
+    ASSERT_FALSE(result.fallback);
+    ASSERT_EQ(result.pdus, 3);
+    ASSERT_EQ(smsc.getSubmitMultiCount(), 3);
+    ASSERT_EQ(smsc.getSubmitCount(), 0);
+    ASSERT_EQ(result.messageId.substr(0, 5), "multi");
+    ASSERT_EQ(result.unsuccessful.size(), 6u);
+    ASSERT_EQ(result.unsuccessful[0].address.value, "4512000000");
+    ASSERT_EQ(result.unsuccessful[0].address.ton, smpp::TON_INTERNATIONAL);
+    ASSERT_EQ(result.unsuccessful[0].status, smpp::ESME_RINVDSTADR);
+}
+
+// Each part of a long message is a submit_multi, the unsuccessful destinations are reported once
+TEST_F(MultiTest, parts) {
+    SendMultiResult result = client->sendMulti(from, getDestinations(10), string(300, 'x'));
+    ASSERT_EQ(result.pdus, 2);
+    ASSERT_EQ(result.unsuccessful.size(), 1u);
+    ASSERT_THROW(client->sendMulti(from, vector<MultiDestination>(), "message to send"), smpp::SmppException);
+}
+
+// An SMSC without submit_multi gets a submit_sm per SME, from then on without trying submit_multi first
+TEST_F(MultiTest, fallback) {
+    smsc.setSubmitMultiSupported(false);
+    vector<MultiDestination> destinations = getDestinations(200);
+    destinations.push_back(MultiDestination("customers"));
+    SendMultiResult result = client->sendMulti(from, destinations, "message to send");
+    ASSERT_TRUE(result.fallback);
+    ASSERT_EQ(result.pdus, 201);
+    ASSERT_EQ(smsc.getSubmitCount(), 200);
+    ASSERT_EQ(result.unsuccessful.size(), 3u);
+    // the distribution list fails right away, the SMEs as their submit_sm are answered
+    ASSERT_EQ(result.unsuccessful[0].address.value, "customers");
+    ASSERT_EQ(result.unsuccessful[0].status, smpp::ESME_RINVCMDID);
+    ASSERT_EQ(result.unsuccessful[1].status, smpp::ESME_RINVDSTADR);
+
+    result = client->sendMulti(from, getDestinations(5), "message to send");
+    ASSERT_TRUE(result.fallback);
+    ASSERT_EQ(result.pdus, 5);
+    ASSERT_EQ(smsc.getSubmitCount(), 205);
+}
+
+static void storeMulti(bool* done, SendMultiResult* stored, const error_code &error, const SendMultiResult &result) {
+    *done = true;
+    ASSERT_FALSE(error);
+    *stored = result;
+}
+
+TEST_F(MultiTest, async) {
+    bool done = false;
+    SendMultiResult result;
+    client->asyncSendMulti(from, getDestinations(300), "message to send",
+                           boost::bind(&storeMulti, &done, &result, _1, _2));
+
+    while (!done) {
+        ios.run_one();
+    }
+
+    ASSERT_EQ(result.pdus, 2);
+    ASSERT_EQ(result.unsuccessful.size(), 3u);
+}
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2014 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ */
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "smpp/smppclient.h"
+#include "smscsimulator.h"
+
+using smpp::SubmitResult;
+using std::set;
+using std::string;
+using std::vector;
+
+class PipeliningTest: public SimulatorClientTest {
+public:
+    virtual void SetUp() {
+        SimulatorClientTest::SetUp();
+        client->bindTransmitter("username", "password");
+    }
+};
+
+// Responses arrive in reverse batches of the window size and must all be matched
+TEST_F(PipeliningTest, outOfOrder) {
+    smsc.setReverseBatch(10);
+    client->setWindowSize(10);
+    set<uint32_t> sent;
+
+    for (int i = 0; i < 100; i++) {
+        vector<uint32_t> parts = client->submitSms(from, to, "message to send");
+        ASSERT_EQ(parts.size(), 1u);
+        sent.insert(parts[0]);
+    }
+
+    ASSERT_EQ(smsc.getMaxPending(), 10);
+    uint32_t previous = 0;
+    bool reordered = false;
+
+    while (client->getOutstanding() > 0) {
+        SubmitResult result = client->readSubmitResult();
+        ASSERT_EQ(result.commandStatus, smpp::ESME_ROK);
+        ASSERT_EQ(result.messageId, "msg" + std::to_string(result.sequenceNo));
+        ASSERT_EQ(sent.erase(result.sequenceNo), 1u);
+        reordered |= result.sequenceNo < previous;
+        previous = result.sequenceNo;
+    }
+
+    ASSERT_TRUE(sent.empty());
+    ASSERT_TRUE(reordered);
+    EXPECT_THROW(client->readSubmitResult(), smpp::SmppException);
+}
+
+// The window is never exceeded, the client reads responses instead
+TEST_F(PipeliningTest, backPressure) {
+    smsc.setReverseBatch(100);
+    client->setWindowSize(4);
+
+    for (int i = 0; i < 20; i++) {
+        client->submitSms(from, to, "message to send");
+        ASSERT_LE(client->getOutstanding(), 20u);
+    }
+
+    ASSERT_EQ(smsc.getMaxPending(), 4);
+
+    for (int i = 0; i < 20; i++) {
+        ASSERT_EQ(client->readSubmitResult().commandStatus, smpp::ESME_ROK);
+    }
+
+    EXPECT_THROW(client->setWindowSize(0), smpp::SmppException);
+}
+
+// Synchronous calls made while submits are in flight leave their responses alone
+TEST_F(PipeliningTest, mixedWithSynchronous) {
+    smsc.setReverseBatch(3);
+    client->setWindowSize(3);
+    client->submitSms(from, to, "first");
+    client->submitSms(from, to, "second");
+
+    // 168 chars is sent as two parts through the same window
+    string message;
+
+    for (int i = 0; i < 14; i++) {
+        message += "lorem ipsum ";
+    }
+
+    std::pair<string, int> result = client->sendSms(from, to, message);
+    ASSERT_EQ(result.second, 2);
+    ASSERT_EQ(result.first.substr(0, 3), "msg");
+
+    smpp::QuerySmResult query = client->querySm("msg1", from);
+    ASSERT_EQ(query.get<0>(), "msg1");
+    ASSERT_EQ(query.get<2>(), smpp::STATE_DELIVERED);
+
+    ASSERT_EQ(client->getOutstanding(), 2u);
+    ASSERT_EQ(client->readSubmitResult().commandStatus, smpp::ESME_ROK);
+    ASSERT_EQ(client->readSubmitResult().commandStatus, smpp::ESME_ROK);
+    ASSERT_EQ(smsc.getSubmitCount(), 4);
+}
+
+static void countDone(int* done, const boost::system::error_code &error, const smpp::SendSmsResult &) {
+    ASSERT_FALSE(error);
+    (*done)++;
+}
+
+// Submits queued while a write is in progress, or while the first one lingers, share a write
+TEST_F(PipeliningTest, coalescing) {
+    client->setWindowSize(100);
+    client->setMaxWriteBatch(32);
+    client->setWriteLinger(50);
+    client->setNoDelay(true);
+    uint64_t writes = client->getWriteCount();
+    uint64_t pdus = client->getWrittenPduCount();
+    int done = 0;
+
+    for (int i = 0; i < 100; i++) {
+        client->asyncSendSms(from, to, "message to send", boost::bind(&countDone, &done, _1, _2));
+    }
+
+    while (done < 100) {
+        ios.run_one();
+    }
+
+    ASSERT_EQ(client->getWrittenPduCount() - pdus, 100u);
+    // batches of up to 32
+    ASSERT_GE(client->getWriteCount() - writes, 4u);
+    ASSERT_LE(client->getWriteCount() - writes, 6u);
+    ASSERT_EQ(smsc.getSubmitCount(), 100);
+    EXPECT_THROW(client->setMaxWriteBatch(0), smpp::SmppException);
+}
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,251 @@
+/*
+ * Copyright (C) 2014 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ */
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "smpp/sessionpool.h"
+#include "smscsimulator.h"
+
+using boost::system::error_code;
+using smpp::SendSmsResult;
+using smpp::SessionPool;
+using smpp::SmppClient;
+using smpp::VirtualClock;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+/**
+ * A VirtualClock whose system time can be stepped, while its steady time goes on.
+ */
+class SteppedClock: public VirtualClock {
+public:
+    boost::posix_time::time_duration step;
+
+    SteppedClock() :
+            VirtualClock(boost::posix_time::ptime(boost::gregorian::date(2014, 1, 1))),
+            step() {
+    }
+
+    boost::posix_time::ptime universalTime() const {
+        return VirtualClock::universalTime() + step;
+    }
+};
+
+class PoolTest: public SimulatorTest {
+public:
+    shared_ptr<SmppClient> connect() {
+        shared_ptr<SmppClient> client(new SmppClient(connectSocket()));
+        client->setWindowSize(100);
+        client->bindTransmitter("username", "password");
+        return client;
+    }
+};
+
+static void countResult(int* done, int* failed, const error_code &error, const SendSmsResult &) {
+    (*done)++;
+
+    if (error) {
+        (*failed)++;
+    }
+}
+
+// Submits go to the session with the fewest awaiting a response
+TEST_F(PoolTest, leastOutstanding) {
+    SessionPool pool(ios);
+    pool.connect(smsc.getEndpoint(), "username", "password", 3, 100);
+    ASSERT_EQ(pool.getSessionCount(), 3u);
+    int done = 0;
+    int failed = 0;
+
+    for (int i = 0; i < 30; i++) {
+        pool.asyncSendSms(from, to, "message to send", boost::bind(&countResult, &done, &failed, _1, _2));
+    }
+
+    for (size_t i = 0; i < 3; i++) {
+        ASSERT_EQ(pool.getSubmitted(i), 10u);
+        ASSERT_EQ(pool.getOutstanding(i), 10u);
+    }
+
+    runUntil(done, 30);
+    ASSERT_EQ(failed, 0);
+    ASSERT_EQ(smsc.getSubmitCount(), 30);
+    ASSERT_EQ(pool.getOutstanding(0), 0u);
+    ASSERT_EQ(pool.getMetrics().succeeded, 30u);
+    ASSERT_GT(pool.getMetrics().maxLatency, boost::posix_time::time_duration());
+    ASSERT_GE(pool.getMetrics().maxLatency, pool.getMetrics().getMeanLatency());
+    ASSERT_GT(pool.getThroughput(), 0);
+    pool.close();
+    ASSERT_EQ(pool.getSessionCount(), 0u);
+}
+
+// Weighted round-robin splits the submits by weight
+TEST_F(PoolTest, weightedRoundRobin) {
+    SessionPool pool(ios, SessionPool::WEIGHTED_ROUND_ROBIN);
+
+    for (unsigned int weight = 1; weight <= 3; weight++) {
+        pool.addSession(connect(), weight);
+    }
+
+    for (int i = 0; i < 60; i++) {
+        ASSERT_EQ(pool.sendSms(from, to, "message to send").second, 1);
+    }
+
+    ASSERT_EQ(pool.getSubmitted(0), 10u);
+    ASSERT_EQ(pool.getSubmitted(1), 20u);
+    ASSERT_EQ(pool.getSubmitted(2), 30u);
+    ASSERT_THROW(pool.addSession(connect(), 0), smpp::SmppException);
+    pool.close();
+}
+
+// A session the SMSC throttles leaves the rotation until the backoff has passed
+TEST_F(PoolTest, throttled) {
+    smsc.setThrottledConnection(1);
+    shared_ptr<VirtualClock> clock(new VirtualClock(boost::posix_time::ptime(boost::gregorian::date(2014, 1, 1))));
+    SessionPool pool(ios);
+    pool.setClock(clock);
+    pool.setThrottleBackoff(500);
+    pool.connect(smsc.getEndpoint(), "username", "password", 3);
+    int done = 0;
+    int failed = 0;
+
+    for (int i = 0; i < 3; i++) {
+        pool.asyncSendSms(from, to, "message to send", boost::bind(&countResult, &done, &failed, _1, _2));
+    }
+
+    runUntil(done, 3);
+    ASSERT_EQ(failed, 1);
+    ASSERT_EQ(pool.getMetrics().throttled, 1u);
+    ASSERT_EQ(pool.getAvailableCount(), 2u);
+
+    for (int i = 0; i < 10; i++) {
+        pool.sendSms(from, to, "message to send");
+    }
+
+    ASSERT_EQ(pool.getSubmitted(1), 1u);
+    ASSERT_EQ(pool.getSubmitted(0) + pool.getSubmitted(2), 12u);
+
+    clock->advance(boost::posix_time::milliseconds(500));
+    ASSERT_EQ(pool.getAvailableCount(), 3u);
+
+    for (int i = 0; i < 3; i++) {
+        pool.asyncSendSms(from, to, "message to send", boost::bind(&countResult, &done, &failed, _1, _2));
+    }
+
+    runUntil(done, 6);
+    ASSERT_EQ(pool.getSubmitted(1), 2u);
+    ASSERT_EQ(failed, 2);
+    pool.close();
+}
+
+// A step of the system clock back doesn't keep a throttled session out of the rotation
+TEST_F(PoolTest, clockStep) {
+    smsc.setThrottledConnection(0);
+    shared_ptr<SteppedClock> clock(new SteppedClock());
+    SessionPool pool(ios);
+    pool.setClock(clock);
+    pool.setThrottleBackoff(500);
+    pool.connect(smsc.getEndpoint(), "username", "password", 1);
+    int done = 0;
+    int failed = 0;
+    pool.asyncSendSms(from, to, "message to send", boost::bind(&countResult, &done, &failed, _1, _2));
+    runUntil(done, 1);
+    ASSERT_EQ(failed, 1);
+    ASSERT_EQ(pool.getAvailableCount(), 0u);
+
+    clock->step = -boost::posix_time::hours(1);
+    clock->advance(boost::posix_time::milliseconds(500));
+    ASSERT_EQ(pool.getAvailableCount(), 1u);
+    pool.close();
+}
+
+// Sessions that are no longer bound leave the rotation, the health check confirms the others
+TEST_F(PoolTest, health) {
+    shared_ptr<SmppClient> first = connect();
+    SessionPool pool(ios);
+    pool.addSession(first);
+    pool.addSession(connect());
+    first->unbind();
+    ASSERT_EQ(pool.getAvailableCount(), 1u);
+
+    pool.checkHealth();
+    ASSERT_EQ(pool.getAvailableCount(), 1u);
+
+    for (int i = 0; i < 5; i++) {
+        pool.sendSms(from, to, "message to send");
+    }
+
+    ASSERT_EQ(pool.getSubmitted(0), 0u);
+    ASSERT_EQ(pool.getSubmitted(1), 5u);
+    pool.close();
+    ASSERT_THROW(pool.sendSms(from, to, "message to send"), smpp::SmppException);
+}
+
+// Threads of the application submit at once while others run the io_service and the handlers of the sessions
+TEST_F(PoolTest, threads) {
+    boost::asio::executor_work_guard<boost::asio::io_service::executor_type> work(ios.get_executor());
+    vector<std::thread> threads;
+
+    for (int i = 0; i < 4; i++) {
+        threads.push_back(std::thread(boost::bind(&boost::asio::io_service::run, &ios)));
+    }
+
+    SessionPool pool(ios);
+
+    for (int i = 0; i < 3; i++) {
+        shared_ptr<SmppClient> client(new SmppClient(connectSocket()));
+        client->setRunIoService(false);
+        client->setWindowSize(10);
+        client->bindTransmitter("username", "password");
+        pool.addSession(client);
+    }
+
+    std::atomic<int> done(0);
+    vector<std::thread> producers;
+
+    for (int i = 0; i < 4; i++) {
+        producers.push_back(std::thread([&]() {
+            for (int j = 0; j < 25; j++) {
+                pool.sendSms(from, to, "message to send");
+                pool.asyncSendSms(from, to, "message to send", [&](const error_code &error, const SendSmsResult &) {
+                    ASSERT_FALSE(error);
+                    done++;
+                });
+            }
+        }));
+    }
+
+    for (size_t i = 0; i < producers.size(); i++) {
+        producers[i].join();
+    }
+
+    while (done < 100) {
+        std::this_thread::yield();
+    }
+
+    ASSERT_EQ(pool.getMetrics().submitted, 200u);
+    ASSERT_EQ(pool.getMetrics().succeeded, 200u);
+    ASSERT_EQ(pool.getSubmitted(0) + pool.getSubmitted(1) + pool.getSubmitted(2), 200u);
+    ASSERT_EQ(pool.getOutstanding(0) + pool.getOutstanding(1) + pool.getOutstanding(2), 0u);
+    pool.close();
+    work.reset();
+    ios.stop();
+
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+}
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
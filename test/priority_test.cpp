@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2014 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ */
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "smpp/priorityscheduler.h"
+#include "smpp/smppclient.h"
+#include "smscsimulator.h"
+
+using smpp::LatencyStats;
+using smpp::MultiDestination;
+using smpp::PriorityScheduler;
+using smpp::SendSmsResult;
+using smpp::SmppClient;
+using smpp::TLV;
+using std::list;
+using std::string;
+using std::vector;
+using boost::system::error_code;
+
+/**
+ * Pops all values of a scheduler.
+ */
+static string drain(PriorityScheduler<char>* scheduler) {
+    string order;
+
+    for (; !scheduler->empty(); scheduler->pop()) {
+        order += scheduler->front();
+    }
+
+    return order;
+}
+
+// Higher classes go first, each class in order, and priorities above the highest class count as the highest
+TEST(PrioritySchedulerTest, strict) {
+    PriorityScheduler<char> scheduler(3);
+    scheduler.push(0, 'a');
+    scheduler.push(1, 'b');
+    scheduler.push(0, 'c');
+    scheduler.push(7, 'd');
+    scheduler.pushFront(1, 'e');
+    ASSERT_EQ(scheduler.size(), 5u);
+    ASSERT_EQ(scheduler.size(2), 1u);
+    ASSERT_EQ(drain(&scheduler), "debac");
+    ASSERT_THROW(PriorityScheduler<char>(0), smpp::SmppException);
+}
+
+// Each class gets its weight of turns per round, so lower classes keep moving
+TEST(PrioritySchedulerTest, weighted) {
+    PriorityScheduler<char> scheduler(2);
+    vector<unsigned int> weights;
+    weights.push_back(1);
+    weights.push_back(3);
+    scheduler.setMode(PriorityScheduler<char>::WEIGHTED, weights);
+
+    for (int i = 0; i < 4; i++) {
+        scheduler.push(0, 'l');
+    }
+
+    for (int i = 0; i < 7; i++) {
+        scheduler.push(1, 'H');
+    }
+
+    ASSERT_EQ(drain(&scheduler), "HHHlHHHlHll");
+
+    weights[0] = 0;
+    ASSERT_THROW(scheduler.setMode(PriorityScheduler<char>::WEIGHTED, weights), smpp::SmppException);
+    ASSERT_THROW(scheduler.setMode(PriorityScheduler<char>::WEIGHTED, vector<unsigned int>(3, 1)),
+                 smpp::SmppException);
+}
+
+class PriorityTest: public SimulatorClientTest {
+public:
+    // Priorities of the SMSes in the order they were answered
+    vector<int> answered;
+
+    PriorityTest() :
+            answered() {
+    }
+
+    virtual void SetUp() {
+        SimulatorClientTest::SetUp();
+        client->bindTransmitter("username", "password");
+    }
+
+    /**
+     * Queues bulk SMSes with priority 0, then urgent ones with priority 3, and runs the io_service until all are
+     * answered. The window holds one, so only the first bulk SMS is sent before the urgent ones are queued.
+     */
+    void send(const int bulk, const int urgent) {
+        for (int i = 0; i < bulk + urgent; i++) {
+            int priority = i < bulk ? 0 : 3;
+            client->asyncSendSms(from, to, "message to send", list<TLV>(), priority, "", "",
+                                 smpp::DATA_CODING_DEFAULT, oc::tools::GsmShiftTables(),
+                                 boost::bind(&PriorityTest::store, this, priority, _1, _2));
+        }
+
+        while (answered.size() < static_cast<size_t>(bulk + urgent)) {
+            ios.run_one();
+        }
+    }
+
+    void store(const int priority, const error_code &error, const SendSmsResult &) {
+        ASSERT_FALSE(error);
+        answered.push_back(priority);
+    }
+};
+
+// Urgent submits overtake the queued bulk
+TEST_F(PriorityTest, strict) {
+    send(10, 3);
+    int expected[] = { 0, 3, 3, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+    ASSERT_EQ(answered, vector<int>(expected, expected + 13));
+    ASSERT_EQ(smsc.getSubmitCount(), 13);
+}
+
+// Bulk gets a turn between the urgent submits
+TEST_F(PriorityTest, weighted) {
+    vector<unsigned int> weights(4, 1);
+    weights[3] = 2;
+    client->setPriorityScheduling(SmppClient::WEIGHTED_PRIORITY, weights);
+    send(4, 5);
+    // the first bulk SMS had the turn of priority 0 in the first round
+    int expected[] = { 0, 3, 3, 3, 3, 0, 3, 0, 0 };
+    ASSERT_EQ(answered, vector<int>(expected, expected + 9));
+    ASSERT_THROW(client->setPriorityScheduling(SmppClient::WEIGHTED_PRIORITY, vector<unsigned int>(2, 1)),
+                 smpp::SmppException);
+}
+
+// Latencies are counted by the priority of each submit, including the priority of a submit_multi
+TEST_F(PriorityTest, latencyStats) {
+    send(5, 2);
+    LatencyStats bulk = client->getLatencyStats(0);
+    LatencyStats urgent = client->getLatencyStats(3);
+    ASSERT_EQ(bulk.count, 5u);
+    ASSERT_EQ(urgent.count, 2u);
+    ASSERT_LE(urgent.maxQueueTime, urgent.maxResponseTime);
+    ASSERT_LE(urgent.totalResponseTime, urgent.maxResponseTime * 2);
+    // the last bulk SMS waited for all the others
+    ASSERT_GE(bulk.maxResponseTime, urgent.maxResponseTime);
+
+    vector<MultiDestination> destinations;
+    destinations.push_back(MultiDestination(to));
+    destinations.push_back(MultiDestination("customers"));
+    client->sendMulti(from, destinations, "message to send", list<TLV>(), 1);
+    client->sendSms(from, to, "message to send", list<TLV>(), 9);
+    ASSERT_EQ(client->getLatencyStats(1).count, 1u);
+    ASSERT_EQ(client->getLatencyStats(3).count, 3u);
+    ASSERT_EQ(client->getLatencyStats(9).count, 3u);
+
+    client->resetLatencyStats();
+    ASSERT_EQ(client->getLatencyStats(0).count, 0u);
+    ASSERT_EQ(client->getLatencyStats(3).count, 0u);
+}
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2014 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ */
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <memory>
+#include <string>
+#include "gtest/gtest.h"
+#include "smpp/ratelimiter.h"
+#include "smpp/smppclient.h"
+#include "smscsimulator.h"
+
+using boost::posix_time::milliseconds;
+using boost::posix_time::ptime;
+using boost::posix_time::time_duration;
+using boost::system::error_code;
+using smpp::RateLimiter;
+using smpp::SendSmsResult;
+using smpp::VirtualClock;
+using std::shared_ptr;
+using std::string;
+
+/**
+ * Virtual clock whose system time can be stepped apart from its steady time, as when the system clock is set.
+ */
+class SteppedClock: public VirtualClock {
+public:
+    time_duration step;
+
+    SteppedClock() :
+            VirtualClock(ptime(boost::gregorian::date(2014, 1, 1))),
+            step() {
+    }
+
+    ptime universalTime() const {
+        return VirtualClock::universalTime() + step;
+    }
+};
+
+class RateLimiterTest: public testing::Test {
+public:
+    shared_ptr<VirtualClock> clock;
+
+    RateLimiterTest() :
+            clock(new VirtualClock(ptime(boost::gregorian::date(2014, 1, 1)))) {
+    }
+};
+
+// Without a burst the submits are spaced evenly
+TEST_F(RateLimiterTest, pacing) {
+    RateLimiter limiter(10);
+    limiter.setClock(clock);
+    ASSERT_TRUE(limiter.acquire().is_zero());
+    time_duration delay = limiter.acquire();
+    ASSERT_GT(delay, milliseconds(99));
+    ASSERT_LE(delay, milliseconds(101));
+    clock->advance(milliseconds(50));
+    ASSERT_FALSE(limiter.acquire().is_zero());
+    clock->advance(milliseconds(51));
+    ASSERT_TRUE(limiter.acquire().is_zero());
+    ASSERT_FALSE(limiter.acquire().is_zero());
+    ASSERT_THROW(RateLimiter(0), smpp::SmppException);
+}
+
+// The bucket is refilled by the steady time, so setting the system clock neither stalls nor floods it
+TEST_F(RateLimiterTest, clockStep) {
+    shared_ptr<SteppedClock> stepped(new SteppedClock());
+    RateLimiter limiter(10, 5);
+    limiter.setClock(stepped);
+
+    for (int i = 0; i < 5; i++) {
+        ASSERT_TRUE(limiter.acquire().is_zero());
+    }
+
+    stepped->step = -boost::posix_time::hours(1);
+    stepped->advance(milliseconds(100));
+    ASSERT_TRUE(limiter.acquire().is_zero());
+    ASSERT_FALSE(limiter.acquire().is_zero());
+
+    stepped->step = boost::posix_time::hours(1);
+    ASSERT_FALSE(limiter.acquire().is_zero());
+}
+
+// An idle limiter saves up to the burst
+TEST_F(RateLimiterTest, burst) {
+    RateLimiter limiter(10, 5);
+    limiter.setClock(clock);
+    clock->advance(boost::posix_time::seconds(10));
+
+    for (int i = 0; i < 5; i++) {
+        ASSERT_TRUE(limiter.acquire().is_zero());
+    }
+
+    ASSERT_FALSE(limiter.acquire().is_zero());
+}
+
+// Throttling halves the rate once per holdoff, accepted submits win it back step by step
+TEST_F(RateLimiterTest, aimd) {
+    RateLimiter limiter(100);
+    limiter.setClock(clock);
+    limiter.onThrottled();
+    ASSERT_DOUBLE_EQ(limiter.getRate(), 50);
+    limiter.onThrottled();
+    ASSERT_DOUBLE_EQ(limiter.getRate(), 50);
+    ASSERT_EQ(limiter.getThrottledCount(), 2u);
+    clock->advance(milliseconds(1000));
+    limiter.onThrottled();
+    ASSERT_DOUBLE_EQ(limiter.getRate(), 25);
+
+    // a second of submits at 25 per second gains about the step of 10
+    for (int i = 0; i < 25; i++) {
+        limiter.onAccepted();
+    }
+
+    ASSERT_GT(limiter.getRate(), 33);
+    ASSERT_LT(limiter.getRate(), 36);
+
+    for (int i = 0; i < 10000; i++) {
+        limiter.onAccepted();
+    }
+
+    ASSERT_DOUBLE_EQ(limiter.getRate(), 100);
+
+    limiter.setMinRate(40);
+    limiter.setHoldoff(0);
+
+    for (int i = 0; i < 5; i++) {
+        limiter.onThrottled();
+    }
+
+    ASSERT_DOUBLE_EQ(limiter.getRate(), 40);
+}
+
+// A session limiter passes only what the account limiter allows as well
+TEST_F(RateLimiterTest, parent) {
+    shared_ptr<RateLimiter> account(new RateLimiter(10));
+    account->setClock(clock);
+    RateLimiter first(100);
+    RateLimiter second(100);
+    first.setClock(clock);
+    second.setClock(clock);
+    first.setParent(account);
+    second.setParent(account);
+    ASSERT_TRUE(first.acquire().is_zero());
+    ASSERT_GT(second.acquire(), milliseconds(99));
+    clock->advance(milliseconds(100));
+    // the token the session kept is used now
+    ASSERT_TRUE(second.acquire().is_zero());
+    ASSERT_FALSE(first.acquire().is_zero());
+
+    second.onThrottled();
+    ASSERT_DOUBLE_EQ(second.getRate(), 50);
+    ASSERT_DOUBLE_EQ(first.getRate(), 100);
+    ASSERT_DOUBLE_EQ(account->getRate(), 5);
+}
+
+class PacedClientTest: public SimulatorClientTest {
+public:
+    virtual void SetUp() {
+        SimulatorClientTest::SetUp();
+        client->setWindowSize(10);
+        client->bindTransmitter("username", "password");
+    }
+};
+
+static void countResult(int* done, int* throttled, const error_code &error, const SendSmsResult &) {
+    (*done)++;
+
+    if (error == smpp::makeEsmeError(smpp::ESME_RTHROTTLED)) {
+        (*throttled)++;
+    }
+}
+
+// The window would allow 10 at once, the limiter spaces them
+TEST_F(PacedClientTest, paced) {
+    shared_ptr<RateLimiter> limiter(new RateLimiter(200));
+    client->setRateLimiter(limiter);
+    int done = 0;
+    int throttled = 0;
+    ptime start = boost::posix_time::microsec_clock::universal_time();
+
+    for (int i = 0; i < 40; i++) {
+        client->asyncSendSms(from, to, "message to send", boost::bind(&countResult, &done, &throttled, _1, _2));
+    }
+
+    runUntil(done, 40);
+    // 39 gaps of 5 ms
+    ASSERT_GE(boost::posix_time::microsec_clock::universal_time() - start, milliseconds(190));
+    ASSERT_EQ(throttled, 0);
+    // enquire links and unbind are not paced
+    client->enquireLink();
+}
+
+// The SMSC allows less than the limiter thinks, so it backs off until the throttling stops
+TEST_F(PacedClientTest, adapts) {
+    smsc.setMaxSubmitRate(100);
+    shared_ptr<RateLimiter> limiter(new RateLimiter(400));
+    limiter->setHoldoff(100);
+    client->setRateLimiter(limiter);
+    int done = 0;
+    int throttled = 0;
+
+    for (int i = 0; i < 150; i++) {
+        client->asyncSendSms(from, to, "message to send", boost::bind(&countResult, &done, &throttled, _1, _2));
+    }
+
+    runUntil(done, 150);
+    ASSERT_GT(throttled, 0);
+    ASSERT_LT(limiter->getRate(), 400);
+    int before = throttled;
+
+    // once adapted, hardly anything is throttled
+    for (int i = 0; i < 100; i++) {
+        client->asyncSendSms(from, to, "message to send", boost::bind(&countResult, &done, &throttled, _1, _2));
+    }
+
+    runUntil(done, 250);
+    ASSERT_LT(throttled - before, 20);
+}
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
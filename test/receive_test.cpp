@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2014 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ */
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "smpp/smppclient.h"
+#include "smscsimulator.h"
+
+using smpp::SMS;
+using std::string;
+using std::vector;
+
+class ReceiveTest: public SimulatorClientTest {
+public:
+    /**
+     * Runs the io_service until the simulator has received a number of responses.
+     */
+    void waitForResponses(const uint32_t commandId, const int n) {
+        for (int i = 0; i < 1000 && smsc.getResponseCount(commandId) < n; i++) {
+            ios.poll();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+};
+
+static void storeMessage(vector<string>* messages, const SMS &sms) {
+    messages->push_back(sms.short_message);
+}
+
+static void count(int* n) {
+    (*n)++;
+}
+
+// Inbound PDUs are dispatched to the handlers as they arrive, and answered
+TEST_F(ReceiveTest, handlers) {
+    smsc.setDeliveriesOnBind(3);
+    smsc.setUnbindAfterDeliveries(true);
+    vector<string> messages;
+    int enquireLinks = 0;
+    int unbinds = 0;
+    client->onDeliverSm(boost::bind(&storeMessage, &messages, _1));
+    client->onEnquireLink(boost::bind(&count, &enquireLinks));
+    client->onUnbind(boost::bind(&count, &unbinds));
+    client->bindReceiver("username", "password");
+
+    while (unbinds == 0) {
+        ios.run_one();
+    }
+
+    ASSERT_EQ(messages.size(), 3u);
+    ASSERT_EQ(messages[0], "delivery 1");
+    ASSERT_EQ(messages[2], "delivery 3");
+    ASSERT_EQ(enquireLinks, 1);
+    ASSERT_FALSE(client->isBound());
+
+    waitForResponses(smpp::UNBIND_RESP, 1);
+    ASSERT_EQ(smsc.getResponseCount(smpp::DELIVER_SM_RESP), 3);
+    ASSERT_EQ(smsc.getResponseCount(smpp::ENQUIRE_LINK_RESP), 1);
+    ASSERT_EQ(smsc.getResponseCount(smpp::UNBIND_RESP), 1);
+}
+
+// Without a handler SMSes are queued for readSms
+TEST_F(ReceiveTest, readSms) {
+    smsc.setDeliveriesOnBind(2);
+    client->bindReceiver("username", "password");
+    ASSERT_EQ(client->readSms().short_message, "delivery 1");
+    ASSERT_EQ(client->readSms().short_message, "delivery 2");
+
+    waitForResponses(smpp::DELIVER_SM_RESP, 2);
+    ASSERT_EQ(smsc.getResponseCount(smpp::DELIVER_SM_RESP), 2);
+}
+
+// SMSes beyond the queue limit are rejected, for the SMSC to deliver them again later
+TEST_F(ReceiveTest, queueLimit) {
+    smsc.setDeliveriesOnBind(5);
+    client->setSmsQueueLimit(2);
+    client->bindReceiver("username", "password");
+
+    waitForResponses(smpp::DELIVER_SM_RESP, 3);
+    ASSERT_EQ(smsc.getResponseCount(smpp::DELIVER_SM_RESP), 3);
+    ASSERT_EQ(smsc.getRejectedCount(smpp::DELIVER_SM_RESP), 3);
+
+    // the queue kept the oldest ones, they are answered as they are read
+    ASSERT_EQ(client->readSms().short_message, "delivery 1");
+    ASSERT_EQ(client->readSms().short_message, "delivery 2");
+    waitForResponses(smpp::DELIVER_SM_RESP, 5);
+    ASSERT_EQ(smsc.getResponseCount(smpp::DELIVER_SM_RESP), 5);
+    ASSERT_EQ(smsc.getRejectedCount(smpp::DELIVER_SM_RESP), 3);
+}
+
+// A transceiver submits and receives on the same connection
+TEST_F(ReceiveTest, transceiver) {
+    smsc.setDeliveriesOnBind(3);
+    smpp::SmppAddress from("CPPSMPP", smpp::TON_ALPHANUMERIC, smpp::NPI_UNKNOWN);
+    smpp::SmppAddress to("4513371337", smpp::TON_INTERNATIONAL, smpp::NPI_E164);
+    vector<string> messages;
+    client->onDeliverSm(boost::bind(&storeMessage, &messages, _1));
+    client->bindTransceiver("username", "password");
+
+    for (int i = 0; i < 5; i++) {
+        ASSERT_EQ(client->sendSms(from, to, "message to send").second, 1);
+    }
+
+    // the deliveries were sent right after the bind, ahead of the submit responses
+    ASSERT_EQ(messages.size(), 3u);
+    ASSERT_EQ(smsc.getSubmitCount(), 5);
+
+    client->onDeliverSm(boost::function<void(const SMS &)>());
+    client->unbind();
+    client->bindReceiver("username", "password");
+    ASSERT_EQ(client->readSms().short_message, "delivery 1");
+    EXPECT_THROW(client->sendSms(from, to, "message to send"), smpp::SmppException);
+}
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
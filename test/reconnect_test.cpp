@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2014 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ */
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <memory>
+#include <string>
+#include "gtest/gtest.h"
+#include "smpp/smppclient.h"
+#include "smscsimulator.h"
+
+using smpp::SendSmsResult;
+using smpp::SmppClient;
+using boost::system::error_code;
+
+class ReconnectTest: public SimulatorClientTest {
+public:
+    int done;
+    int failed;
+    int lost;
+    int reconnects;
+
+    ReconnectTest() :
+            done(0),
+            failed(0),
+            lost(0),
+            reconnects(0) {
+    }
+
+    virtual void SetUp() {
+        SimulatorClientTest::SetUp();
+        client->setReconnectBackoff(10, 100);
+        client->onConnectionLost(boost::bind(&ReconnectTest::countLost, this, _1));
+        client->onReconnect(boost::bind(&ReconnectTest::countReconnect, this));
+    }
+
+    void countResult(const error_code &error, const SendSmsResult &) {
+        done++;
+
+        if (error) {
+            failed++;
+        }
+    }
+
+    void countLost(const error_code &) {
+        lost++;
+    }
+
+    void countReconnect() {
+        reconnects++;
+    }
+
+    /**
+     * Sends 10 submits through a window of 5, and drops the connection when the 3rd one arrives.
+     */
+    void sendThroughDrop() {
+        smsc.setReverseBatch(10);
+        smsc.setDropAtSubmit(3);
+        client->setWindowSize(5);
+        client->bindTransmitter("username", "password");
+
+        for (int i = 0; i < 10; i++) {
+            client->asyncSendSms(from, to, "message to send",
+                                 boost::bind(&ReconnectTest::countResult, this, _1, _2));
+        }
+
+        while (done < 10) {
+            ios.run_one();
+        }
+    }
+};
+
+// Unanswered submits are sent again on the new connection
+TEST_F(ReconnectTest, atLeastOnce) {
+    client->setReconnect(smsc.getEndpoint(), SmppClient::AT_LEAST_ONCE);
+    sendThroughDrop();
+    ASSERT_EQ(lost, 1);
+    ASSERT_EQ(reconnects, 1);
+    ASSERT_FALSE(client->isReconnecting());
+    ASSERT_EQ(failed, 0);
+    ASSERT_EQ(smsc.getSubmitCount(), 13);
+    ASSERT_EQ(client->sendSms(from, to, "message to send").second, 1);
+}
+
+// Unanswered submits fail, the ones held back by the window are sent on the new connection
+TEST_F(ReconnectTest, atMostOnce) {
+    client->setReconnect(smsc.getEndpoint(), SmppClient::AT_MOST_ONCE);
+    sendThroughDrop();
+    ASSERT_EQ(reconnects, 1);
+    ASSERT_EQ(failed, 5);
+    ASSERT_EQ(smsc.getSubmitCount(), 8);
+}
+
+// Refused binds are retried after a backoff, while a synchronous call waits
+TEST_F(ReconnectTest, backoff) {
+    client->setReconnect(smsc.getEndpoint());
+    smsc.setDropAtSubmit(1);
+    client->bindTransmitter("username", "password");
+    smsc.setRefusedBinds(2);
+    ASSERT_EQ(client->sendSms(from, to, "message to send").second, 1);
+    ASSERT_EQ(smsc.getBindCount(), 4);
+    ASSERT_EQ(reconnects, 1);
+    ASSERT_THROW(client->setReconnectBackoff(0, 100), smpp::SmppException);
+}
+
+// Without reconnect the requests fail and the client is unbound
+TEST_F(ReconnectTest, disabled) {
+    sendThroughDrop();
+    ASSERT_EQ(lost, 1);
+    ASSERT_EQ(reconnects, 0);
+    ASSERT_EQ(failed, 10);
+    ASSERT_FALSE(client->isBound());
+}
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
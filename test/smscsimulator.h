@@ -0,0 +1,636 @@
+/*
+ * Copyright (C) 2014 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ */
+#ifndef SMSCSIMULATOR_H_
+#define SMSCSIMULATOR_H_
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <boost/asio.hpp>
+#include <boost/shared_array.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "smpp/pdu.h"
+#include "smpp/smpp.h"
+#include "smpp/smppclient.h"
+
+/**
+ * A minimal SMSC on the loopback interface, so client tests don't need a live SMSC.
+ * Every connection is served by its own thread with blocking I/O.
+ *
+ * It accepts any bind, answers enquire_link, query_sm and unbind, and gives each submit_sm and submit_multi a
+ * message id. Destinations ending in 0000 are rejected as invalid, submit_sm to destinations ending in 9999 are
+ * never answered. Support of submit_multi and answering enquire_link can be turned off.
+ * One of the connections can be made to reject every submit_sm as throttled, and the account can be limited to a
+ * rate of submits, above which they are throttled.
+ * Receivers can be sent a number of deliver_sm as soon as they bind, followed by an enquire_link and an unbind.
+ * Submits can be held in batches and answered in reverse, to exercise out of order responses.
+ * To exercise reconnects, a connection can be dropped on a submit and binds can be refused.
+ * A query_sm for the message id "malformed" is answered with a final_date that isn't a timestamp, and one for
+ * "corrupt" with a PDU whose command_length is shorter than its header.
+ */
+class SmscSimulator {
+  private:
+    boost::asio::io_service ios;
+    boost::asio::ip::tcp::acceptor acceptor;
+    std::thread acceptThread;
+    std::mutex mutex;
+    std::list<std::shared_ptr<boost::asio::ip::tcp::socket> > sockets;
+    std::list<std::thread> threads;
+    std::atomic<bool> stopped;
+    std::atomic<int> reverseBatch;
+    std::atomic<int> submitCount;
+    std::atomic<int> maxPending;
+    std::atomic<int> deliveriesOnBind;
+    std::atomic<bool> unbindAfterDeliveries;
+    std::atomic<int> throttledConnection;
+    std::atomic<bool> submitMultiSupported;
+    std::atomic<int> submitMultiCount;
+    std::atomic<bool> enquireLinkAnswered;
+    std::atomic<int> enquireLinkCount;
+    // Total submit_sm count at which the connection is dropped, 0 for never
+    std::atomic<int> dropAtSubmit;
+    std::atomic<int> refusedBinds;
+    std::atomic<int> bindCount;
+    // Submits per second accepted over all connections, 0 for no limit
+    int maxSubmitRate;
+    // Token bucket of the submit rate
+    double submitTokens;
+    std::chrono::steady_clock::time_point lastSubmit;
+    std::mutex rateMutex;
+    // Responses received from clients, by command id
+    std::map<uint32_t, int> responseCounts;
+    // Responses with an error status received from clients, by command id
+    std::map<uint32_t, int> rejectedCounts;
+    std::mutex countMutex;
+
+  public:
+    SmscSimulator() :
+        ios(),
+        acceptor(ios, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0)),
+        acceptThread(),
+        mutex(),
+        sockets(),
+        threads(),
+        stopped(false),
+        reverseBatch(1),
+        submitCount(0),
+        maxPending(0),
+        deliveriesOnBind(0),
+        unbindAfterDeliveries(false),
+        throttledConnection(-1),
+        submitMultiSupported(true),
+        submitMultiCount(0),
+        enquireLinkAnswered(true),
+        enquireLinkCount(0),
+        dropAtSubmit(0),
+        refusedBinds(0),
+        bindCount(0),
+        maxSubmitRate(0),
+        submitTokens(0),
+        lastSubmit(),
+        rateMutex(),
+        responseCounts(),
+        rejectedCounts(),
+        countMutex() {
+        acceptThread = std::thread(&SmscSimulator::acceptLoop, this);
+    }
+
+    ~SmscSimulator() {
+        stopped = true;
+        // wake the blocking accept
+        boost::asio::ip::tcp::socket wakeup(ios);
+        boost::system::error_code ec;
+        wakeup.connect(getEndpoint(), ec);
+        acceptThread.join();
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (std::list<std::shared_ptr<boost::asio::ip::tcp::socket> >::iterator it = sockets.begin();
+                it != sockets.end(); it++) {
+            ::shutdown((*it)->native_handle(), SHUT_RDWR);
+        }
+
+        for (std::list<std::thread>::iterator it = threads.begin(); it != threads.end(); it++) {
+            it->join();
+        }
+    }
+
+    boost::asio::ip::tcp::endpoint getEndpoint() const {
+        return acceptor.local_endpoint();
+    }
+
+    /**
+     * Holds up to n submit_sm and answers them last first. A batch is answered early if the client goes quiet,
+     * so a client with a smaller window doesn't stall.
+     */
+    void setReverseBatch(const int n) {
+        reverseBatch = n;
+    }
+
+    int getSubmitCount() const {
+        return submitCount;
+    }
+
+    /**
+     * @return Largest number of submit_sm held unanswered at once on one connection.
+     */
+    int getMaxPending() const {
+        return maxPending;
+    }
+
+    /**
+     * Sends n deliver_sm, with the short messages "delivery 1" to "delivery n", to each receiver that binds.
+     */
+    void setDeliveriesOnBind(const int n) {
+        deliveriesOnBind = n;
+    }
+
+    /**
+     * Makes the simulator end the session of a receiver after its deliveries, with an enquire_link and an unbind.
+     */
+    void setUnbindAfterDeliveries(const bool b) {
+        unbindAfterDeliveries = b;
+    }
+
+    /**
+     * Makes the connection with the index, counting from 0 in the order they were accepted, answer every
+     * submit_sm with ESME_RTHROTTLED.
+     */
+    void setThrottledConnection(const int index) {
+        throttledConnection = index;
+    }
+
+    /**
+     * Makes the simulator answer submit_multi with a generic_nack, like an SMSC that doesn't support it.
+     */
+    void setSubmitMultiSupported(const bool b) {
+        submitMultiSupported = b;
+    }
+
+    int getSubmitMultiCount() const {
+        return submitMultiCount;
+    }
+
+    /**
+     * Makes the simulator ignore enquire_link, like a link that went dead.
+     */
+    void setEnquireLinkAnswered(const bool b) {
+        enquireLinkAnswered = b;
+    }
+
+    /**
+     * Drops the connection a submit_sm arrives on, without answering it or the ones held, like an SMSC that
+     * crashed.
+     * @param n Total number of submit_sm, counted from the start, the connection is dropped at. 0 for never.
+     */
+    void setDropAtSubmit(const int n) {
+        dropAtSubmit = n;
+    }
+
+    /**
+     * Rejects the next n binds with ESME_RBINDFAIL, like an SMSC that is starting up.
+     */
+    void setRefusedBinds(const int n) {
+        refusedBinds = n;
+    }
+
+    int getBindCount() const {
+        return bindCount;
+    }
+
+    /**
+     * @return Number of enquire_link received from clients.
+     */
+    int getEnquireLinkCount() const {
+        return enquireLinkCount;
+    }
+
+    /**
+     * Throttles submits above a rate, counted over all connections like an SMSC counts an account.
+     * A tenth of a second of submits may arrive back to back.
+     * @param perSecond Submits per second, 0 for no limit.
+     */
+    void setMaxSubmitRate(const int perSecond) {
+        std::lock_guard<std::mutex> lock(rateMutex);
+        maxSubmitRate = perSecond;
+        submitTokens = std::max(1, perSecond / 10);
+        lastSubmit = std::chrono::steady_clock::now();
+    }
+
+    /**
+     * @return Number of responses with the command id received from clients.
+     */
+    int getResponseCount(const uint32_t commandId) {
+        std::lock_guard<std::mutex> lock(countMutex);
+        return responseCounts[commandId];
+    }
+
+    /**
+     * @return Number of responses with the command id and an error status received from clients.
+     */
+    int getRejectedCount(const uint32_t commandId) {
+        std::lock_guard<std::mutex> lock(countMutex);
+        return rejectedCounts[commandId];
+    }
+
+  private:
+    void acceptLoop() {
+        while (true) {
+            std::shared_ptr<boost::asio::ip::tcp::socket> socket(new boost::asio::ip::tcp::socket(ios));
+            boost::system::error_code ec;
+            acceptor.accept(*socket, ec);
+
+            if (stopped || ec) {
+                return;
+            }
+
+            socket->set_option(boost::asio::ip::tcp::no_delay(true));
+            std::lock_guard<std::mutex> lock(mutex);
+            sockets.push_back(socket);
+            threads.push_back(std::thread(&SmscSimulator::serve, this, socket, sockets.size() - 1));
+        }
+    }
+
+    /**
+     * @return True if a submit arriving now is within the rate.
+     */
+    bool admitSubmit() {
+        std::lock_guard<std::mutex> lock(rateMutex);
+
+        if (maxSubmitRate == 0) {
+            return true;
+        }
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - lastSubmit).count();
+        submitTokens = std::min<double>(std::max(1, maxSubmitRate / 10), submitTokens + elapsed * maxSubmitRate);
+        lastSubmit = now;
+
+        if (submitTokens < 1) {
+            return false;
+        }
+
+        submitTokens -= 1;
+        return true;
+    }
+
+    static bool isInvalidDestination(const std::string &address) {
+        return address.length() >= 4 && address.compare(address.length() - 4, 4, "0000") == 0;
+    }
+
+    // Submits to these are never answered
+    static bool isUnansweredDestination(const std::string &address) {
+        return address.length() >= 4 && address.compare(address.length() - 4, 4, "9999") == 0;
+    }
+
+    /**
+     * Answers a submit_multi, listing the invalid SME destinations as unsuccessful.
+     */
+    static void answerSubmitMulti(boost::asio::ip::tcp::socket &socket, smpp::PDU &pdu) {
+        std::string serviceType;
+        uint8_t ton;
+        uint8_t npi;
+        std::string source;
+        uint8_t count;
+        pdu >> serviceType;
+        pdu >> ton;
+        pdu >> npi;
+        pdu >> source;
+        pdu >> count;
+        std::vector<smpp::SmppAddress> unsuccessful;
+
+        for (int i = 0; i < count; i++) {
+            uint8_t flag;
+            pdu >> flag;
+
+            if (flag == smpp::DEST_FLAG_SME) {
+                smpp::SmppAddress address("");
+                pdu >> address.ton;
+                pdu >> address.npi;
+                pdu >> address.value;
+
+                if (isInvalidDestination(address.value)) {
+                    unsuccessful.push_back(address);
+                }
+            } else {
+                std::string listName;
+                pdu >> listName;
+            }
+        }
+
+        std::stringstream id;
+        id << "multi" << pdu.getSequenceNo();
+        smpp::PDU resp(smpp::SUBMIT_MULTI_RESP, smpp::ESME_ROK, pdu.getSequenceNo());
+        resp << id.str();
+        resp << static_cast<uint8_t>(unsuccessful.size());
+
+        for (size_t i = 0; i < unsuccessful.size(); i++) {
+            resp << unsuccessful[i];
+            resp << smpp::ESME_RINVDSTADR;
+        }
+
+        writePdu(socket, resp);
+    }
+
+    static smpp::PDU readPdu(boost::asio::ip::tcp::socket &socket) {
+        boost::shared_array<uint8_t> header(new uint8_t[smpp::HEADERFIELD_SIZE]);
+        boost::asio::read(socket, boost::asio::buffer(header.get(), smpp::HEADERFIELD_SIZE));
+        uint32_t len = smpp::PDU::getPduLength(header);
+        boost::shared_array<uint8_t> body(new uint8_t[len - smpp::HEADERFIELD_SIZE]);
+        boost::asio::read(socket, boost::asio::buffer(body.get(), len - smpp::HEADERFIELD_SIZE));
+        return smpp::PDU(header, body);
+    }
+
+    static void writePdu(boost::asio::ip::tcp::socket &socket, smpp::PDU &pdu) {
+        boost::asio::write(socket, boost::asio::buffer(pdu.getOctets().get(), pdu.getSize()));
+    }
+
+    /**
+     * Waits a little for the client to send more.
+     * @return True if there is data to read.
+     */
+    static bool waitForData(boost::asio::ip::tcp::socket &socket) {
+        for (int i = 0; i < 20; i++) {
+            if (socket.available() > 0) {
+                return true;
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        return false;
+    }
+
+    static void answerSubmits(boost::asio::ip::tcp::socket &socket, std::vector<uint32_t>* pending) {
+        for (std::vector<uint32_t>::reverse_iterator it = pending->rbegin(); it != pending->rend(); it++) {
+            std::stringstream id;
+            id << "msg" << *it;
+            smpp::PDU resp(smpp::SUBMIT_SM_RESP, smpp::ESME_ROK, *it);
+            resp << id.str();
+            writePdu(socket, resp);
+        }
+
+        pending->clear();
+    }
+
+    static void deliverSms(boost::asio::ip::tcp::socket &socket, const int n) {
+        for (int i = 1; i <= n; i++) {
+            std::stringstream message;
+            message << "delivery " << i;
+            smpp::PDU pdu(smpp::DELIVER_SM, smpp::ESME_ROK, i);
+            pdu << std::string("");
+            pdu << smpp::SmppAddress("4513371337", smpp::TON_INTERNATIONAL, smpp::NPI_E164);
+            pdu << smpp::SmppAddress("CPPSMPP", smpp::TON_ALPHANUMERIC, smpp::NPI_UNKNOWN);
+            pdu << uint8_t(0);  // esm_class
+            pdu << uint8_t(0);  // protocol_id
+            pdu << uint8_t(0);  // priority_flag
+            pdu << std::string("");
+            pdu << std::string("");
+            pdu << uint8_t(0);  // registered_delivery
+            pdu << uint8_t(0);  // replace_if_present_flag
+            pdu << uint8_t(smpp::DATA_CODING_DEFAULT);
+            pdu << uint8_t(0);  // sm_default_msg_id
+            pdu << static_cast<uint8_t>(message.str().length());
+            pdu.addOctets(reinterpret_cast<const uint8_t*>(message.str().data()), message.str().length());
+            writePdu(socket, pdu);
+        }
+    }
+
+    void serve(std::shared_ptr<boost::asio::ip::tcp::socket> socket, const int index) {
+        std::vector<uint32_t> pending;
+
+        try {
+            while (true) {
+                if (!pending.empty() && !waitForData(*socket)) {
+                    answerSubmits(*socket, &pending);
+                }
+
+                smpp::PDU pdu = readPdu(*socket);
+                uint32_t cmdId = pdu.getCommandId();
+
+                switch (cmdId) {
+                case smpp::BIND_RECEIVER:
+                case smpp::BIND_TRANSMITTER:
+                case smpp::BIND_TRANSCEIVER: {
+                    bindCount++;
+
+                    if (refusedBinds > 0) {
+                        refusedBinds--;
+                        smpp::PDU resp(cmdId | smpp::GENERIC_NACK, smpp::ESME_RBINDFAIL, pdu.getSequenceNo());
+                        writePdu(*socket, resp);
+                        break;
+                    }
+
+                    smpp::PDU resp(cmdId | smpp::GENERIC_NACK, smpp::ESME_ROK, pdu.getSequenceNo());
+                    resp << std::string("simulator");
+                    writePdu(*socket, resp);
+
+                    if (cmdId != smpp::BIND_TRANSMITTER) {
+                        deliverSms(*socket, deliveriesOnBind);
+
+                        if (unbindAfterDeliveries) {
+                            smpp::PDU enquireLink(smpp::ENQUIRE_LINK, smpp::ESME_ROK, deliveriesOnBind + 1);
+                            writePdu(*socket, enquireLink);
+                            smpp::PDU unbind(smpp::UNBIND, smpp::ESME_ROK, deliveriesOnBind + 2);
+                            writePdu(*socket, unbind);
+                        }
+                    }
+
+                    break;
+                }
+
+                case smpp::SUBMIT_SM: {
+                    submitCount++;
+
+                    if (submitCount == dropAtSubmit) {
+                        ::shutdown(socket->native_handle(), SHUT_RDWR);
+                        return;
+                    }
+
+                    if (index == throttledConnection || !admitSubmit()) {
+                        smpp::PDU resp(smpp::SUBMIT_SM_RESP, smpp::ESME_RTHROTTLED, pdu.getSequenceNo());
+                        writePdu(*socket, resp);
+                        break;
+                    }
+
+                    std::string serviceType;
+                    smpp::SmppAddress source("");
+                    smpp::SmppAddress destination("");
+                    pdu >> serviceType;
+                    pdu >> source.ton;
+                    pdu >> source.npi;
+                    pdu >> source.value;
+                    pdu >> destination.ton;
+                    pdu >> destination.npi;
+                    pdu >> destination.value;
+
+                    if (isInvalidDestination(destination.value)) {
+                        smpp::PDU resp(smpp::SUBMIT_SM_RESP, smpp::ESME_RINVDSTADR, pdu.getSequenceNo());
+                        writePdu(*socket, resp);
+                        break;
+                    }
+
+                    if (isUnansweredDestination(destination.value)) {
+                        break;
+                    }
+
+                    pending.push_back(pdu.getSequenceNo());
+                    int n = pending.size();
+
+                    if (n > maxPending) {
+                        maxPending = n;
+                    }
+
+                    if (n >= reverseBatch) {
+                        answerSubmits(*socket, &pending);
+                    }
+
+                    break;
+                }
+
+                case smpp::SUBMIT_MULTI:
+                    if (!submitMultiSupported) {
+                        smpp::PDU resp(smpp::GENERIC_NACK, smpp::ESME_RINVCMDID, pdu.getSequenceNo());
+                        writePdu(*socket, resp);
+                        break;
+                    }
+
+                    submitMultiCount++;
+                    answerSubmitMulti(*socket, pdu);
+                    break;
+
+                case smpp::QUERY_SM: {
+                    std::string messageId;
+                    pdu >> messageId;
+
+                    if (messageId == "corrupt") {
+                        uint32_t header[4] = { htonl(8), htonl(smpp::QUERY_SM_RESP), 0, htonl(pdu.getSequenceNo()) };
+                        boost::asio::write(*socket, boost::asio::buffer(header, sizeof(header)));
+                        break;
+                    }
+
+                    smpp::PDU resp(smpp::QUERY_SM_RESP, smpp::ESME_ROK, pdu.getSequenceNo());
+                    resp << messageId;
+                    resp << std::string(messageId == "malformed" ? "garbage" : "");
+                    resp << smpp::STATE_DELIVERED;
+                    resp << uint8_t(0);
+                    writePdu(*socket, resp);
+                    break;
+                }
+
+                case smpp::ENQUIRE_LINK: {
+                    enquireLinkCount++;
+
+                    if (enquireLinkAnswered) {
+                        smpp::PDU resp(smpp::ENQUIRE_LINK_RESP, smpp::ESME_ROK, pdu.getSequenceNo());
+                        writePdu(*socket, resp);
+                    }
+
+                    break;
+                }
+
+                case smpp::UNBIND: {
+                    smpp::PDU resp(cmdId | smpp::GENERIC_NACK, smpp::ESME_ROK, pdu.getSequenceNo());
+                    writePdu(*socket, resp);
+                    break;
+                }
+
+                default:
+                    if (cmdId & smpp::GENERIC_NACK) {
+                        std::lock_guard<std::mutex> lock(countMutex);
+                        responseCounts[cmdId]++;
+
+                        if (pdu.getCommandStatus() != smpp::ESME_ROK) {
+                            rejectedCounts[cmdId]++;
+                        }
+                    } else {
+                        smpp::PDU resp(smpp::GENERIC_NACK, smpp::ESME_RINVCMDID, pdu.getSequenceNo());
+                        writePdu(*socket, resp);
+                    }
+                }
+            }
+        } catch (std::exception &e) {
+            // the client hung up
+        }
+    }
+};
+
+/**
+ * Fixture of tests against a simulator, which open their own connections.
+ */
+class SimulatorTest: public testing::Test {
+public:
+    SmscSimulator smsc;
+    boost::asio::io_service ios;
+    smpp::SmppAddress from;
+    smpp::SmppAddress to;
+
+    SimulatorTest() :
+            smsc(),
+            ios(),
+            from("CPPSMPP", smpp::TON_ALPHANUMERIC, smpp::NPI_UNKNOWN),
+            to("4513371337", smpp::TON_INTERNATIONAL, smpp::NPI_E164) {
+    }
+
+    /**
+     * @return Socket connected to the simulator.
+     */
+    std::shared_ptr<boost::asio::ip::tcp::socket> connectSocket() {
+        std::shared_ptr<boost::asio::ip::tcp::socket> socket(new boost::asio::ip::tcp::socket(ios));
+        connectSocket(socket.get());
+        return socket;
+    }
+
+    void connectSocket(boost::asio::ip::tcp::socket* socket) {
+        socket->connect(smsc.getEndpoint());
+        // without it Nagle holds back the small PDUs a window lets through
+        socket->set_option(boost::asio::ip::tcp::no_delay(true));
+    }
+
+    /**
+     * Runs the io_service until a number of handlers are done. The read loop of a bound client keeps the
+     * io_service busy, so it can't just be run until it is out of work.
+     */
+    void runUntil(const int &done, const int n) {
+        while (done < n) {
+            ios.run_one();
+        }
+    }
+};
+
+/**
+ * Fixture of tests of a client connected to a simulator. The client is unbound after the test if it still is.
+ */
+class SimulatorClientTest: public SimulatorTest {
+public:
+    std::shared_ptr<boost::asio::ip::tcp::socket> socket;
+    std::shared_ptr<smpp::SmppClient> client;
+
+    SimulatorClientTest() :
+            socket(new boost::asio::ip::tcp::socket(ios)),
+            client(new smpp::SmppClient(socket)) {
+    }
+
+    virtual void SetUp() {
+        connectSocket(socket.get());
+    }
+
+    virtual void TearDown() {
+        if (client->isBound()) {
+            client->unbind();
+        }
+
+        socket->close();
+    }
+};
+#endif  // SMSCSIMULATOR_H_
@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2014 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ */
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "smpp/smppclient.h"
+#include "smpp/spool.h"
+#include "smscsimulator.h"
+
+using smpp::SendSmsResult;
+using smpp::SmppAddress;
+using smpp::SmppClient;
+using smpp::Spool;
+using smpp::SubmitResult;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+using boost::system::error_code;
+
+/**
+ * Spool files in a directory of their own, removed afterwards.
+ */
+class SpoolTest: public testing::Test {
+public:
+    string directory;
+    string path;
+
+    SpoolTest() :
+            directory(),
+            path() {
+    }
+
+    virtual void SetUp() {
+        char name[] = "/tmp/spool_test.XXXXXX";
+        ASSERT_TRUE(mkdtemp(name) != NULL);
+        directory = name;
+        path = directory + "/spool";
+    }
+
+    virtual void TearDown() {
+        for (int i = 0; unlink(segmentPath(i).c_str()) == 0; i++) {
+        }
+
+        rmdir(directory.c_str());
+    }
+
+    string segmentPath(const int n) {
+        std::stringstream ss;
+        ss << path << "." << n;
+        return ss.str();
+    }
+};
+
+static void collect(vector<string>* records, vector<uint64_t>* ids, uint64_t id, const uint8_t* data, uint32_t size) {
+    records->push_back(string(reinterpret_cast<const char*>(data), size));
+    ids->push_back(id);
+}
+
+// Uncommitted PDUs are replayed in order after the spool is opened again
+TEST_F(SpoolTest, replay) {
+    uint64_t last;
+
+    {
+        Spool spool(path, 4096);
+        spool.setSyncInterval(2);
+        uint64_t first = spool.append(reinterpret_cast<const uint8_t*>("first"), 5);
+        uint64_t second = spool.append(reinterpret_cast<const uint8_t*>("second"), 6);
+        last = spool.append(reinterpret_cast<const uint8_t*>("third pdu"), 9);
+        ASSERT_LT(first, second);
+        spool.commit(second);
+        spool.commit(second);
+        spool.commit(12345);
+        ASSERT_EQ(spool.getUncommittedCount(), 2u);
+    }
+
+    Spool spool(path, 4096);
+    vector<string> records;
+    vector<uint64_t> ids;
+    spool.replay(boost::bind(&collect, &records, &ids, _1, _2, _3));
+    ASSERT_EQ(records.size(), 2u);
+    ASSERT_EQ(records[0], "first");
+    ASSERT_EQ(records[1], "third pdu");
+    ASSERT_EQ(ids[1], last);
+    ASSERT_GT(spool.append(reinterpret_cast<const uint8_t*>("fourth"), 6), last);
+
+    spool.commit(ids[0]);
+    spool.commit(ids[1]);
+    ASSERT_EQ(spool.getUncommittedCount(), 1u);
+    ASSERT_THROW(spool.append(reinterpret_cast<const uint8_t*>(string(4096, 'x').data()), 4096),
+                 smpp::SmppException);
+}
+
+// Segments are reused once their PDUs are committed, and a PDU in an old segment holds back the later ones
+TEST_F(SpoolTest, recycle) {
+    string pdu(100, 'x');
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(pdu.data());
+
+    {
+        Spool spool(path, 512);
+
+        for (int i = 0; i < 100; i++) {
+            spool.commit(spool.append(data, pdu.size()));
+        }
+
+        ASSERT_EQ(spool.getSegmentCount(), 1u);
+        ASSERT_LE(spool.getFileCount(), 2u);
+
+        uint64_t held = spool.append(data, pdu.size());
+
+        for (int i = 0; i < 20; i++) {
+            spool.commit(spool.append(data, pdu.size()));
+        }
+
+        ASSERT_GT(spool.getSegmentCount(), 5u);
+        spool.commit(held);
+        ASSERT_EQ(spool.getSegmentCount(), 1u);
+        spool.append(data, pdu.size());
+    }
+
+    // the recycled segments hold no PDUs, though their records were not erased
+    Spool spool(path, 512);
+    ASSERT_EQ(spool.getUncommittedCount(), 1u);
+    ASSERT_EQ(spool.getSegmentCount(), 1u);
+}
+
+// The submits lost with a crashed client are sent again by the next one
+TEST_F(SpoolTest, resend) {
+    SmscSimulator smsc;
+    boost::asio::io_service ios;
+    SmppAddress from("CPPSMPP", smpp::TON_ALPHANUMERIC, smpp::NPI_UNKNOWN);
+    SmppAddress to("4513371337", smpp::TON_INTERNATIONAL, smpp::NPI_E164);
+    int done = 0;
+    int lost = 0;
+
+    {
+        shared_ptr<boost::asio::ip::tcp::socket> socket(new boost::asio::ip::tcp::socket(ios));
+        socket->connect(smsc.getEndpoint());
+        SmppClient client(socket);
+        shared_ptr<Spool> spool(new Spool(path, 4096));
+        client.setSpool(spool);
+        client.setWindowSize(5);
+        client.setReconnect(smsc.getEndpoint());
+        client.onConnectionLost([&](const error_code &) {
+            lost++;
+        });
+        client.bindTransmitter("username", "password");
+        smsc.setDropAtSubmit(3);
+        smsc.setRefusedBinds(1000);
+
+        for (int i = 0; i < 5; i++) {
+            client.asyncSendSms(from, to, "message to send", [&](const error_code &, const SendSmsResult &) {
+                done++;
+            });
+        }
+
+        while (lost == 0) {
+            ios.run_one();
+        }
+
+        // the first two were answered before the connection dropped, the client goes while the rest wait for it
+        // to reconnect, like a process that crashed
+        ASSERT_EQ(done, 2);
+        ASSERT_TRUE(client.isReconnecting());
+        ASSERT_EQ(spool->getUncommittedCount(), 3u);
+    }
+
+    smsc.setRefusedBinds(0);
+
+    shared_ptr<boost::asio::ip::tcp::socket> socket(new boost::asio::ip::tcp::socket(ios));
+    socket->connect(smsc.getEndpoint());
+    SmppClient client(socket);
+    shared_ptr<Spool> spool(new Spool(path, 4096));
+    client.setSpool(spool);
+    ASSERT_THROW(client.resendSpooled([](const error_code &, const SubmitResult &) {}), smpp::SmppException);
+    client.bindTransmitter("username", "password");
+    vector<SubmitResult> results;
+    ASSERT_EQ(client.resendSpooled([&](const error_code &, const SubmitResult &result) {
+        results.push_back(result);
+    }), 3u);
+
+    while (results.size() < 3) {
+        ios.run_one();
+    }
+
+    for (size_t i = 0; i < results.size(); i++) {
+        ASSERT_FALSE(results[i].error);
+        ASSERT_FALSE(results[i].messageId.empty());
+    }
+
+    ASSERT_EQ(spool->getUncommittedCount(), 0u);
+    client.unbind();
+}
+
+// Submits still queued or in flight are not sent twice by a resend during the session
+TEST_F(SpoolTest, resendInSession) {
+    SmscSimulator smsc;
+    boost::asio::io_service ios;
+    SmppAddress from("CPPSMPP", smpp::TON_ALPHANUMERIC, smpp::NPI_UNKNOWN);
+    SmppAddress unanswered("4513379999", smpp::TON_INTERNATIONAL, smpp::NPI_E164);
+    shared_ptr<boost::asio::ip::tcp::socket> socket(new boost::asio::ip::tcp::socket(ios));
+    socket->connect(smsc.getEndpoint());
+    SmppClient client(socket);
+    shared_ptr<Spool> spool(new Spool(path, 4096));
+    client.setSpool(spool);
+    client.setWindowSize(2);
+    client.setSocketReadTimeout(200);
+    client.bindTransmitter("username", "password");
+    int failed = 0;
+
+    for (int i = 0; i < 3; i++) {
+        client.asyncSendSms(from, unanswered, "message to send", [&](const error_code &error, const SendSmsResult &) {
+            if (error) {
+                failed++;
+            }
+        });
+    }
+
+    while (smsc.getSubmitCount() < 2) {
+        ios.run_one();
+    }
+
+    // two in flight and one waiting for the window
+    ASSERT_EQ(client.resendSpooled([](const error_code &, const SubmitResult &) {}), 0u);
+
+    while (failed < 3) {
+        ios.run_one();
+    }
+
+    ASSERT_EQ(smsc.getSubmitCount(), 3);
+    ASSERT_EQ(spool->getUncommittedCount(), 0u);
+    client.unbind();
+}
+
+// A submit that times out is committed when it fails, so it doesn't hold on to its segment
+TEST_F(SpoolTest, timeout) {
+    SmscSimulator smsc;
+    boost::asio::io_service ios;
+    SmppAddress from("CPPSMPP", smpp::TON_ALPHANUMERIC, smpp::NPI_UNKNOWN);
+    SmppAddress to("4513371337", smpp::TON_INTERNATIONAL, smpp::NPI_E164);
+    SmppAddress unanswered("4513379999", smpp::TON_INTERNATIONAL, smpp::NPI_E164);
+    shared_ptr<boost::asio::ip::tcp::socket> socket(new boost::asio::ip::tcp::socket(ios));
+    socket->connect(smsc.getEndpoint());
+    SmppClient client(socket);
+    shared_ptr<Spool> spool(new Spool(path, 512));
+    client.setSpool(spool);
+    client.setSocketReadTimeout(200);
+    client.setTimeoutResolution(10);
+    client.bindTransmitter("username", "password");
+    error_code timedOut;
+
+    client.asyncSendSms(from, unanswered, "message to send", [&](const error_code &error, const SendSmsResult &) {
+        timedOut = error;
+    });
+
+    while (!timedOut) {
+        client.sendSms(from, to, "message to send");
+    }
+
+    ASSERT_EQ(timedOut, boost::asio::error::timed_out);
+
+    for (int i = 0; i < 50; i++) {
+        client.sendSms(from, to, "message to send");
+    }
+
+    ASSERT_EQ(spool->getUncommittedCount(), 0u);
+    ASSERT_LE(spool->getSegmentCount(), 2u);
+    client.unbind();
+}
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
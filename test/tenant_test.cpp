@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2014 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ */
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "smpp/fairscheduler.h"
+#include "smpp/smppclient.h"
+#include "smscsimulator.h"
+
+using smpp::FairScheduler;
+using smpp::SendSmsResult;
+using smpp::TenantStats;
+using std::map;
+using std::string;
+using std::vector;
+using boost::system::error_code;
+
+/**
+ * Pops values until none may go, returning their tenants.
+ */
+static string drain(FairScheduler<int>* scheduler) {
+    string order;
+
+    while (scheduler->front()) {
+        order += scheduler->pop();
+    }
+
+    return order;
+}
+
+// Busy tenants take turns by weight, however much each has queued
+TEST(FairSchedulerTest, weights) {
+    FairScheduler<int> scheduler(1);
+    scheduler.setTenant("b", 2, 0);
+
+    for (int i = 0; i < 6; i++) {
+        scheduler.push("b", 0, i);
+    }
+
+    for (int i = 0; i < 4; i++) {
+        scheduler.push("a", 0, i);
+    }
+
+    ASSERT_EQ(scheduler.size(), 10u);
+    ASSERT_EQ(drain(&scheduler), "bbabbabbaa");
+    ASSERT_TRUE(scheduler.empty());
+    ASSERT_THROW(scheduler.setTenant("a", 0, 0), smpp::SmppException);
+}
+
+// A tenant at its cap is passed over until a value completes, and the stats follow its values
+TEST(FairSchedulerTest, cap) {
+    FairScheduler<int> scheduler(1);
+    scheduler.setTenant("a", 1, 2);
+
+    for (int i = 0; i < 3; i++) {
+        scheduler.push("a", 0, i);
+        scheduler.push("b", 0, i);
+    }
+
+    ASSERT_EQ(drain(&scheduler), "ababb");
+    map<string, TenantStats> stats = scheduler.getStats();
+    ASSERT_EQ(stats["a"].queued, 1u);
+    ASSERT_EQ(stats["a"].inFlight, 2u);
+    ASSERT_EQ(stats["a"].sent, 2u);
+
+    scheduler.complete("a", true);
+    scheduler.complete("b", false);
+    ASSERT_EQ(drain(&scheduler), "a");
+    stats = scheduler.getStats();
+    ASSERT_EQ(stats["a"].answered, 1u);
+    ASSERT_EQ(stats["b"].inFlight, 2u);
+    ASSERT_EQ(stats["b"].answered, 0u);
+}
+
+// Queued values are taken in the order they would have gone
+TEST(FairSchedulerTest, takeAll) {
+    FairScheduler<int> scheduler(2);
+    scheduler.push("a", 0, 1);
+    scheduler.push("a", 1, 2);
+    scheduler.push("b", 0, 3);
+    vector<int> values;
+    scheduler.takeAll(&values);
+    ASSERT_EQ(values.size(), 3u);
+    ASSERT_EQ(values[0], 2);
+    ASSERT_EQ(values[1], 1);
+    ASSERT_EQ(values[2], 3);
+    ASSERT_TRUE(scheduler.empty());
+    ASSERT_EQ(scheduler.getStats()["a"].queued, 0u);
+}
+
+class TenantTest: public SimulatorClientTest {
+public:
+    // Tenants of the SMSes in the order they were answered
+    string answered;
+
+    TenantTest() :
+            answered() {
+    }
+
+    virtual void SetUp() {
+        SimulatorClientTest::SetUp();
+        client->bindTransmitter("username", "password");
+    }
+
+    void store(const string &tenant, const error_code &error, const SendSmsResult &) {
+        ASSERT_FALSE(error);
+        answered += tenant;
+    }
+
+    void run(const size_t count) {
+        while (answered.size() < count) {
+            ios.run_one();
+        }
+    }
+};
+
+// A small tenant isn't held back by the campaign queued before it
+TEST_F(TenantTest, fairShare) {
+    for (int i = 0; i < 8; i++) {
+        client->asyncSendSms("c", from, to, "message to send", boost::bind(&TenantTest::store, this, "c", _1, _2));
+    }
+
+    for (int i = 0; i < 3; i++) {
+        client->trySubmit("o", from, to, "message to send", boost::bind(&TenantTest::store, this, "o", _1, _2));
+    }
+
+    run(11);
+    // the first SMS of the campaign went at once, as the window was empty
+    ASSERT_EQ(answered, "ccocococccc");
+
+    map<string, TenantStats> stats = client->getTenantStats();
+    ASSERT_EQ(stats["c"].sent, 8u);
+    ASSERT_EQ(stats["c"].answered, 8u);
+    ASSERT_EQ(stats["o"].answered, 3u);
+    ASSERT_EQ(stats["o"].queued, 0u);
+    ASSERT_EQ(stats["o"].inFlight, 0u);
+    // the bind went through the tenant of requests without one
+    ASSERT_EQ(stats[""].answered, 1u);
+}
+
+// A tenant at its cap leaves the rest of the window to the others
+TEST_F(TenantTest, maxInFlight) {
+    client->setWindowSize(5);
+    client->setTenant("c", 1, 1);
+
+    for (int i = 0; i < 5; i++) {
+        client->asyncSendSms("c", from, to, "message to send", boost::bind(&TenantTest::store, this, "c", _1, _2));
+    }
+
+    for (int i = 0; i < 3; i++) {
+        client->asyncSendSms("o", from, to, "message to send", boost::bind(&TenantTest::store, this, "o", _1, _2));
+    }
+
+    run(8);
+    ASSERT_EQ(answered, "cooocccc");
+    ASSERT_THROW(client->setTenant("c", 0), smpp::SmppException);
+}
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
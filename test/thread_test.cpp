@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2014 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ */
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "smpp/mpscring.h"
+#include "smpp/smppclient.h"
+#include "smscsimulator.h"
+
+using boost::system::error_code;
+using smpp::MpscRing;
+using smpp::SendSmsResult;
+using std::set;
+using std::string;
+using std::vector;
+
+static const int PRODUCERS = 8;
+static const int MESSAGES = 50;
+
+// Values come out in the order they went in, and a full ring refuses more
+TEST(MpscRingTest, fifo) {
+    MpscRing<int> ring(5);
+    ASSERT_EQ(ring.capacity(), 8u);
+    ASSERT_FALSE(ring.ready());
+
+    for (int i = 0; i < 8; i++) {
+        ASSERT_TRUE(ring.tryPush(i));
+    }
+
+    ASSERT_FALSE(ring.tryPush(8));
+    int value = -1;
+
+    for (int turn = 0; turn < 3; turn++) {
+        for (int i = 0; i < 8; i++) {
+            ASSERT_TRUE(ring.tryPop(&value));
+            ASSERT_EQ(value, turn * 8 + i);
+            ASSERT_TRUE(ring.tryPush((turn + 1) * 8 + i));
+        }
+    }
+
+    ASSERT_TRUE(ring.ready());
+}
+
+// Producer threads push while one thread pops, each producer's values stay in order and none are lost
+TEST(MpscRingTest, producers) {
+    MpscRing<int> ring(64);
+    vector<std::thread> producers;
+    const int count = 10000;
+
+    for (int p = 0; p < PRODUCERS; p++) {
+        producers.push_back(std::thread([&, p]() {
+            for (int i = 0; i < count; i++) {
+                while (!ring.tryPush(p * count + i)) {
+                    std::this_thread::yield();
+                }
+            }
+        }));
+    }
+
+    vector<int> next(PRODUCERS, 0);
+    int value;
+
+    for (int popped = 0; popped < PRODUCERS * count;) {
+        if (!ring.tryPop(&value)) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        ASSERT_EQ(value % count, next[value / count]);
+        next[value / count]++;
+        popped++;
+    }
+
+    for (size_t i = 0; i < producers.size(); i++) {
+        producers[i].join();
+    }
+
+    ASSERT_FALSE(ring.ready());
+}
+
+/**
+ * The io_service is run by a pool of threads, while other threads use the client.
+ * Build with -fsanitize=thread to check the client for data races.
+ */
+class ThreadTest: public SimulatorClientTest {
+public:
+    std::unique_ptr<boost::asio::executor_work_guard<boost::asio::io_service::executor_type> > work;
+    vector<std::thread> threads;
+
+    ThreadTest() :
+            work(new boost::asio::executor_work_guard<boost::asio::io_service::executor_type>(ios.get_executor())),
+            threads() {
+    }
+
+    virtual void SetUp() {
+        SimulatorClientTest::SetUp();
+        client->setRunIoService(false);
+        client->setWindowSize(10);
+
+        for (int i = 0; i < 4; i++) {
+            threads.push_back(std::thread(boost::bind(&boost::asio::io_service::run, &ios)));
+        }
+
+        client->bindTransmitter("username", "password");
+    }
+
+    virtual void TearDown() {
+        if (client->isBound()) {
+            client->unbind();
+        }
+
+        // the read loop keeps the io_service busy after the unbind
+        work.reset();
+        ios.stop();
+
+        for (size_t i = 0; i < threads.size(); i++) {
+            threads[i].join();
+        }
+
+        client.reset();
+    }
+};
+
+// Producer threads send with the synchronous call, each blocking only itself
+TEST_F(ThreadTest, concurrentSendSms) {
+    std::mutex mutex;
+    set<string> ids;
+    std::atomic<int> failed(0);
+    vector<std::thread> producers;
+    // every other producer sends messages long enough to be split, so message references are taken concurrently
+    string longMessage(300, 'x');
+
+    for (int p = 0; p < PRODUCERS; p++) {
+        producers.push_back(std::thread([&, p]() {
+            for (int i = 0; i < MESSAGES; i++) {
+                try {
+                    SendSmsResult result = client->sendSms(from, to, p % 2 == 0 ? "message to send" : longMessage);
+                    std::lock_guard<std::mutex> lock(mutex);
+                    ids.insert(result.first);
+                } catch (std::exception &e) {
+                    failed++;
+                }
+            }
+        }));
+    }
+
+    for (size_t i = 0; i < producers.size(); i++) {
+        producers[i].join();
+    }
+
+    ASSERT_EQ(failed, 0);
+    ASSERT_EQ(ids.size(), static_cast<size_t>(PRODUCERS * MESSAGES));
+    // half the messages have 2 parts
+    ASSERT_EQ(smsc.getSubmitCount(), PRODUCERS * MESSAGES * 3 / 2);
+}
+
+// Producer threads start asynchronous sends, the handlers run on the threads of the io_service
+TEST_F(ThreadTest, concurrentAsyncSendSms) {
+    std::atomic<int> done(0);
+    std::atomic<int> failed(0);
+    std::promise<void> finished;
+    vector<std::thread> producers;
+
+    for (int p = 0; p < PRODUCERS; p++) {
+        producers.push_back(std::thread([&]() {
+            for (int i = 0; i < MESSAGES; i++) {
+                client->asyncSendSms(from, to, "message to send", [&](const error_code &error, const SendSmsResult &) {
+                    if (error) {
+                        failed++;
+                    }
+
+                    if (++done == PRODUCERS * MESSAGES) {
+                        finished.set_value();
+                    }
+                });
+            }
+        }));
+    }
+
+    for (size_t i = 0; i < producers.size(); i++) {
+        producers[i].join();
+    }
+
+    ASSERT_EQ(finished.get_future().wait_for(std::chrono::seconds(30)), std::future_status::ready);
+    ASSERT_EQ(failed, 0);
+    ASSERT_EQ(smsc.getSubmitCount(), PRODUCERS * MESSAGES);
+}
+
+// Producer threads queue without blocking, retrying when the queue is full
+TEST_F(ThreadTest, trySubmit) {
+    std::atomic<int> done(0);
+    std::atomic<int> failed(0);
+    std::atomic<int> refused(0);
+    std::promise<void> finished;
+    vector<std::thread> producers;
+    client->setSubmitQueueCapacity(16);
+
+    for (int p = 0; p < PRODUCERS; p++) {
+        producers.push_back(std::thread([&]() {
+            for (int i = 0; i < MESSAGES; i++) {
+                while (!client->trySubmit(from, to, "message to send",
+                                          [&](const error_code &error, const SendSmsResult &) {
+                                              if (error) {
+                                                  failed++;
+                                              }
+
+                                              if (++done == PRODUCERS * MESSAGES) {
+                                                  finished.set_value();
+                                              }
+                                          })) {
+                    refused++;
+                    std::this_thread::yield();
+                }
+            }
+        }));
+    }
+
+    for (size_t i = 0; i < producers.size(); i++) {
+        producers[i].join();
+    }
+
+    ASSERT_EQ(finished.get_future().wait_for(std::chrono::seconds(30)), std::future_status::ready);
+    ASSERT_EQ(failed, 0);
+    ASSERT_EQ(smsc.getSubmitCount(), PRODUCERS * MESSAGES);
+    ASSERT_EQ(client->getSubmitQueueCapacity(), 16u);
+}
+
+// Synchronous calls mixed with other work on the io_service
+TEST_F(ThreadTest, mixedCalls) {
+    std::atomic<int> ticks(0);
+    vector<std::thread> producers;
+
+    for (int p = 0; p < PRODUCERS; p++) {
+        producers.push_back(std::thread([&]() {
+            for (int i = 0; i < MESSAGES; i++) {
+                boost::asio::post(ios, [&]() {
+                    ticks++;
+                });
+
+                if (i % 10 == 0) {
+                    client->enquireLink();
+                } else {
+                    client->sendSms(from, to, "message to send");
+                }
+            }
+        }));
+    }
+
+    for (size_t i = 0; i < producers.size(); i++) {
+        producers[i].join();
+    }
+
+    ASSERT_EQ(smsc.getSubmitCount(), PRODUCERS * MESSAGES * 9 / 10);
+    ASSERT_GT(ticks, 0);
+}
+
+// A synchronous call from a thread of the io_service would wait for itself
+TEST_F(ThreadTest, syncCallFromIoThread) {
+    std::promise<bool> thrown;
+    boost::asio::post(ios, [&]() {
+        try {
+            client->enquireLink();
+            thrown.set_value(false);
+        } catch (smpp::SmppException &e) {
+            thrown.set_value(true);
+        }
+    });
+    ASSERT_TRUE(thrown.get_future().get());
+    EXPECT_THROW(client->readSms(), smpp::SmppException);
+}
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2014 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ */
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/date_time/local_time/local_time.hpp>
+
+#include <iomanip>
+#include <regex>
+#include <sstream>
+#include <string>
+#include "smpp/timeformat.h"
+
+DEFINE_int32(iterations, 200000, "Number of timestamps to parse or format with each implementation");
+
+using std::string;
+using boost::posix_time::microsec_clock;
+using boost::posix_time::ptime;
+using boost::local_time::local_date_time;
+using boost::local_time::local_sec_clock;
+using boost::local_time::local_time_period;
+
+/**
+ * Parses a timestamp the way parseSmppTimestamp did before the fixed width parser.
+ */
+static smpp::timeformat::DatePair parseWithRegex(const string &time) {
+    static const std::regex pattern("^(\\d{2})(\\d{2})(\\d{2})(\\d{2})(\\d{2})(\\d{2})(\\d{1})(\\d{2})([R+-])$");
+    std::smatch match;
+
+    if (!regex_match(time.begin(), time.end(), match, pattern)) {
+        throw smpp::SmppException(string("Timestamp \"") + time + "\" has the wrong format.");
+    }
+
+    if (match[match.size() - 1] == "R") {
+        boost::posix_time::time_duration td = smpp::timeformat::parseRelativeTimestamp(match);
+        boost::local_time::time_zone_ptr zone(new boost::local_time::posix_time_zone("GMT"));
+        local_date_time ldt = local_sec_clock::local_time(zone);
+        ldt += td;
+        return smpp::timeformat::DatePair(ldt, td);
+    }
+
+    local_date_time ldt = smpp::timeformat::parseAbsoluteTimestamp(match);
+    local_date_time lt = local_sec_clock::local_time(ldt.zone());
+    return smpp::timeformat::DatePair(ldt, local_time_period(ldt, lt).length());
+}
+
+static smpp::timeformat::DatePair parseFixedWidth(const string &time) {
+    return smpp::timeformat::parseSmppTimestamp(time);
+}
+
+/**
+ * Formats a relative timestamp the way getTimeString did before the digit tables.
+ */
+static string formatWithStream(const boost::posix_time::time_duration &td) {
+    std::stringstream output;
+    output << std::setfill('0') << std::setw(2) << 0 << std::setw(2) << 0 << std::setw(2) << td.hours() / 24
+           << std::setw(2) << td.hours() % 24 << std::setw(2) << td.minutes() << std::setw(2) << td.seconds() << "000R";
+    return output.str();
+}
+
+static void formatIntoBuffer(const boost::posix_time::time_duration &td) {
+    smpp::timeformat::TimeString output;
+    smpp::timeformat::getTimeString(td, output);
+}
+
+template<typename Function, typename Input>
+static void run(const string &name, Function parser, const Input &time) {
+    ptime start = microsec_clock::universal_time();
+
+    for (int i = 0; i < FLAGS_iterations; i++) {
+        parser(time);
+    }
+
+    double ns = (microsec_clock::universal_time() - start).total_microseconds() * 1000.0 / FLAGS_iterations;
+    LOG(INFO) << name << " " << time << ": " << ns << " ns/timestamp";
+}
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    FLAGS_logtostderr = true;
+
+    const string timestamps[] = { "111019080000017+", "000002000000000R" };
+
+    for (int i = 0; i < 2; i++) {
+        run("regex       ", &parseWithRegex, timestamps[i]);
+        run("fixed width ", &parseFixedWidth, timestamps[i]);
+    }
+
+    boost::posix_time::time_duration validity(48, 0, 0);
+    run("stringstream", &formatWithStream, validity);
+    run("TimeString  ", &formatIntoBuffer, validity);
+    run("cached      ", &smpp::timeformat::getCachedTimeString, validity);
+    return 0;
+}
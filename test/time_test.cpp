@@ -46,6 +46,32 @@ TEST(TimeTest, absolute) {
     ASSERT_TRUE(!pair3.second.is_not_a_date_time());
 }
 
+TEST(TimeTest, zones) {
+    ASSERT_EQ(smpp::timeformat::getTimeZone(0)->base_utc_offset(), time_duration(0, 0, 0));
+    ASSERT_EQ(smpp::timeformat::getTimeZone(17)->base_utc_offset(), time_duration(4, 15, 0));
+    ASSERT_EQ(smpp::timeformat::getTimeZone(-4)->base_utc_offset(), time_duration(-1, 0, 0));
+    ASSERT_EQ(smpp::timeformat::getTimeZone(-48)->base_utc_offset(), time_duration(-12, 0, 0));
+    ASSERT_EQ(smpp::timeformat::getTimeZone(56)->base_utc_offset(), time_duration(14, 0, 0));
+    EXPECT_THROW(smpp::timeformat::getTimeZone(57), smpp::SmppException);
+    EXPECT_THROW(parseSmppTimestamp("111019080000049-"), smpp::SmppException);
+
+    // Timestamps with the same offset share the zone
+    DatePair pair1 = parseSmppTimestamp("111019080000017+");
+    DatePair pair2 = parseSmppTimestamp("120101000000017+");
+    ASSERT_EQ(pair1.first.zone(), pair2.first.zone());
+    ASSERT_EQ(pair1.first.zone(), smpp::timeformat::getTimeZone(17));
+
+    local_date_time ldt(ptime(date(2011, boost::gregorian::Oct, 19), time_duration(7, 30, 0)),
+                        smpp::timeformat::getTimeZone(-4));
+    ASSERT_EQ(getTimeString(ldt), string("111019063000004-"));
+
+    // UTC, ie. what a posix_time_zone("GMT") was built for
+    ASSERT_EQ(smpp::timeformat::getTimeZone(0), smpp::timeformat::getTimeZone(0));
+    local_date_time utc(ptime(date(2011, boost::gregorian::Oct, 19), time_duration(7, 30, 0)),
+                        smpp::timeformat::getTimeZone(0));
+    ASSERT_EQ(getTimeString(utc), string("111019073000000+"));
+}
+
 TEST(TimeTest, relative) {
     DatePair pair1 = parseSmppTimestamp("000002000000000R");
     ASSERT_EQ(pair1.second, time_duration(48, 0, 0));
@@ -56,6 +82,37 @@ TEST(TimeTest, relative) {
     ASSERT_TRUE(!pair2.first.is_not_a_date_time());
 }
 
+TEST(TimeTest, virtualClock) {
+    smpp::VirtualClock clock(ptime(date(2011, boost::gregorian::Oct, 19), time_duration(7, 30, 0, 250)));
+
+    DatePair pair1 = parseSmppTimestamp("000002000000000R", clock);
+    ASSERT_EQ(pair1.first.utc_time(), ptime(date(2011, boost::gregorian::Oct, 21), time_duration(7, 30, 0)));
+    ASSERT_EQ(pair1.second, time_duration(48, 0, 0));
+
+    // due in one hour
+    DatePair pair2 = parseSmppTimestamp("111019093000004+", clock);
+    ASSERT_EQ(pair2.second, time_duration(-1, 0, 0));
+    clock.advance(time_duration(2, 0, 0));
+    pair2 = parseSmppTimestamp("111019093000004+", clock);
+    ASSERT_EQ(pair2.second, time_duration(1, 0, 0));
+}
+
+TEST(TimeTest, coarseClock) {
+    smpp::CoarseClock clock;
+    ptime first = clock.universalTime();
+    ASSERT_EQ(clock.universalTime(), first);
+    ASSERT_LE(first, smpp::getSystemClock().universalTime());
+    clock.update();
+    ASSERT_GE(clock.universalTime(), first);
+
+    // the steady time is cached the same way, and never behind an earlier reading
+    ptime steady = clock.steadyTime();
+    ASSERT_EQ(clock.steadyTime(), steady);
+    ASSERT_LE(steady, smpp::getSystemClock().steadyTime());
+    clock.update();
+    ASSERT_GE(clock.steadyTime(), steady);
+}
+
 TEST(TimeTest, formats) {
     EXPECT_NO_THROW(parseSmppTimestamp("111019103011100+"));
     EXPECT_NO_THROW(parseSmppTimestamp("000002000000000R"));
@@ -63,6 +120,10 @@ TEST(TimeTest, formats) {
     EXPECT_THROW(parseSmppTimestamp("000002000000000r"), smpp::SmppException);
     EXPECT_THROW(parseSmppTimestamp("0000020000AA000R"), smpp::SmppException);
     EXPECT_THROW(parseSmppTimestamp(""), smpp::SmppException);
+    EXPECT_THROW(parseSmppTimestamp("1110191030111000+"), smpp::SmppException);
+    EXPECT_THROW(parseSmppTimestamp("11101910301X100+"), smpp::SmppException);
+    EXPECT_THROW(parseSmppTimestamp("111019103011100*"), smpp::SmppException);
+    EXPECT_THROW(parseSmppTimestamp("-11019103011100+"), smpp::SmppException);
 }
 
 TEST(TimeTest, dlr) {
@@ -87,6 +148,41 @@ TEST(TimeTest, formatRelative) {
     EXPECT_THROW(getTimeString(time_duration(876143, 34, 29)), smpp::SmppException);  // 876143 would overflow 99 years
 }
 
+// A negative duration has no relative timestamp
+TEST(TimeTest, formatNegative) {
+    smpp::timeformat::TimeString output;
+    EXPECT_THROW(getTimeString(time_duration(-1, 0, 0)), smpp::SmppException);
+    EXPECT_THROW(getTimeString(time_duration(0, 0, -1), output), smpp::SmppException);
+    EXPECT_THROW(getTimeString(-time_duration(48, 30, 0)), smpp::SmppException);
+}
+
+TEST(TimeTest, formatIntoBuffer) {
+    smpp::timeformat::TimeString output;
+    local_date_time ldt(ptime(date(2011, boost::gregorian::Oct, 19), time_duration(7, 30, 0)),
+                        smpp::timeformat::getTimeZone(-4));
+    getTimeString(ldt, output);
+    ASSERT_EQ(string(output), string("111019063000004-"));
+    getTimeString(time_duration(875043, 34, 29), output);
+    ASSERT_EQ(string(output), string("991025033429000R"));
+    EXPECT_THROW(getTimeString(time_duration(876143, 34, 29), output), smpp::SmppException);
+
+    // no terminator when writing into a larger buffer
+    char pdu[] = "xxxxxxxxxxxxxxxxxx";
+    char* end = smpp::timeformat::formatTimeString(time_duration(48, 0, 0), pdu + 1);
+    ASSERT_EQ(end, pdu + 1 + smpp::timeformat::TIME_STRING_LENGTH);
+    ASSERT_EQ(string(pdu), string("x000002000000000Rx"));
+}
+
+TEST(TimeTest, cachedRelative) {
+    const char* first = smpp::timeformat::getCachedTimeString(time_duration(48, 0, 0));
+    ASSERT_EQ(string(first), string("000002000000000R"));
+    // same second, same string
+    ASSERT_EQ(smpp::timeformat::getCachedTimeString(time_duration(48, 0, 0, 500)), first);
+    ASSERT_EQ(string(smpp::timeformat::getCachedTimeString(time_duration(1, 0, 0))), string("000000010000000R"));
+    EXPECT_THROW(smpp::timeformat::getCachedTimeString(time_duration(876143, 34, 29)), smpp::SmppException);
+    ASSERT_EQ(string(smpp::timeformat::getCachedTimeString(time_duration(1, 0, 0))), string("000000010000000R"));
+}
+
 int main(int argc, char** argv) {
     google::ParseCommandLineFlags(&argc, &argv, true);
     google::InitGoogleLogging(argv[0]);
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2014 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ */
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "smpp/smppclient.h"
+#include "smpp/timerwheel.h"
+#include "smscsimulator.h"
+
+using smpp::SendSmsResult;
+using smpp::SmppAddress;
+using smpp::TimerWheel;
+using std::vector;
+using boost::system::error_code;
+
+// Keys expire at their tick, not before
+TEST(TimerWheelTest, expiry) {
+    TimerWheel wheel(8);
+    vector<uint32_t> expired;
+    wheel.schedule(1, 3);
+    wheel.schedule(2, 3);
+    wheel.schedule(3, 5);
+    ASSERT_EQ(wheel.size(), 3u);
+
+    wheel.advance(2, &expired);
+    ASSERT_TRUE(expired.empty());
+    wheel.advance(3, &expired);
+    ASSERT_EQ(expired.size(), 2u);
+    ASSERT_EQ(expired[0], 1u);
+    ASSERT_EQ(expired[1], 2u);
+
+    // going back is ignored
+    wheel.advance(1, &expired);
+    ASSERT_EQ(wheel.getTick(), 3u);
+
+    wheel.advance(5, &expired);
+    ASSERT_EQ(expired.size(), 3u);
+    ASSERT_EQ(expired[2], 3u);
+    ASSERT_TRUE(wheel.empty());
+}
+
+// Cancelled keys never expire
+TEST(TimerWheelTest, cancel) {
+    TimerWheel wheel(8);
+    vector<uint32_t> expired;
+    TimerWheel::Handle first = wheel.schedule(1, 2);
+    wheel.schedule(2, 2);
+    wheel.cancel(first);
+    ASSERT_EQ(wheel.size(), 1u);
+
+    wheel.advance(2, &expired);
+    ASSERT_EQ(expired.size(), 1u);
+    ASSERT_EQ(expired[0], 2u);
+}
+
+// Keys more than one turn away share a slot with nearer ones, and catching up over many turns expires all
+TEST(TimerWheelTest, turns) {
+    TimerWheel wheel(4);
+    vector<uint32_t> expired;
+    wheel.schedule(1, 2);
+    wheel.schedule(2, 6);
+    wheel.schedule(3, 11);
+
+    wheel.advance(2, &expired);
+    ASSERT_EQ(expired.size(), 1u);
+    wheel.advance(5, &expired);
+    ASSERT_EQ(expired.size(), 1u);
+    wheel.advance(6, &expired);
+    ASSERT_EQ(expired.size(), 2u);
+
+    wheel.advance(1000, &expired);
+    ASSERT_EQ(expired.size(), 3u);
+    ASSERT_TRUE(wheel.empty());
+    ASSERT_THROW(TimerWheel(0), smpp::SmppException);
+}
+
+class RequestTimeoutTest: public SimulatorClientTest {
+public:
+    virtual void SetUp() {
+        SimulatorClientTest::SetUp();
+        client->setWindowSize(50);
+        client->bindTransmitter("username", "password");
+    }
+};
+
+static void countResult(int* done, int* timedOut, const error_code &error, const SendSmsResult &) {
+    (*done)++;
+
+    if (error == boost::asio::error::timed_out) {
+        (*timedOut)++;
+    }
+}
+
+// Unanswered submits fail after the read timeout and free their place in the window, answered ones don't
+TEST_F(RequestTimeoutTest, unanswered) {
+    client->setSocketReadTimeout(300);
+    client->setTimeoutResolution(20);
+    SmppAddress unanswered("4513379999", smpp::TON_INTERNATIONAL, smpp::NPI_E164);
+    SmppAddress answered("4513371337", smpp::TON_INTERNATIONAL, smpp::NPI_E164);
+    int done = 0;
+    int timedOut = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < 50; i++) {
+        client->asyncSendSms(from, i % 10 == 0 ? answered : unanswered, "message to send",
+                             boost::bind(&countResult, &done, &timedOut, _1, _2));
+    }
+
+    while (done < 5) {
+        ios.run_one();
+    }
+
+    ASSERT_EQ(timedOut, 0);
+
+    while (done < 50) {
+        ios.run_one();
+    }
+
+    std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
+    ASSERT_EQ(timedOut, 45);
+    ASSERT_GE(elapsed, std::chrono::milliseconds(300));
+    ASSERT_LT(elapsed, std::chrono::milliseconds(1000));
+
+    // the window is empty again
+    ASSERT_EQ(client->sendSms(from, answered, "message to send").second, 1);
+}
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}